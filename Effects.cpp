@@ -4,16 +4,26 @@
 ***************************************/
 
 #include "Effects.h"
+#include <chrono>
+#include <cstring>
 
 # define DOWN (0)
 # define UP (1)
 
+// Time constant of the smoothing of the sliders and potentiometers (see ControlParameter)
+const float parameter_smoothing_ms = 20;
+
 /*************************constants for reverb***************************/
 // These values considered example for a great medium concert hall Reverb
 const float cf1_delay_ms = 29.7;
 const float cf2_delay_ms = 37.1;
 const float cf3_delay_ms = 41.1;
 const float cf4_delay_ms = 43.7;
+// Additional combs of the dense (8 combs) configuration, spread between the classic ones
+const float cf5_delay_ms = 31.3;
+const float cf6_delay_ms = 34.9;
+const float cf7_delay_ms = 39.3;
+const float cf8_delay_ms = 46.1;
 const float apf1_delay_ms = 5;
 const float apf2_delay_ms = 1.7;
 const float apf1_reverb_time_ms = 96.83;
@@ -24,22 +34,54 @@ const float apf1_gain = pow(0.001, apf1_delay_ms/apf1_reverb_time_ms);
 const float apf2_gain = pow(0.001, apf2_delay_ms/apf2_reverb_time_ms);
 /************************************************************************/
 
+const size_t Arena::alignment;
+thread_local Arena* Arena::active = nullptr;
+
+Arena::Arena(size_t capacity) : capacity(capacity), used(0), overflow(0)
+{
+	// Over-allocate, so the arena itself starts on a cache line
+	void* block = ::operator new(capacity + alignment);
+	base = static_cast<unsigned char*>(block);
+	memory = base + ((alignment - (uintptr_t)base % alignment) % alignment);
+}
+
+Arena::~Arena()
+{
+	for (auto object = objects.rbegin(); object != objects.rend(); ++object)
+		object->destroy(object->object);
+	::operator delete(base);
+}
+
+void*
+Arena::allocate(size_t bytes)
+{
+	// Every allocation starts on a cache line, so two effects never share one
+	size_t start = (used + alignment - 1) & ~(alignment - 1);
+	if (start + bytes > capacity)
+		return nullptr;
+	used = start + bytes;
+	return memory + start;
+}
+
 IIRFilter::IIRFilter(unsigned int input_elements_num, FilterElement* input_elements_vals, unsigned int output_elements_num, FilterElement* output_elements_vals) :
-		input_elements_num(input_elements_num), input_elements(new FilterElement[input_elements_num]),
-		output_elements_num(output_elements_num), output_elements(new FilterElement[output_elements_num])
+		input_elements_num(input_elements_num), input_elements(input_elements_vals, input_elements_vals + input_elements_num),
+		output_elements_num(output_elements_num), output_elements(output_elements_vals, output_elements_vals + output_elements_num)
 {
+	// The history holds x[n - max input delay] and y[n - 1 - max output delay]
+	unsigned int max_delay = 0;
 	for (int i = 0; i < input_elements_num ; i++) {
-		input_elements[i] = input_elements_vals[i];
+		max_delay = std::max(max_delay, input_elements[i].delay);
 	}
 	for (int i = 0; i < output_elements_num ; i++) {
-		output_elements[i] = output_elements_vals[i];
+		max_delay = std::max(max_delay, output_elements[i].delay + 1);
 	}
-}
-
-IIRFilter::~IIRFilter()
-{
-	delete [] input_elements;
-	delete [] output_elements;
+	unsigned int size = 1;
+	while (size <= max_delay)
+		size <<= 1;
+	inputs.resize(size);
+	outputs.resize(size);
+	mask = size - 1;
+	wr_ptr = 0;
 }
 
 float
@@ -58,73 +100,646 @@ IIRFilter::process(const RingBuffer<float>& inputs_buffer, const RingBuffer<floa
 	return result;
 }
 
-Effects::Effects(BelaContext *context) : sample_rate(context->audioSampleRate),
-										 audio_frames_per_analog_frame(context->audioFrames/context->analogFrames)
+float
+IIRFilter::process(float in)
+{
+	inputs[wr_ptr] = DenormalGuard::bias(in);
+	
+	// Same taps as with the external RingBuffers: y[n - 1 - d] was written d + 1 samples ago
+	float result = 0;
+	for (int i = 0; i < input_elements_num ; i++) {
+		result += input_elements[i].coefficient * inputs[(wr_ptr - input_elements[i].delay) & mask];
+	}
+	for (int i = 0; i < output_elements_num ; i++) {
+		result -= output_elements[i].coefficient * outputs[(wr_ptr - 1 - output_elements[i].delay) & mask];
+	}
+	
+	outputs[wr_ptr] = result;
+	wr_ptr = (wr_ptr + 1) & mask;
+	return result;
+}
+
+void
+IIRFilter::process(const float* in, float* out, unsigned int frames)
+{
+	// The taps are read through locals, so the compiler keeps them in registers for the whole block
+	const unsigned int input_count = input_elements_num;
+	const unsigned int output_count = output_elements_num;
+	const FilterElement* input_taps = input_elements.data();
+	const FilterElement* output_taps = output_elements.data();
+	float* x = inputs.data();
+	float* y = outputs.data();
+	const unsigned int history_mask = mask;
+	unsigned int position = wr_ptr;
+	DenormalGuard guard;
+	
+	for (unsigned int n = 0; n < frames; n++) {
+		x[position] = DenormalGuard::bias(in[n]);
+		
+		float result = 0;
+		for (unsigned int i = 0; i < input_count; i++) {
+			result += input_taps[i].coefficient * x[(position - input_taps[i].delay) & history_mask];
+		}
+		for (unsigned int i = 0; i < output_count; i++) {
+			result -= output_taps[i].coefficient * y[(position - 1 - output_taps[i].delay) & history_mask];
+		}
+		
+		y[position] = result;
+		out[n] = result;
+		position = (position + 1) & history_mask;
+	}
+	wr_ptr = position;
+}
+
+void
+IIRFilter::reset()
+{
+	std::fill(inputs.begin(), inputs.end(), 0.0f);
+	std::fill(outputs.begin(), outputs.end(), 0.0f);
+	wr_ptr = 0;
+}
+
+// How often the reader thread checks the ring: host builds read faster than realtime (see AudioFileStream::read())
+#ifdef BELA_HOST
+static const std::chrono::milliseconds reader_period(1);
+#else
+static const std::chrono::milliseconds reader_period(50);
+#endif
+
+AudioFileStream::AudioFileStream(const std::string& path, unsigned int channels, bool loop, unsigned int buffer_frames,
+								 unsigned int chunk_frames) :
+		path(path), channels(std::max(channels, 1u)), file_channels(0), file_frames(0), loop(loop),
+		chunk_frames(std::max(chunk_frames, 1u)),
+		ring((size_t)std::max(buffer_frames, this->chunk_frames) * this->channels), file(nullptr), position(0),
+		end_of_file(false), stopping(false), underruns(0),
+#ifdef BELA_HOST
+		blocking(true)
+#else
+		blocking(false)
+#endif
+{
+	SF_INFO info = SF_INFO();
+	file = sf_open(path.c_str(), SFM_READ, &info);
+	if (!file || info.frames <= 0 || info.channels <= 0) {
+		end_of_file = true;
+		return;
+	}
+	file_frames = info.frames;
+	file_channels = info.channels;
+	
+	chunk.resize(this->chunk_frames * file_channels);
+	frames_buffer.resize(this->chunk_frames * this->channels);
+	read_buffer.resize(this->chunk_frames * this->channels);
+	// Half of the ring, and room for at least a chunk
+	refill_space = std::max(ring.capacity() / 2, (size_t)this->chunk_frames * this->channels);
+	
+	// Only the first chunk is read here, the reader thread reads the rest of the buffer
+	if (!fill(1))
+		end_of_file = true;
+	else
+		reader = std::thread(&AudioFileStream::reader_loop, this);
+}
+
+AudioFileStream::~AudioFileStream()
+{
+	{
+		std::lock_guard<std::mutex> lock(reader_mutex);
+		stopping = true;
+	}
+	stop_requested.notify_one();
+	if (reader.joinable())
+		reader.join();
+	if (file)
+		sf_close(file);
+}
+
+bool
+AudioFileStream::fill(unsigned int max_chunks)
+{
+	for (unsigned int c = 0; c < max_chunks && ring.space() >= chunk_frames * channels; c++) {
+		if (position >= file_frames) {
+			if (!loop)
+				return false;
+			position = 0;
+			sf_seek(file, 0, SEEK_SET);
+		}
+		
+		// One read of all of the channels, the frames are read in order so the file only seeks when it loops
+		unsigned int count = std::min(chunk_frames, file_frames - position);
+		unsigned int done = std::max<sf_count_t>(sf_readf_float(file, chunk.data(), count), 0);
+		std::fill(chunk.begin() + done * file_channels, chunk.begin() + count * file_channels, 0.0f);
+		
+		for (unsigned int n = 0; n < count; n++) {
+			const float* frame = &chunk[n * file_channels];
+			for (unsigned int channel = 0; channel < channels; channel++)
+				frames_buffer[n * channels + channel] = frame[std::min(channel, file_channels - 1)];
+		}
+		ring.write(frames_buffer.data(), count * channels);
+		position += count;
+	}
+	
+	return loop || position < file_frames;
+}
+
+void
+AudioFileStream::reader_loop()
+{
+	while (!stopping.load()) {
+		if (!fill(~0u)) {
+			end_of_file = true;
+			return;
+		}
+		// Polls the ring: read() never signals the reader (a wake-up is a syscall, which would take the audio thread
+		// out of realtime mode on Bela), the period is much shorter than the time it takes to play half of the ring
+		std::unique_lock<std::mutex> lock(reader_mutex);
+		stop_requested.wait_for(lock, reader_period,
+								[this] { return ring.space() >= refill_space || stopping.load(); });
+	}
+}
+
+unsigned int
+AudioFileStream::read(float* const* out, unsigned int frames)
+{
+	unsigned int done = 0;
+	while (done < frames && !read_buffer.empty()) {
+		unsigned int wanted = std::min(frames - done, chunk_frames);
+		bool reader_done = end_of_file.load();	// before reading, so the last chunk is not missed
+		unsigned int count = ring.read(read_buffer.data(), wanted * channels) / channels;
+		
+		for (unsigned int n = 0; n < count; n++) {
+			for (unsigned int channel = 0; channel < channels; channel++)
+				out[channel][done + n] = read_buffer[n * channels + channel];
+		}
+		done += count;
+		if (count < wanted) {
+			if (!blocking || reader_done)
+				break;
+			std::this_thread::sleep_for(std::chrono::microseconds(100));
+		}
+	}
+	
+	if (done < frames) {
+		for (unsigned int channel = 0; channel < channels; channel++)
+			std::fill(out[channel] + done, out[channel] + frames, 0.0f);
+		if (!end_of_file.load())
+			underruns++;
+	}
+	return done;
+}
+
+Effects::Effects(BelaContext *context, unsigned int channels) : sample_rate(context->audioSampleRate),
+										 audio_frames_per_analog_frame(context->audioFrames/context->analogFrames),
+										 audio_frames(context->audioFrames), channels(std::max(channels, 1u)),
+										 has_sliders(false), quality(0)
 {}
 
-Distortion::Distortion(BelaContext *context, GuiController* controller) : Effects(context)
+void
+Effects::process_block(const float* in, float* out, unsigned int frames, GuiController* controller)
 {
-	// Arguments: name, default value, minimum, maximum, increment
-	volume_slider_index = controller->addSlider("Volume", 1, 0.025, 1, 0.05);
-	gain_slider_index = controller->addSlider("Gain", 1, 1, 50, 1);
-	type_slider_index = controller->addSlider("Distortion/Overdrive", 0, 0, 1, 1);
+	for (unsigned int n = 0; n < frames; n++) {
+		out[n] = process(in[n], controller);
+	}
 }
 
-// Called by the Distortion class process/process_hardware wrappers, and do the actual processing.
-float static
-__distortion_process(float in, float volume, float gain, bool is_overdrive)
+void
+Effects::process_channels(const float* const* in, float* const* out, unsigned int frames, GuiController* controller)
 {
-	// Boost the amplitude
-    in *= gain;
-    
-    if (!is_overdrive) {
-    	// Hard - Clipping the samples higher than 1 or lower than -1
-	    if(in > 1)
-			in = 1;
-		else if (in < -1)
-			in = -1;
-    }
-    
-    else {
-		// soft clipping	
-		int sign = in > 0 ? 1 : -1;
-		in = sign*(1 - exp(-fabs(in)));
-    }
+	for (unsigned int c = 0; c < channels; c++) {
+		process_block(in[c], out[c], frames, controller);
+	}
+}
+
+Waveshaper::Waveshaper(Curve curve, float (*custom_curve)(float), float input_range, unsigned int table_size) :
+		curve(curve), input_range(input_range), table_size(table_size), scale(table_size / (2 * input_range)),
+		table(2 * (table_size + 1))
+{
+	set_curve(curve, custom_curve);
+}
+
+static float
+__exponential_soft_clip(float in)
+{
+	return copysignf(1.0f - expf(-fabsf(in)), in);
+}
+
+void
+Waveshaper::set_curve(Curve curve, float (*custom_curve)(float))
+{
+	float (*f)(float) = nullptr;
+	switch (curve) {
+		case HARD_CLIP: break;
+		case EXPONENTIAL_SOFT_CLIP: f = __exponential_soft_clip; break;
+		case TANH: f = tanhf; break;
+		case CUSTOM: f = custom_curve; break;
+	}
+	// Hard clip is computed directly and never reads the table, and a custom curve without its function
+	// (in any build, not only in debug ones) falls back to it rather than calling a null pointer
+	if (!f) {
+		this->curve = HARD_CLIP;
+		return;
+	}
+	this->curve = curve;
 	
-	// Normalizing the clipped signal
-	in *= volume;
+	// Sample the curve, and store the slope to the next point with every value
+	for (unsigned int i = 0; i <= table_size; i++) {
+		table[2*i] = f(-input_range + i / scale);
+	}
+	for (unsigned int i = 0; i < table_size; i++) {
+		table[2*i + 1] = table[2*(i + 1)] - table[2*i];
+	}
+	table[2*table_size + 1] = 0;
+}
+
+void
+Waveshaper::process(const float* in, float* out, unsigned int frames, float gain, float volume) const
+{
+	if (curve == HARD_CLIP) {
+		for (unsigned int n = 0; n < frames; n++) {
+			out[n] = fminf(fmaxf(in[n] * gain, -1.0f), 1.0f) * volume;
+		}
+		return;
+	}
 	
-	return in;
+	for (unsigned int n = 0; n < frames; n++) {
+		out[n] = lookup(in[n] * gain) * volume;
+	}
+}
+
+const unsigned int Oversampler::half_taps;
+const unsigned int Oversampler::input_history;
+const unsigned int Oversampler::output_history;
+
+Oversampler::Oversampler(unsigned int max_frames) :
+		max_frames(max_frames), inputs(input_history + max_frames), outputs(output_history + 2 * max_frames)
+{
+	// Odd taps of a halfband windowed sinc, h[k] = sin(pi * k / 2) / (pi * k) * w(k) for k = 2i + 1
+	const double length = 4 * half_taps;
+	double sum = 0;
+	for (unsigned int i = 0; i < half_taps; i++) {
+		const double k = 2 * i + 1;
+		const double window = 0.42 + 0.5 * cos(M_PI * k / (length / 2)) + 0.08 * cos(2 * M_PI * k / (length / 2));
+		coefficients[i] = (i % 2 ? -1 : 1) / (M_PI * k) * window;
+		sum += coefficients[i];
+	}
+	
+	// Normalized so the interpolation has unity gain at DC (twice the halfband taps, which sum to 1/4 per side)
+	for (unsigned int i = 0; i < half_taps; i++)
+		coefficients[i] *= 0.5 / sum;
+}
+
+void
+Oversampler::shift_inputs(unsigned int frames)
+{
+	std::copy(inputs.begin() + frames, inputs.begin() + frames + input_history, inputs.begin());
+}
+
+void
+Oversampler::upsample(const float* in, float* out, unsigned int frames)
+{
+	assert(frames <= max_frames);
+	std::copy(in, in + frames, inputs.begin() + input_history);
+	
+	const float* x = &inputs[0];
+	for (unsigned int n = 0; n < frames; n++) {
+		// The even phase is the input delayed by half_taps, the odd phase is interpolated around it
+		const unsigned int j = input_history + n - half_taps;
+		out[2*n] = x[j];
+		out[2*n + 1] = interpolate(x, j);
+	}
+	
+	shift_inputs(frames);
+}
+
+void
+Oversampler::downsample(const float* in, float* out, unsigned int frames)
+{
+	assert(frames <= max_frames);
+	std::copy(in, in + 2 * frames, outputs.begin() + output_history);
+	
+	const float* w = &outputs[0];
+	for (unsigned int n = 0; n < frames; n++) {
+		// Halfband filter centered half_taps - 1 input samples back: the center tap is 1/2, the even taps are 0
+		const unsigned int center = output_history + 2 * n + 2 - 2 * half_taps;
+		float sum = 0;
+		for (unsigned int i = 0; i < half_taps; i++)
+			sum += coefficients[i] * (w[center - 2*i - 1] + w[center + 2*i + 1]);
+		out[n] = 0.5f * (w[center] + sum);
+	}
+	
+	std::copy(outputs.begin() + 2 * frames, outputs.begin() + 2 * frames + output_history, outputs.begin());
+}
+
+void
+Oversampler::delay(const float* in, float* out, unsigned int frames)
+{
+	assert(frames <= max_frames);
+	std::copy(in, in + frames, inputs.begin() + input_history);
+	std::copy(inputs.begin() + input_history - latency(), inputs.begin() + input_history - latency() + frames, out);
+	shift_inputs(frames);
+}
+
+void
+Oversampler::clear()
+{
+	std::fill(inputs.begin(), inputs.end(), 0.0f);
+	std::fill(outputs.begin(), outputs.end(), 0.0f);
+}
+
+RealFFT::RealFFT(unsigned int size) : size(size), passes(0), twiddles(size), bit_reverse(size / 2), work(size)
+{
+	assert(size >= 4 && (size & (size - 1)) == 0);
+	
+	for (unsigned int k = 0; k < size / 2; k++) {
+		twiddles[2*k] = cos(2 * M_PI * k / size);
+		twiddles[2*k + 1] = -sin(2 * M_PI * k / size);
+	}
+	
+	const unsigned int points = size / 2;
+	while ((1u << passes) < points)
+		passes++;
+	for (unsigned int i = 0; i < points; i++) {
+		unsigned int reversed = 0;
+		for (unsigned int b = 0; b < passes; b++)
+			reversed |= ((i >> b) & 1) << (passes - 1 - b);
+		bit_reverse[i] = reversed;
+	}
+}
+
+void
+RealFFT::butterflies(float* data, unsigned int pass, bool inverse) const
+{
+	// Radix-2 butterflies, the twiddles of a length 'length' FFT are every (size / length)th twiddle
+	const unsigned int points = size / 2;
+	const unsigned int length = 1u << pass;
+	const unsigned int half = length / 2;
+	const unsigned int step = size / length;
+	const float sign = inverse ? -1 : 1;
+	for (unsigned int start = 0; start < points; start += length) {
+		for (unsigned int k = 0; k < half; k++) {
+			float wr = twiddles[2*k*step];
+			float wi = sign * twiddles[2*k*step + 1];
+			float* a = data + 2*(start + k);
+			float* b = a + 2*half;
+			float tr = wr * b[0] - wi * b[1];
+			float ti = wr * b[1] + wi * b[0];
+			b[0] = a[0] - tr;
+			b[1] = a[1] - ti;
+			a[0] += tr;
+			a[1] += ti;
+		}
+	}
+}
+
+void
+RealFFT::forward_step(const float* in, float* re, float* im, float* buffer, unsigned int step) const
+{
+	const unsigned int points = size / 2;
+	
+	if (step == 0) {
+		// Even samples as the real part, odd samples as the imaginary part, in bit reversed order
+		for (unsigned int i = 0; i < points; i++) {
+			buffer[2*bit_reverse[i]] = in[2*i];
+			buffer[2*bit_reverse[i] + 1] = in[2*i + 1];
+		}
+		return;
+	}
+	if (step <= passes) {
+		butterflies(buffer, step, false);
+		return;
+	}
+	
+	// Split: X[k] = E[k] + W^k O[k], with E = (Z[k] + conj(Z[M-k])) / 2 and O = -i (Z[k] - conj(Z[M-k])) / 2
+	const float* z = buffer;
+	re[0] = z[0] + z[1];
+	im[0] = 0;
+	re[points] = z[0] - z[1];
+	im[points] = 0;
+	for (unsigned int k = 1; k < points; k++) {
+		const float* zk = z + 2*k;
+		const float* zm = z + 2*(points - k);
+		float er = 0.5f * (zk[0] + zm[0]);
+		float ei = 0.5f * (zk[1] - zm[1]);
+		float or_ = 0.5f * (zk[1] + zm[1]);
+		float oi = -0.5f * (zk[0] - zm[0]);
+		float wr = twiddles[2*k];
+		float wi = twiddles[2*k + 1];
+		re[k] = er + wr * or_ - wi * oi;
+		im[k] = ei + wr * oi + wi * or_;
+	}
+}
+
+void
+RealFFT::inverse_step(const float* re, const float* im, float* out, float* buffer, unsigned int step) const
+{
+	const unsigned int points = size / 2;
+	
+	if (step == 0) {
+		// Undo the split: Z[k] = E[k] + i O[k], with E = X[k] + conj(X[M-k]) and O = (X[k] - conj(X[M-k])) conj(W^k)
+		// (both twice their forward value, so the unscaled inverse gives N times the signal), in bit reversed order
+		float* z = buffer;
+		z[0] = re[0] + re[points];
+		z[1] = re[0] - re[points];
+		for (unsigned int k = 1; k < points; k++) {
+			float er = re[k] + re[points - k];
+			float ei = im[k] - im[points - k];
+			float dr = re[k] - re[points - k];
+			float di = im[k] + im[points - k];
+			float wr = twiddles[2*k];
+			float wi = twiddles[2*k + 1];
+			float or_ = dr * wr + di * wi;
+			float oi = di * wr - dr * wi;
+			z[2*bit_reverse[k]] = er - oi;
+			z[2*bit_reverse[k] + 1] = ei + or_;
+		}
+		return;
+	}
+	if (step <= passes) {
+		butterflies(buffer, step, true);
+		return;
+	}
+	std::copy(buffer, buffer + size, out);
+}
+
+void
+RealFFT::forward(const float* in, float* re, float* im) const
+{
+	for (unsigned int step = 0; step < get_steps(); step++)
+		forward_step(in, re, im, work.data(), step);
+}
+
+void
+RealFFT::inverse(const float* re, const float* im, float* out) const
+{
+	for (unsigned int step = 0; step < get_steps(); step++)
+		inverse_step(re, im, out, work.data(), step);
+}
+
+Distortion::Distortion(BelaContext *context, GuiController* controller, Waveshaper::Curve overdrive_curve, float (*custom_curve)(float),
+					   unsigned int channels, unsigned int oversampling) :
+		Effects(context, channels), clipper(Waveshaper::HARD_CLIP), overdrive(overdrive_curve, custom_curve),
+		shaper_in_use(&clipper), oversampling(oversampling),
+		smoothed_volume(sample_rate, parameter_smoothing_ms), smoothed_gain(sample_rate, parameter_smoothing_ms)
+{
+	assert(oversampling == 1 || oversampling == 2);
+	if (oversampling == 2) {
+		oversamplers.reserve(this->channels);
+		for (unsigned int c = 0; c < this->channels; c++)
+			oversamplers.emplace_back(audio_frames);
+		oversampled_block.resize(2 * audio_frames);
+	}
+	
+	const Parameters defaults;
+	has_sliders = controller != nullptr;
+	if (has_sliders) {
+		// Arguments: name, default value, minimum, maximum, increment
+		volume_slider_index = controller->addSlider("Volume", defaults.volume, 0.025, 1, 0.05);
+		gain_slider_index = controller->addSlider("Gain", defaults.gain, 1, 50, 1);
+		type_slider_index = controller->addSlider("Distortion/Overdrive", defaults.is_overdrive, 0, 1, 1);
+	}
+	parameters.write(has_sliders ? read_sliders(controller) : defaults);
+}
+
+Distortion::Parameters
+Distortion::read_sliders(GuiController* controller) const
+{
+	Parameters result;
+	result.volume = controller->getSliderValue(volume_slider_index);
+	result.gain = controller->getSliderValue(gain_slider_index);
+	result.is_overdrive = controller->getSliderValue(type_slider_index);
+	return result;
+}
+
+void
+Distortion::publish(GuiController* controller)
+{
+	if (has_sliders)
+		parameters.write(read_sliders(controller));
 }
 
 float
 Distortion::process(float in, GuiController* controller)
 {
-	float volume = controller->getSliderValue(volume_slider_index);
-    float gain = controller->getSliderValue(gain_slider_index);
-	bool is_overdrive = controller->getSliderValue(type_slider_index);
+	Parameters p = current_parameters(controller);
+	smoothed_volume.set(p.volume);
+	smoothed_gain.set(p.gain);
     
-	return __distortion_process(in, volume, gain, is_overdrive);
+	// Boost the amplitude, clip, and normalize the clipped signal
+	const Waveshaper& shaper = p.is_overdrive ? overdrive : clipper;
+	float out;
+	shape_block(0, shaper, &in, &out, 1, smoothed_gain.update(1), smoothed_volume.update(1));
+	return out;
+}
+
+void
+Distortion::process_block(const float* in, float* out, unsigned int frames, GuiController* controller)
+{
+	Parameters p = current_parameters(controller);
+	smoothed_volume.set(p.volume);
+	smoothed_gain.set(p.gain);
+	
+	// The mode is fixed for the whole block, so the inner loop does not branch on it
+	const Waveshaper& shaper = p.is_overdrive ? overdrive : clipper;
+	shape_block(0, shaper, in, out, frames, smoothed_gain.update(frames), smoothed_volume.update(frames));
+}
+
+void
+Distortion::process_channels(const float* const* in, float* const* out, unsigned int frames, GuiController* controller)
+{
+	Parameters p = current_parameters(controller);
+	smoothed_volume.set(p.volume);
+	smoothed_gain.set(p.gain);
+	
+	// Same parameters for all the channels, each with its own oversampling filters
+	const Waveshaper& shaper = p.is_overdrive ? overdrive : clipper;
+	const float gain = smoothed_gain.update(frames);
+	const float volume = smoothed_volume.update(frames);
+	for (unsigned int c = 0; c < channels; c++) {
+		shape_block(c, shaper, in[c], out[c], frames, gain, volume);
+	}
+}
+
+void
+Distortion::shape_block(unsigned int channel, const Waveshaper& shaper, const float* in, float* out, unsigned int frames,
+						float gain, float volume)
+{
+	shaper_in_use = &shaper;
+	if (oversampling == 1) {
+		shaper.process(in, out, frames, gain, volume);
+		return;
+	}
+	
+	// Blocks longer than the initialized block size are oversampled in pieces
+	Oversampler& oversampler = oversamplers[channel];
+	for (unsigned int start = 0; start < frames; start += audio_frames) {
+		const unsigned int piece = std::min(frames - start, audio_frames);
+		if (quality == 0) {
+			float* block = &oversampled_block[0];
+			oversampler.upsample(in + start, block, piece);
+			shaper.process(block, block, 2 * piece, gain, volume);
+			oversampler.downsample(block, out + start, piece);
+		}
+		else {
+			// Delayed as much as the oversampled path, so changing the tier does not shift the signal
+			oversampler.delay(in + start, out + start, piece);
+			shaper.process(out + start, out + start, piece, gain, volume);
+		}
+	}
+}
+
+void
+Distortion::set_quality(unsigned int tier)
+{
+	const unsigned int previous = quality;
+	quality = std::min(tier, get_quality_tiers() - 1);
+	if (quality == 0 && previous != 0) {
+		// The downsampler continues from what the oversampled path would have output
+		const Waveshaper& shaper = *shaper_in_use;
+		const float gain = smoothed_gain.get();
+		const float volume = smoothed_volume.get();
+		for (Oversampler& oversampler : oversamplers)
+			oversampler.prime([&](float x) { return shaper.process(x * gain) * volume; });
+	}
+}
+
+void
+Distortion::reset()
+{
+	smoothed_volume.reset();
+	smoothed_gain.reset();
+	for (Oversampler& oversampler : oversamplers)
+		oversampler.clear();
 }
 
 float
 Distortion::process_hardware(float in, unsigned int index, BelaContext* context)
 {
-	float volume = 1;
-	float gain = 1;
 	if(!(index % audio_frames_per_analog_frame)) {
-			// read analog inputs and update volume and gain
-			volume = analogRead(context, index/2, 0);
-			volume = map(volume, 0, 0.85, 0.1, 1);
-			gain = analogRead(context, index/2, 1);
-			gain = map(gain, 0, 0.85, 1, 50);
+			// read analog inputs and update volume and gain, they are held until the next analog frame
+			unsigned int analog_frame = index / audio_frames_per_analog_frame;
+			smoothed_volume.set(map(analogRead(context, analog_frame, 0), 0, 0.85, 0.1, 1));
+			smoothed_gain.set(map(analogRead(context, analog_frame, 1), 0, 0.85, 1, 50));
+			smoothed_volume.update(audio_frames_per_analog_frame);
+			smoothed_gain.update(audio_frames_per_analog_frame);
 	}
 	
-	return __distortion_process(in, volume, gain, 0);
+	// Boost the amplitude, hard clip, and normalize the clipped signal
+	float out;
+	shape_block(0, clipper, &in, &out, 1, smoothed_gain.get(), smoothed_volume.get());
+	return out;
 }
 
 
-WahWah::WahWah(BelaContext *context, GuiController* controller) : Effects(context), fc(1000), direction(DOWN)
+// The tan() table covers center frequencies up to this fraction of the sample rate
+const float wahwah_table_max_fc = 0.45;
+const unsigned int wahwah_table_size = 2048;
+
+WahWah::WahWah(BelaContext *context, GuiController* controller, CoefficientMode coefficient_mode, unsigned int control_period,
+			   unsigned int channels) :
+		Effects(context, channels), fc(1000), direction(DOWN),
+		coefficient_mode(coefficient_mode), control_period(std::max(control_period, 1u)),
+		base_control_period(this->control_period), control_counter(0),
+		coefficients_valid(false), coefficients{0, 0, 0}, coefficients_step{0, 0, 0},
+		z1((this->channels + 3) / 4, float4{0, 0, 0, 0}), z2((this->channels + 3) / 4, float4{0, 0, 0, 0}), tan_table_scale(0)
 {
 	double Fs = context->audioSampleRate;
 	
@@ -136,26 +751,55 @@ WahWah::WahWah(BelaContext *context, GuiController* controller) : Effects(contex
 			.q = 1,
 			.peakGainDb = 0,
 			};
-	bpFilter.setup(settings);
+	bpFilters.resize(this->channels);
+	for (Biquad& filter : bpFilters) {
+		filter.setup(settings);
+	}
 	
-	q_slider_index = controller->addSlider("Q", 2.5, 0.1, 10, 0.1);
-	movement_rate_slider_index = controller->addSlider("Movement Rate", 2000, 1000, 10000, 500);
-	minf_slider_index = controller->addSlider("Min Freq", 500, 100, 10000, 100);
-	maxf_slider_index = controller->addSlider("Max Freq ", 5000, 1000, 10000, 100);
-	dry_wet_slider_index = controller->addSlider("Dry/Wet ", 0, 0, 1, 0.05);
+	if (coefficient_mode == TABLE) {
+		tan_table.resize(wahwah_table_size + 2);
+		tan_table_scale = wahwah_table_size / (wahwah_table_max_fc * sample_rate);
+		for (unsigned int i = 0; i < tan_table.size(); i++) {
+			tan_table[i] = tan(M_PI * (i / tan_table_scale) / sample_rate);
+		}
+	}
+	const Parameters defaults;
+	has_sliders = controller != nullptr;
+	if (has_sliders) {
+		q_slider_index = controller->addSlider("Q", defaults.q, 0.1, 10, 0.1);
+		movement_rate_slider_index = controller->addSlider("Movement Rate", defaults.movement_rate, 1000, 10000, 500);
+		minf_slider_index = controller->addSlider("Min Freq", defaults.minf, 100, 10000, 100);
+		maxf_slider_index = controller->addSlider("Max Freq ", defaults.maxf, 1000, 10000, 100);
+		dry_wet_slider_index = controller->addSlider("Dry/Wet ", defaults.mix_percent, 0, 1, 0.05);
+	}
+	parameters.write(has_sliders ? read_sliders(controller) : defaults);
 }
 
-float
-WahWah::process(float in, GuiController* controller)
+WahWah::Parameters
+WahWah::read_sliders(GuiController* controller) const
 {
-	float out = 0.0;
- 	double fc_wave = 0.0;
-	double delta = controller->getSliderValue(movement_rate_slider_index)/sample_rate;
-	double minf = controller->getSliderValue(minf_slider_index);
-	double maxf = controller->getSliderValue(maxf_slider_index);
+	Parameters result;
+	result.q = controller->getSliderValue(q_slider_index);
+	result.movement_rate = controller->getSliderValue(movement_rate_slider_index);
+	result.minf = controller->getSliderValue(minf_slider_index);
+	result.maxf = controller->getSliderValue(maxf_slider_index);
+	result.mix_percent = controller->getSliderValue(dry_wet_slider_index);
+	return result;
+}
+
+void
+WahWah::publish(GuiController* controller)
+{
+	if (has_sliders)
+		parameters.write(read_sliders(controller));
+}
+
+double
+WahWah::next_fc(double delta, double minf, double maxf)
+{
+	double fc_wave = fc;
 	
 	if (direction == DOWN) {
-		fc_wave = fc;
 		fc = fc - delta;
 		if (fc < minf) {
 			fc = minf;
@@ -164,7 +808,6 @@ WahWah::process(float in, GuiController* controller)
 	}
 	
 	else if (direction == UP) {
-		fc_wave = fc;
 		fc = fc + delta;
 		if (fc > maxf) {
 			fc = maxf;
@@ -172,122 +815,1778 @@ WahWah::process(float in, GuiController* controller)
 		}
 	}
 	
-    double q = controller->getSliderValue(q_slider_index);
-	bpFilter.setQ(q);
-	bpFilter.setFc(fc_wave);
-	out = bpFilter.process(in);
-	
-	// Dry/Wet Mix
-    float mix_percent = controller->getSliderValue(dry_wet_slider_index);
-    out = ((1 - mix_percent) * in) + (mix_percent * out * 10);	// normalizing factor can be changed later
-	
-	return out;
+	return fc_wave;
 }
 
-Reverb::Reverb(BelaContext *context, GuiController* controller) : Effects(context),
-		cf1(sample_rate), cf2(sample_rate), cf3(sample_rate), cf4(sample_rate),
-		apf1_in(sample_rate), apf1_out(sample_rate), apf2_out(sample_rate),
-		cf1_delay((int)( cf1_delay_ms * (sample_rate/1000))), cf2_delay((int)( cf2_delay_ms * (sample_rate/1000))),
-		cf3_delay((int)( cf3_delay_ms * (sample_rate/1000))), cf4_delay((int)( cf4_delay_ms * (sample_rate/1000))),
-		apf1_delay((int)( apf1_delay_ms * (sample_rate/1000))), apf2_delay((int)( apf2_delay_ms * (sample_rate/1000)))
+WahWah::BandpassCoefficients
+WahWah::design(double fc_wave, float inv_q) const
 {
-	reverb_time_slider_index = controller->addSlider("Reverb Time (ms)", 1000, 0.1, 3000, 100);
-	mix_slider_index = controller->addSlider("Mix Percentage", 0.0, 0.0, 1.0, 0.05);
+	float K;
+	if (coefficient_mode == TABLE) {
+		float position = fminf(fc_wave * tan_table_scale, wahwah_table_size);
+		unsigned int index = (unsigned int)position;
+		K = tan_table[index] + (position - index) * (tan_table[index + 1] - tan_table[index]);
+	}
+	else {
+		K = tan(M_PI * fc_wave / sample_rate);
+	}
+	
+	// Same band-pass design as the Biquad library
+	float norm = 1 / (1 + K * inv_q + K * K);
+	BandpassCoefficients result;
+	result.b0 = K * inv_q * norm;
+	result.a1 = 2 * (K * K - 1) * norm;
+	result.a2 = (1 - K * inv_q + K * K) * norm;
+	return result;
 }
 
-float
-Reverb::process(float in, GuiController* controller)
+void
+WahWah::set_control_period(unsigned int period)
 {
-	float reverb_time = controller->getSliderValue(reverb_time_slider_index);
-	float mix_percent = controller->getSliderValue(mix_slider_index);
-	
-	// g = 0.001 power of delay_time over reverb_time (-60db decrease, time to completely decay) 
-	float cf1_gain = pow(0.001,cf1_delay_ms/reverb_time);
-	float cf2_gain = pow(0.001,cf2_delay_ms/reverb_time);
-	float cf3_gain = pow(0.001,cf3_delay_ms/reverb_time);
-	float cf4_gain = pow(0.001,cf4_delay_ms/reverb_time);
-    	
-    float cf1_out_delay_sample = cf1.read(cf1_delay);			//y[n-D] for each CF
-    float cf2_out_delay_sample = cf2.read(cf2_delay); 
-    float cf3_out_delay_sample = cf3.read(cf3_delay); 
-    float cf4_out_delay_sample = cf4.read(cf4_delay); 
-    
-    float apf1_input_delay_sample = apf1_in.read(apf1_delay);	//x[n-D] for APF1
-    float apf1_output_delay_sample = apf1_out.read(apf1_delay); //y[n-D] for APF1
-    
-    float apf2_in_delay_sample = apf1_out.read(apf2_delay);		//x[n-D] for APF2
-    float apf2_out_delay_sample = apf2_out.read(apf2_delay);	//y[n-D] for APF2
-
-    cf1.write(in + cf1_out_delay_sample * cf1_gain);
-    cf2.write(in + cf2_out_delay_sample * cf2_gain);
-    cf3.write(in + cf3_out_delay_sample * cf3_gain);
-    cf4.write(in + cf4_out_delay_sample * cf4_gain);
-    
-    // x[n] for APF1 + normalizing
-    float apf1_in_curr_sample = (cf1.read() + cf2.read() + cf3.read() + cf4.read()) * 0.25;
-    
-    float apf1_in_mixed = (1 - mix_percent) * in + (mix_percent * apf1_in_curr_sample);
-    apf1_in.write(apf1_in_mixed);
-
-    // y[n] = x[n-D] - g * x[n] + g * y[n-D] (APF1)
-    apf1_out.write(apf1_input_delay_sample - apf1_gain * apf1_in_mixed + apf1_gain * apf1_output_delay_sample);
-    float apf2_in_curr_sample = apf1_out.read();				//x[n] for APF2
-    
-    // y[n] = x[n-D] - g * x[n] + g * y[n-D] (APF2)
-    apf2_out.write(apf2_in_delay_sample - apf2_gain * apf2_in_curr_sample + apf2_gain * apf2_out_delay_sample);
+	control_period = std::max(period, 1u);
+	control_counter = std::min(control_counter, control_period);
+}
 
-	return apf2_out.read();
+void
+WahWah::set_quality(unsigned int tier)
+{
+	quality = std::min(tier, get_quality_tiers() - 1);
+	set_control_period(base_control_period << quality);
 }
 
 float
-Reverb::process_hardware(float in, unsigned int index, BelaContext* context)
+WahWah::process(float in, GuiController* controller)
 {
-	float reverb_time = 1000;
-	float mix_percent = 0;
+	float out = 0.0;
+	Parameters p = current_parameters(controller);
+	double delta = p.movement_rate/sample_rate;
 	
-	if(!(index % audio_frames_per_analog_frame)) {
-			// read analog inputs and update reverb time and mix percent
-			reverb_time = analogRead(context, index/2, 0);
-			reverb_time = map(reverb_time, 0, 0.85, 1, 3000);
-			mix_percent = analogRead(context, index/2, 1);
-			mix_percent = map(mix_percent, 0, 0.85, 0, 1);
+	double fc_wave = next_fc(delta, p.minf, p.maxf);
+	
+    double q = p.q;
+	if (coefficient_mode == PER_SAMPLE) {
+		bpFilters[0].setQ(q);
+		bpFilters[0].setFc(fc_wave);
+		out = bpFilters[0].process(DenormalGuard::bias(in));
+	}
+	else {
+		float s1 = z1[0][0], s2 = z2[0][0];
+		out = filter_sample(in, fc_wave, 1 / q, s1, s2);
+		z1[0][0] = s1;
+		z2[0][0] = s2;
 	}
 	
-	// g = 0.001 power of delay_time over reverb_time (-60db decrease, time to completely decay) 
-	float cf1_gain = pow(0.001,cf1_delay_ms/reverb_time);
-	float cf2_gain = pow(0.001,cf2_delay_ms/reverb_time);
-	float cf3_gain = pow(0.001,cf3_delay_ms/reverb_time);
-	float cf4_gain = pow(0.001,cf4_delay_ms/reverb_time);
-    	
-    float cf1_out_delay_sample = cf1.read(cf1_delay);			//y[n-D] for each CF
-    float cf2_out_delay_sample = cf2.read(cf2_delay); 
-    float cf3_out_delay_sample = cf3.read(cf3_delay); 
-    float cf4_out_delay_sample = cf4.read(cf4_delay); 
-    
-    float apf1_input_delay_sample = apf1_in.read(apf1_delay);	//x[n-D] for APF1
-    float apf1_output_delay_sample = apf1_out.read(apf1_delay); //y[n-D] for APF1
-    
-    float apf2_in_delay_sample = apf1_out.read(apf2_delay);		//x[n-D] for APF2
-    float apf2_out_delay_sample = apf2_out.read(apf2_delay);	//y[n-D] for APF2
-
-    cf1.write(in + cf1_out_delay_sample * cf1_gain);
-    cf2.write(in + cf2_out_delay_sample * cf2_gain);
-    cf3.write(in + cf3_out_delay_sample * cf3_gain);
-    cf4.write(in + cf4_out_delay_sample * cf4_gain);
-    
-    // x[n] for APF1 + normalizing
-    float apf1_in_curr_sample = (cf1.read() + cf2.read() + cf3.read() + cf4.read()) * 0.25;
-    
-    float apf1_in_mixed = (1 - mix_percent) * in + (mix_percent * apf1_in_curr_sample);
-    apf1_in.write(apf1_in_mixed);
-
-    // y[n] = x[n-D] - g * x[n] + g * y[n-D] (APF1)
-    apf1_out.write(apf1_input_delay_sample - apf1_gain * apf1_in_mixed + apf1_gain * apf1_output_delay_sample);
-    float apf2_in_curr_sample = apf1_out.read();				//x[n] for APF2
-    
-    // y[n] = x[n-D] - g * x[n] + g * y[n-D] (APF2)
-    apf2_out.write(apf2_in_delay_sample - apf2_gain * apf2_in_curr_sample + apf2_gain * apf2_out_delay_sample);
-
-	return apf2_out.read();
+	// Dry/Wet Mix
+    float mix_percent = p.mix_percent;
+    out = ((1 - mix_percent) * in) + (mix_percent * out * 10);	// normalizing factor can be changed later
+	
+	return out;
 }
 
+void
+WahWah::process_block(const float* in, float* out, unsigned int frames, GuiController* controller)
+{
+	Parameters p = current_parameters(controller);
+	double delta = p.movement_rate/sample_rate;
+	double minf = p.minf;
+	double maxf = p.maxf;
+	double q = p.q;
+	float mix_percent = p.mix_percent;
+	float dry_gain = 1 - mix_percent;
+	float wet_gain = mix_percent * 10;	// normalizing factor can be changed later
+	DenormalGuard guard;
+	
+	if (coefficient_mode == PER_SAMPLE) {
+		Biquad& bpFilter = bpFilters[0];
+		bpFilter.setQ(q);
+		
+		for (unsigned int n = 0; n < frames; n++) {
+			bpFilter.setFc(next_fc(delta, minf, maxf));
+			float x = in[n];
+			out[n] = dry_gain * x + wet_gain * bpFilter.process(DenormalGuard::bias(x));
+		}
+		return;
+	}
+	
+	// The coefficients are only designed every control_period samples, in between they are interpolated.
+	// Channel 0's state is kept in locals during the loop, so it stays in registers.
+	float inv_q = 1 / q;
+	float s1 = z1[0][0], s2 = z2[0][0];
+	for (unsigned int n = 0; n < frames; n++) {
+		float x = in[n];
+		out[n] = dry_gain * x + wet_gain * filter_sample(x, next_fc(delta, minf, maxf), inv_q, s1, s2);
+	}
+	z1[0][0] = s1;
+	z2[0][0] = s2;
+}
+
+void
+WahWah::process_channels(const float* const* in, float* const* out, unsigned int frames, GuiController* controller)
+{
+	if (channels == 1) {
+		process_block(in[0], out[0], frames, controller);
+		return;
+	}
+	
+	Parameters p = current_parameters(controller);
+	double delta = p.movement_rate/sample_rate;
+	double minf = p.minf;
+	double maxf = p.maxf;
+	double q = p.q;
+	float dry_gain = 1 - p.mix_percent;
+	float wet_gain = p.mix_percent * 10;	// normalizing factor can be changed later
+	DenormalGuard guard;
+	
+	if (coefficient_mode == PER_SAMPLE) {
+		for (Biquad& filter : bpFilters) {
+			filter.setQ(q);
+		}
+		
+		for (unsigned int n = 0; n < frames; n++) {
+			double fc_wave = next_fc(delta, minf, maxf);
+			for (unsigned int c = 0; c < channels; c++) {
+				bpFilters[c].setFc(fc_wave);
+				float x = in[c][n];
+				out[c][n] = dry_gain * x + wet_gain * bpFilters[c].process(DenormalGuard::bias(x));
+			}
+		}
+		return;
+	}
+	
+	// All the channels follow the same sweep, so they share the coefficients, and 4 channels
+	// (one per SIMD lane) are filtered at once.
+	float inv_q = 1 / q;
+	const unsigned int vectors = z1.size();
+	const float offset = DenormalGuard::bias(0);	// unused lanes are fed the offset as well
+	for (unsigned int n = 0; n < frames; n++) {
+		const BandpassCoefficients& k = next_coefficients(next_fc(delta, minf, maxf), inv_q);
+		
+		for (unsigned int v = 0; v < vectors; v++) {
+			const unsigned int first = 4 * v;
+			const unsigned int lanes = std::min(channels - first, 4u);
+			
+			float4 x = {0, 0, 0, 0};
+			for (unsigned int lane = 0; lane < lanes; lane++)
+				x[lane] = in[first + lane][n];
+			float4 biased = x + offset;
+			
+			float4 y = k.b0 * biased + z1[v];
+			z1[v] = z2[v] - k.a1 * y;
+			z2[v] = -k.b0 * biased - k.a2 * y;
+			
+			float4 mixed = dry_gain * x + wet_gain * y;
+			for (unsigned int lane = 0; lane < lanes; lane++)
+				out[first + lane][n] = mixed[lane];
+		}
+	}
+}
+
+void
+WahWah::reset()
+{
+	fc = 1000;
+	direction = DOWN;
+	for (Biquad& filter : bpFilters) {
+		filter.clean();
+	}
+	
+	coefficients_valid = false;
+	control_counter = 0;
+	std::fill(z1.begin(), z1.end(), float4{0, 0, 0, 0});
+	std::fill(z2.begin(), z2.end(), float4{0, 0, 0, 0});
+}
+
+void
+WahWah::advance(unsigned int frames, GuiController* controller)
+{
+	Parameters p = current_parameters(controller);
+	double delta = p.movement_rate/sample_rate;
+	
+	for (unsigned int n = 0; n < frames; n++) {
+		next_fc(delta, p.minf, p.maxf);
+	}
+}
+
+// Number of samples a delay line must hold: 'delay + 1' previous samples (process_sample reads read(delay))
+// plus a whole block, so a block of delayed samples can be read as one window before the block is written.
+static unsigned int
+__delay_line_size(float delay_ms, float sample_rate, unsigned int block_size)
+{
+	return (unsigned int)(delay_ms * (sample_rate/1000)) + 1 + block_size;
+}
+
+static unsigned int
+__delay_samples(float delay_ms, float sample_rate)
+{
+	return (unsigned int)(delay_ms * (sample_rate/1000));
+}
+
+Reverb::ChannelState::ChannelState(const std::array<unsigned int, 8>& comb_delays, bool dense, unsigned int apf1_size, unsigned int apf2_size) :
+		// Only one of the banks is used, the other one has 2 rows
+		combs(dense ? std::array<unsigned int, 4>{} : std::array<unsigned int, 4>{{comb_delays[0], comb_delays[1], comb_delays[2], comb_delays[3]}}),
+		dense_combs(dense ? comb_delays : std::array<unsigned int, 8>{}),
+		apf1_in(apf1_size),
+		apf1_out(apf1_size),	// apf1_delay > apf2_delay, so also fits apf2's input
+		apf2_out(apf2_size)
+{}
+
+Reverb::Reverb(BelaContext *context, GuiController* controller, unsigned int comb_count, unsigned int channels) :
+		Effects(context, channels), comb_count(comb_count), max_comb_count(comb_count),
+		apf1_delay(__delay_samples(apf1_delay_ms, sample_rate)), apf2_delay(__delay_samples(apf2_delay_ms, sample_rate)),
+		block_scratch(4 * audio_frames), smoothed_reverb_time(sample_rate, parameter_smoothing_ms),
+		smoothed_mix(sample_rate, parameter_smoothing_ms), applied_reverb_time(-1), control_counter(0)
+{
+	assert(comb_count == 4 || comb_count == 8);
+	
+	// The first 4 combs are the classic ones, the dense configuration adds the other 4
+	const std::array<unsigned int, 8> comb_delays{{
+			__delay_samples(cf1_delay_ms, sample_rate), __delay_samples(cf2_delay_ms, sample_rate),
+			__delay_samples(cf3_delay_ms, sample_rate), __delay_samples(cf4_delay_ms, sample_rate),
+			__delay_samples(cf5_delay_ms, sample_rate), __delay_samples(cf6_delay_ms, sample_rate),
+			__delay_samples(cf7_delay_ms, sample_rate), __delay_samples(cf8_delay_ms, sample_rate)}};
+	
+	channel_states.reserve(this->channels);
+	for (unsigned int c = 0; c < this->channels; c++) {
+		channel_states.emplace_back(comb_delays, comb_count == 8, __delay_line_size(apf1_delay_ms, sample_rate, audio_frames),
+									__delay_line_size(apf2_delay_ms, sample_rate, audio_frames));
+	}
+	
+	const Parameters defaults;
+	has_sliders = controller != nullptr;
+	if (has_sliders) {
+		reverb_time_slider_index = controller->addSlider("Reverb Time (ms)", defaults.reverb_time, 0.1, 3000, 100);
+		mix_slider_index = controller->addSlider("Mix Percentage", defaults.mix_percent, 0.0, 1.0, 0.05);
+	}
+	parameters.write(has_sliders ? read_sliders(controller) : defaults);
+}
+
+Reverb::Parameters
+Reverb::read_sliders(GuiController* controller) const
+{
+	Parameters result;
+	result.reverb_time = controller->getSliderValue(reverb_time_slider_index);
+	result.mix_percent = controller->getSliderValue(mix_slider_index);
+	return result;
+}
+
+void
+Reverb::publish(GuiController* controller)
+{
+	if (has_sliders)
+		parameters.write(read_sliders(controller));
+}
+
+void
+Reverb::set_reverb_time(float reverb_time)
+{
+	if (reverb_time == applied_reverb_time)
+		return;
+	applied_reverb_time = reverb_time;
+	
+	// g = 0.001 power of delay_time over reverb_time (-60db decrease, time to completely decay) 
+	const float cf_gains[8] = {
+		(float)pow(0.001,cf1_delay_ms/reverb_time),
+		(float)pow(0.001,cf2_delay_ms/reverb_time),
+		(float)pow(0.001,cf3_delay_ms/reverb_time),
+		(float)pow(0.001,cf4_delay_ms/reverb_time),
+		(float)pow(0.001,cf5_delay_ms/reverb_time),
+		(float)pow(0.001,cf6_delay_ms/reverb_time),
+		(float)pow(0.001,cf7_delay_ms/reverb_time),
+		(float)pow(0.001,cf8_delay_ms/reverb_time)
+	};
+	
+	// Both configurations are kept up to date, so the quality tier can change without recomputing them
+	for (ChannelState& state : channel_states) {
+		state.dense_combs.set_gains(cf_gains);
+		state.combs.set_gains(cf_gains);
+	}
+}
+
+void
+Reverb::set_quality(unsigned int tier)
+{
+	quality = std::min(tier, get_quality_tiers() - 1);
+	unsigned int count = quality == 0 ? max_comb_count : 4;
+	if (count == comb_count)
+		return;
+	
+	// The classic combs are the first 4 of the dense bank: their tail carries over, the 4 others start empty
+	for (ChannelState& state : channel_states)
+		state.dense_combs.set_active_combs(count);
+	comb_count = count;
+}
+
+float
+Reverb::process_sample(ChannelState& state, float in, float mix_percent)
+{
+    float apf1_input_delay_sample = state.apf1_in.read(apf1_delay);	//x[n-D] for APF1
+    float apf1_output_delay_sample = state.apf1_out.read(apf1_delay); //y[n-D] for APF1
+    
+    float apf2_in_delay_sample = state.apf1_out.read(apf2_delay);		//x[n-D] for APF2
+    float apf2_out_delay_sample = state.apf2_out.read(apf2_delay);	//y[n-D] for APF2
+
+    // x[n] for APF1: average of the parallel combs
+    float apf1_in_curr_sample = max_comb_count == 8 ? state.dense_combs.process(in) : state.combs.process(in);
+    
+    float apf1_in_mixed = DenormalGuard::bias((1 - mix_percent) * in + (mix_percent * apf1_in_curr_sample));
+    state.apf1_in.write(apf1_in_mixed);
+
+    // y[n] = x[n-D] - g * x[n] + g * y[n-D] (APF1)
+    state.apf1_out.write(apf1_input_delay_sample - apf1_gain * apf1_in_mixed + apf1_gain * apf1_output_delay_sample);
+    float apf2_in_curr_sample = state.apf1_out.read();				//x[n] for APF2
+    
+    // y[n] = x[n-D] - g * x[n] + g * y[n-D] (APF2)
+    state.apf2_out.write(apf2_in_delay_sample - apf2_gain * apf2_in_curr_sample + apf2_gain * apf2_out_delay_sample);
+
+	return state.apf2_out.read();
+}
+
+float
+Reverb::update_controls(const Parameters& p, unsigned int frames)
+{
+	smoothed_reverb_time.set(p.reverb_time);
+	smoothed_mix.set(p.mix_percent);
+	
+	// The comb gains only depend on the reverb time, they are recomputed when it changes
+	set_reverb_time(smoothed_reverb_time.update(frames));
+	return smoothed_mix.update(frames);
+}
+
+float
+Reverb::process(float in, GuiController* controller)
+{
+	// The parameters are read once every block length, as with process_block()
+	if (control_counter == 0) {
+		update_controls(current_parameters(controller), audio_frames);
+		control_counter = audio_frames;
+	}
+	control_counter--;
+	
+	return process_sample(channel_states[0], in, smoothed_mix.get());
+}
+
+void
+Reverb::process_block_windowed(ChannelState& state, const float* in, float* out, unsigned int frames, float mix_percent)
+{
+	float* combs_block = &block_scratch[0];
+	float* apf1_in_block = combs_block + frames;
+	float* apf1_out_block = apf1_in_block + frames;
+	float* apf2_out_block = apf1_out_block + frames;
+	
+	// x[n] for APF1: average of the parallel combs (4 combs per SIMD operation)
+	if (max_comb_count == 8)
+		state.dense_combs.process(in, combs_block, frames);
+	else
+		state.combs.process(in, combs_block, frames);
+	
+	for (unsigned int n = 0; n < frames; n++) {
+		apf1_in_block[n] = DenormalGuard::bias((1 - mix_percent) * in[n] + (mix_percent * combs_block[n]));
+	}
+	
+	// Every allpass delay is at least 'frames - 1' samples, so all the delayed samples needed by this block
+	// were written by previous blocks, and are available as contiguous windows (see MirroredRingBuffer).
+	const float* apf1_input_delay = state.apf1_in.window(frames, apf1_delay + 1 - frames);	//x[n-D] for APF1
+	const float* apf1_output_delay = state.apf1_out.window(frames, apf1_delay + 1 - frames);	//y[n-D] for APF1
+	const float* apf2_in_delay = state.apf1_out.window(frames, apf2_delay + 1 - frames);		//x[n-D] for APF2
+	const float* apf2_out_delay = state.apf2_out.window(frames, apf2_delay + 1 - frames);		//y[n-D] for APF2
+	
+	for (unsigned int n = 0; n < frames; n++) {
+		// y[n] = x[n-D] - g * x[n] + g * y[n-D] (APF1)
+		apf1_out_block[n] = apf1_input_delay[n] - apf1_gain * apf1_in_block[n] + apf1_gain * apf1_output_delay[n];
+		// y[n] = x[n-D] - g * x[n] + g * y[n-D] (APF2)
+		apf2_out_block[n] = apf2_in_delay[n] - apf2_gain * apf1_out_block[n] + apf2_gain * apf2_out_delay[n];
+	}
+	
+	state.apf1_in.write_block(apf1_in_block, frames);
+	state.apf1_out.write_block(apf1_out_block, frames);
+	state.apf2_out.write_block(apf2_out_block, frames);
+	
+	std::copy(apf2_out_block, apf2_out_block + frames, out);
+}
+
+void
+Reverb::process_block(const float* in, float* out, unsigned int frames, GuiController* controller)
+{
+	float mix_percent = update_controls(current_parameters(controller), frames);
+	DenormalGuard guard;
+	
+	process_channel_block(channel_states[0], in, out, frames, mix_percent);
+}
+
+void
+Reverb::process_channels(const float* const* in, float* const* out, unsigned int frames, GuiController* controller)
+{
+	float mix_percent = update_controls(current_parameters(controller), frames);
+	DenormalGuard guard;
+	
+	// Same parameters (and comb gains) for all the channels
+	for (unsigned int c = 0; c < channels; c++) {
+		process_channel_block(channel_states[c], in[c], out[c], frames, mix_percent);
+	}
+}
+
+void
+Reverb::process_channel_block(ChannelState& state, const float* in, float* out, unsigned int frames, float mix_percent)
+{
+	// Blocks longer than the shortest delay (or than the initialized block size) are processed in pieces
+	const unsigned int piece = std::min(audio_frames, apf2_delay + 1);
+	for (unsigned int done = 0; done < frames; done += piece)
+		process_block_windowed(state, in + done, out + done, std::min(piece, frames - done), mix_percent);
+}
+
+void
+Reverb::reset()
+{
+	for (ChannelState& state : channel_states) {
+		state.combs.clear();
+		state.dense_combs.clear();
+		state.apf1_in.clear();
+		state.apf1_out.clear();
+		state.apf2_out.clear();
+	}
+	smoothed_reverb_time.reset();
+	smoothed_mix.reset();
+	control_counter = 0;
+}
+
+float
+Reverb::process_hardware(float in, unsigned int index, BelaContext* context)
+{
+	if(!(index % audio_frames_per_analog_frame)) {
+			// read analog inputs and update reverb time and mix percent, they are held until the next analog frame
+			unsigned int analog_frame = index / audio_frames_per_analog_frame;
+			Parameters p;
+			p.reverb_time = map(analogRead(context, analog_frame, 0), 0, 0.85, 1, 3000);
+			p.mix_percent = map(analogRead(context, analog_frame, 1), 0, 0.85, 0, 1);
+			update_controls(p, audio_frames_per_analog_frame);
+	}
+	
+	return process_sample(channel_states[0], in, smoothed_mix.get());
+}
+
+ConvolutionReverb::Stage::Stage(unsigned int partition, unsigned int offset, unsigned int count, unsigned int head_size) :
+		partition(partition), offset(offset), count(count), fft(2 * partition),
+		spectra_re(count * (partition + 1)), spectra_im(count * (partition + 1))
+{
+	// The output of a partition is played from 'offset - partition' samples after it is complete
+	ticks = std::min(partition, offset - partition + head_size) / head_size;
+	steps = fft.get_steps() + count + fft.get_steps();
+}
+
+ConvolutionReverb::ChannelState::ChannelState(unsigned int history_size, unsigned int accumulator_size) :
+		history(history_size), accumulator(accumulator_size), time(0)
+{}
+
+ConvolutionReverb::ConvolutionReverb(BelaContext *context, GuiController* controller, const std::vector<float>& impulse_response,
+									 unsigned int channels, unsigned int head_size, unsigned int max_partition) :
+		Effects(context, channels), head_size(head_size), head(head_size)
+{
+	assert(head_size > 0 && (head_size & (head_size - 1)) == 0);
+	assert(max_partition >= head_size && (max_partition & (max_partition - 1)) == 0);
+	const unsigned int length = impulse_response.size();
+	
+	// The head is applied as a dot product with the newest samples, so its taps are stored reversed
+	for (unsigned int k = 0; k < head_size && k < length; k++) {
+		head[head_size - 1 - k] = impulse_response[k];
+	}
+	
+	// Stages of growing partitions. The first one starts one partition into the response and runs its work
+	// as soon as a partition is complete, each one has enough partitions for the next one to start two of
+	// its partitions into the response (so the work can be spread over the next partition, see advance_stage).
+	unsigned int offset = head_size;
+	unsigned int partition = head_size;
+	unsigned int accumulator_size = 1;
+	while (offset < length) {
+		unsigned int next = std::min(partition * 4, max_partition);
+		unsigned int remaining = (length - offset + partition - 1) / partition;
+		unsigned int count = remaining;
+		if (next > partition)
+			count = std::min(remaining, std::max(1u, (2 * next - offset + partition - 1) / partition));
+		
+		stages.emplace_back(partition, offset, count, head_size);
+		while (accumulator_size < offset + count * partition + partition)
+			accumulator_size <<= 1;
+		offset += count * partition;
+		partition = next;
+	}
+	accumulator_mask = accumulator_size - 1;
+	
+	// Spectra of the partitions, scaled by 1 / 2P for the unscaled inverse transform
+	unsigned int largest = head_size;
+	for (Stage& stage : stages) {
+		const unsigned int P = stage.partition;
+		std::vector<float> frame(2 * P);
+		for (unsigned int j = 0; j < stage.count; j++) {
+			std::fill(frame.begin(), frame.end(), 0.0f);
+			for (unsigned int k = 0; k < P; k++) {
+				unsigned int tap = stage.offset + j * P + k;
+				if (tap < length)
+					frame[k] = impulse_response[tap] / (2 * P);
+			}
+			stage.fft.forward(frame.data(), &stage.spectra_re[j * (P + 1)], &stage.spectra_im[j * (P + 1)]);
+		}
+		largest = std::max(largest, P);
+	}
+	
+	frame_out.resize(2 * largest);
+	wet_scratch.resize(std::max(audio_frames, 1u));
+	
+	channel_states.reserve(this->channels);
+	for (unsigned int c = 0; c < this->channels; c++) {
+		channel_states.emplace_back(2 * largest, accumulator_size);
+		ChannelState& state = channel_states.back();
+		for (const Stage& stage : stages) {
+			state.fdl_re.emplace_back(stage.count * (stage.partition + 1));
+			state.fdl_im.emplace_back(stage.count * (stage.partition + 1));
+			state.fdl_position.push_back(0);
+			state.work.emplace_back(2 * stage.partition);
+			state.sum_re.emplace_back(stage.partition + 1);
+			state.sum_im.emplace_back(stage.partition + 1);
+			state.progress.push_back(stage.steps);
+		}
+	}
+	
+	const Parameters defaults;
+	has_sliders = controller != nullptr;
+	if (has_sliders)
+		mix_slider_index = controller->addSlider("Convolution Mix", defaults.mix_percent, 0, 1, 0.05);
+	parameters.write(has_sliders ? read_sliders(controller) : defaults);
+}
+
+ConvolutionReverb::ConvolutionReverb(BelaContext *context, GuiController* controller, const std::string& impulse_response_path,
+									 unsigned int channels, unsigned int head_size, unsigned int max_partition) :
+		ConvolutionReverb(context, controller, AudioFileUtilities::loadMono(impulse_response_path), channels, head_size, max_partition)
+{}
+
+ConvolutionReverb::Parameters
+ConvolutionReverb::read_sliders(GuiController* controller) const
+{
+	Parameters result;
+	result.mix_percent = controller->getSliderValue(mix_slider_index);
+	return result;
+}
+
+void
+ConvolutionReverb::publish(GuiController* controller)
+{
+	if (has_sliders)
+		parameters.write(read_sliders(controller));
+}
+
+void
+ConvolutionReverb::run_step(ChannelState& state, unsigned int stage_index, unsigned int step)
+{
+	const Stage& stage = stages[stage_index];
+	const unsigned int P = stage.partition;
+	const unsigned int bins = P + 1;
+	const unsigned int transform_steps = stage.fft.get_steps();
+	float* work = state.work[stage_index].data();
+	float* yr = state.sum_re[stage_index].data();
+	float* yi = state.sum_im[stage_index].data();
+	unsigned int& position = state.fdl_position[stage_index];
+	
+	// Spectrum of the last 2P input samples (read by the first step, when the partition is complete),
+	// stored as the newest entry of the frequency domain delay line
+	if (step < transform_steps) {
+		if (step == 0)
+			position = (position + 1) % stage.count;
+		stage.fft.forward_step(state.history.window(2 * P), &state.fdl_re[stage_index][position * bins],
+							   &state.fdl_im[stage_index][position * bins], work, step);
+		return;
+	}
+	step -= transform_steps;
+	
+	// Y = sum of X[m - j] * H[j]: partition j meets the input frame of j partitions ago
+	if (step < stage.count) {
+		const unsigned int j = step;
+		if (j == 0) {
+			std::fill(yr, yr + bins, 0.0f);
+			std::fill(yi, yi + bins, 0.0f);
+		}
+		unsigned int slot = (position + stage.count - j) % stage.count;
+		const float* xr = &state.fdl_re[stage_index][slot * bins];
+		const float* xi = &state.fdl_im[stage_index][slot * bins];
+		const float* hr = &stage.spectra_re[j * bins];
+		const float* hi = &stage.spectra_im[j * bins];
+		for (unsigned int b = 0; b < bins; b++) {
+			yr[b] += xr[b] * hr[b] - xi[b] * hi[b];
+			yi[b] += xr[b] * hi[b] + xi[b] * hr[b];
+		}
+		return;
+	}
+	step -= stage.count;
+	
+	// Overlap-save: the last P samples are the output for the last P inputs, delayed by the stage's offset
+	// (from the time the partition was complete, the start of the current period of P samples)
+	stage.fft.inverse_step(yr, yi, frame_out.data(), work, step);
+	if (step == transform_steps - 1) {
+		const unsigned int first = (state.time & ~(P - 1)) - P + stage.offset;
+		for (unsigned int i = 0; i < P; i++) {
+			state.accumulator[(first + i) & accumulator_mask] += frame_out[P + i];
+		}
+	}
+}
+
+void
+ConvolutionReverb::advance_stage(ChannelState& state, unsigned int stage_index)
+{
+	const Stage& stage = stages[stage_index];
+	unsigned int& progress = state.progress[stage_index];
+	
+	// A partition is complete at the start of each period of P samples, its steps are due by 'ticks'
+	// head_size periods later, in equal shares
+	const unsigned int tick = (state.time & (stage.partition - 1)) / head_size;
+	if (tick == 0) {
+		assert(progress == stage.steps);
+		progress = 0;
+	}
+	const unsigned int due = tick < stage.ticks ? ((tick + 1) * stage.steps + stage.ticks - 1) / stage.ticks : stage.steps;
+	for (; progress < due; progress++)
+		run_step(state, stage_index, progress);
+}
+
+void
+ConvolutionReverb::convolve(ChannelState& state, const float* in, float* wet, unsigned int frames)
+{
+	unsigned int done = 0;
+	while (done < frames) {
+		// Runs end on multiples of head_size, where the stages may complete a partition
+		unsigned int run = std::min(frames - done, head_size - (state.time & (head_size - 1)));
+		state.history.write_block(in + done, run);
+		
+		// The output the stages computed for these samples, plus the head. The head loops over the samples
+		// in the inner loop (one multiply-add per sample and tap, no reduction), so it vectorizes.
+		const float* x = state.history.window(run + head_size - 1);
+		float* y = wet + done;
+		for (unsigned int n = 0; n < run; n++) {
+			float& future = state.accumulator[(state.time + n) & accumulator_mask];
+			y[n] = future;
+			future = 0;
+		}
+		for (unsigned int k = 0; k < head_size; k++) {
+			const float tap = head[k];
+			for (unsigned int n = 0; n < run; n++) {
+				y[n] += tap * x[n + k];
+			}
+		}
+		state.time += run;
+		done += run;
+		
+		if ((state.time & (head_size - 1)) == 0) {
+			for (unsigned int i = 0; i < stages.size(); i++)
+				advance_stage(state, i);
+		}
+	}
+}
+
+float
+ConvolutionReverb::process(float in, GuiController* controller)
+{
+	Parameters p = current_parameters(controller);
+	float wet;
+	convolve(channel_states[0], &in, &wet, 1);
+	return (1 - p.mix_percent) * in + p.mix_percent * wet;
+}
+
+void
+ConvolutionReverb::process_block(const float* in, float* out, unsigned int frames, GuiController* controller)
+{
+	Parameters p = current_parameters(controller);
+	DenormalGuard guard;
+	float dry_gain = 1 - p.mix_percent;
+	
+	// Longer blocks than the initialized block size are processed in pieces, the scratch is not resized
+	for (unsigned int done = 0; done < frames; done += wet_scratch.size()) {
+		unsigned int count = std::min<unsigned int>(frames - done, wet_scratch.size());
+		convolve(channel_states[0], in + done, wet_scratch.data(), count);
+		for (unsigned int n = 0; n < count; n++) {
+			out[done + n] = dry_gain * in[done + n] + p.mix_percent * wet_scratch[n];
+		}
+	}
+}
+
+void
+ConvolutionReverb::process_channels(const float* const* in, float* const* out, unsigned int frames, GuiController* controller)
+{
+	Parameters p = current_parameters(controller);
+	DenormalGuard guard;
+	float dry_gain = 1 - p.mix_percent;
+	
+	for (unsigned int c = 0; c < channels; c++) {
+		for (unsigned int done = 0; done < frames; done += wet_scratch.size()) {
+			unsigned int count = std::min<unsigned int>(frames - done, wet_scratch.size());
+			convolve(channel_states[c], in[c] + done, wet_scratch.data(), count);
+			for (unsigned int n = 0; n < count; n++) {
+				out[c][done + n] = dry_gain * in[c][done + n] + p.mix_percent * wet_scratch[n];
+			}
+		}
+	}
+}
+
+void
+ConvolutionReverb::reset()
+{
+	for (ChannelState& state : channel_states) {
+		state.history.clear();
+		for (ArenaVector<float>& spectra : state.fdl_re)
+			std::fill(spectra.begin(), spectra.end(), 0.0f);
+		for (ArenaVector<float>& spectra : state.fdl_im)
+			std::fill(spectra.begin(), spectra.end(), 0.0f);
+		std::fill(state.fdl_position.begin(), state.fdl_position.end(), 0);
+		for (unsigned int i = 0; i < stages.size(); i++)
+			state.progress[i] = stages[i].steps;
+		std::fill(state.accumulator.begin(), state.accumulator.end(), 0.0f);
+		state.time = 0;
+	}
+}
+
+// Smallest prime number >= n
+static unsigned int
+__next_prime(unsigned int n)
+{
+	for (n = std::max(n, 2u); ; n++) {
+		bool prime = true;
+		for (unsigned int d = 2; d * d <= n && prime; d++)
+			prime = n % d != 0;
+		if (prime)
+			return n;
+	}
+}
+
+// Lane shuffles of the Hadamard butterflies inside a float4: [1, 0, 3, 2] and [2, 3, 0, 1]
+static inline float4
+__swap_pairs(float4 v)
+{
+#if defined(__clang__)
+	return __builtin_shufflevector(v, v, 1, 0, 3, 2);
+#else
+	typedef int int4 __attribute__((vector_size(16)));
+	return __builtin_shuffle(v, int4{1, 0, 3, 2});
+#endif
+}
+
+static inline float4
+__swap_halves(float4 v)
+{
+#if defined(__clang__)
+	return __builtin_shufflevector(v, v, 2, 3, 0, 1);
+#else
+	typedef int int4 __attribute__((vector_size(16)));
+	return __builtin_shuffle(v, int4{2, 3, 0, 1});
+#endif
+}
+
+// Fast Walsh-Hadamard transform of 4 * Vectors values (not normalized)
+template <unsigned int Vectors>
+static inline void
+__hadamard(float4* v)
+{
+	const float4 pair_signs = {1, -1, 1, -1};
+	const float4 half_signs = {1, 1, -1, -1};
+	
+	// Butterflies of span 1 and 2, inside every float4
+	for (unsigned int k = 0; k < Vectors; k++) {
+		v[k] = v[k] * pair_signs + __swap_pairs(v[k]);
+		v[k] = v[k] * half_signs + __swap_halves(v[k]);
+	}
+	
+	// Butterflies of span 4 and up, between float4s
+	for (unsigned int span = 1; span < Vectors; span *= 2) {
+		for (unsigned int start = 0; start < Vectors; start += 2 * span) {
+			for (unsigned int k = start; k < start + span; k++) {
+				float4 a = v[k];
+				float4 b = v[k + span];
+				v[k] = a + b;
+				v[k + span] = a - b;
+			}
+		}
+	}
+}
+
+FdnReverb::ChannelState::ChannelState(unsigned int capacity, unsigned int vectors) :
+		lines(capacity * vectors, float4{0, 0, 0, 0}), lowpass(vectors, float4{0, 0, 0, 0}), wr_ptr(0)
+{}
+
+FdnReverb::FdnReverb(BelaContext *context, GuiController* controller, unsigned int line_count,
+					 const std::vector<float>& delays_ms, unsigned int channels) :
+		Effects(context, channels), max_line_count(line_count), line_count(line_count), vectors(line_count / 4),
+		all_delays(line_count), delays(line_count),
+		feedback_gains(line_count / 4, float4{0, 0, 0, 0}), damping(float4{0, 0, 0, 0}),
+		smoothed_reverb_time(sample_rate, parameter_smoothing_ms), smoothed_damping(sample_rate, parameter_smoothing_ms),
+		smoothed_mix(sample_rate, parameter_smoothing_ms), applied_reverb_time(-1), control_counter(0)
+{
+	assert(line_count >= 4 && line_count <= 32 && (line_count & (line_count - 1)) == 0);
+	assert(delays_ms.empty() || delays_ms.size() == line_count);
+	
+	unsigned int longest = 0;
+	for (unsigned int k = 0; k < line_count; k++) {
+		if (!delays_ms.empty()) {
+			all_delays[k] = std::max(__delay_samples(delays_ms[k], sample_rate), 1u);
+		}
+		else {
+			// Geometric spread, every line at least one sample longer than the previous one
+			float delay_ms = 23 * pow(61.0 / 23, (double)k / (line_count - 1));
+			all_delays[k] = __next_prime(std::max(__delay_samples(delay_ms, sample_rate), k > 0 ? all_delays[k - 1] + 1 : 1));
+		}
+		longest = std::max(longest, all_delays[k]);
+	}
+	std::copy(all_delays.begin(), all_delays.end(), delays.begin());
+	
+	// The slot being written must not be one of the slots read
+	capacity = 1;
+	while (capacity <= longest)
+		capacity <<= 1;
+	mask = capacity - 1;
+	
+	channel_states.reserve(this->channels);
+	for (unsigned int c = 0; c < this->channels; c++)
+		channel_states.emplace_back(capacity, vectors);
+	
+	const Parameters defaults;
+	has_sliders = controller != nullptr;
+	if (has_sliders) {
+		reverb_time_slider_index = controller->addSlider("FDN Reverb Time (ms)", defaults.reverb_time, 100, 10000, 100);
+		damping_slider_index = controller->addSlider("FDN Damping", defaults.damping, 0, 0.95, 0.05);
+		mix_slider_index = controller->addSlider("FDN Mix", defaults.mix_percent, 0, 1, 0.05);
+	}
+	parameters.write(has_sliders ? read_sliders(controller) : defaults);
+}
+
+FdnReverb::Parameters
+FdnReverb::read_sliders(GuiController* controller) const
+{
+	Parameters result;
+	result.reverb_time = controller->getSliderValue(reverb_time_slider_index);
+	result.damping = controller->getSliderValue(damping_slider_index);
+	result.mix_percent = controller->getSliderValue(mix_slider_index);
+	return result;
+}
+
+void
+FdnReverb::publish(GuiController* controller)
+{
+	if (has_sliders)
+		parameters.write(read_sliders(controller));
+}
+
+void
+FdnReverb::set_reverb_time(float reverb_time)
+{
+	if (reverb_time == applied_reverb_time)
+		return;
+	applied_reverb_time = reverb_time;
+	
+	// g = 0.001 power of delay_time over reverb_time (-60db decrease), and 1/sqrt(N) makes the matrix lossless
+	const double reverb_samples = std::max(reverb_time, 1.0f) * sample_rate / 1000;
+	const double normalization = 1 / sqrt((double)line_count);
+	for (unsigned int k = 0; k < line_count; k++)
+		feedback_gains[k / 4][k % 4] = pow(0.001, delays[k] / reverb_samples) * normalization;
+}
+
+float
+FdnReverb::update_controls(const Parameters& p, unsigned int frames)
+{
+	smoothed_reverb_time.set(p.reverb_time);
+	smoothed_damping.set(p.damping);
+	smoothed_mix.set(p.mix_percent);
+	
+	set_reverb_time(smoothed_reverb_time.update(frames));
+	float d = smoothed_damping.update(frames);
+	damping = float4{d, d, d, d};
+	return smoothed_mix.update(frames);
+}
+
+template <unsigned int Vectors>
+void
+FdnReverb::process_network(ChannelState& state, const float* in, float* out, unsigned int frames, float mix_percent)
+{
+	// The state and the gains are kept in locals, so they stay in registers for the whole block
+	float4* lines = state.lines.data();
+	const float* samples = (const float*)lines;		// vector types may alias their element type
+	const unsigned int* line_delays = delays.data();
+	const unsigned int history_mask = mask;
+	unsigned int position = state.wr_ptr;
+	
+	float4 lowpass[Vectors];
+	float4 gains[Vectors];
+	for (unsigned int v = 0; v < Vectors; v++) {
+		lowpass[v] = state.lowpass[v];
+		gains[v] = feedback_gains[v];
+	}
+	const float4 hold = damping;
+	const float4 pass = 1 - damping;
+	// Alternating output signs, so the output is not the first row of the matrix (which is also what is fed back)
+	const float4 output_signs = {1, -1, 1, -1};
+	const float dry_gain = 1 - mix_percent;
+	// 1/sqrt(N): the taps are about uncorrelated, so the wet level does not depend on the line count
+	const float wet_gain = mix_percent / sqrtf(4 * Vectors);
+	
+	for (unsigned int n = 0; n < frames; n++) {
+		// Output of every line, line k was written delays[k] samples ago
+		float4 x[Vectors];
+		for (unsigned int v = 0; v < Vectors; v++) {
+			for (unsigned int lane = 0; lane < 4; lane++) {
+				const unsigned int k = 4 * v + lane;
+				x[v][lane] = samples[((position - line_delays[k]) & history_mask) * 4 * Vectors + k];
+			}
+		}
+		
+		// Damping (one-pole lowpass of every line), then the output taps
+		float4 sum = {0, 0, 0, 0};
+		for (unsigned int v = 0; v < Vectors; v++) {
+			lowpass[v] = pass * x[v] + hold * lowpass[v];
+			x[v] = lowpass[v];
+			sum += lowpass[v] * output_signs;
+		}
+		
+		// Mixing, decay and input, 4 lines per operation
+		__hadamard<Vectors>(x);
+		const float input = DenormalGuard::bias(in[n]);
+		float4* current = lines + position * Vectors;
+		for (unsigned int v = 0; v < Vectors; v++)
+			current[v] = x[v] * gains[v] + input;
+		position = (position + 1) & history_mask;
+		
+		out[n] = dry_gain * in[n] + wet_gain * (sum[0] + sum[1] + sum[2] + sum[3]);
+	}
+	
+	state.wr_ptr = position;
+	for (unsigned int v = 0; v < Vectors; v++)
+		state.lowpass[v] = lowpass[v];
+}
+
+void
+FdnReverb::process_channel_block(ChannelState& state, const float* in, float* out, unsigned int frames, float mix_percent)
+{
+	switch (vectors) {
+		case 1: process_network<1>(state, in, out, frames, mix_percent); break;
+		case 2: process_network<2>(state, in, out, frames, mix_percent); break;
+		case 4: process_network<4>(state, in, out, frames, mix_percent); break;
+		default: process_network<8>(state, in, out, frames, mix_percent); break;
+	}
+}
+
+float
+FdnReverb::process(float in, GuiController* controller)
+{
+	// The parameters are read once every block length, as with process_block()
+	if (control_counter == 0) {
+		update_controls(current_parameters(controller), audio_frames);
+		control_counter = audio_frames;
+	}
+	control_counter--;
+	
+	float out;
+	process_channel_block(channel_states[0], &in, &out, 1, smoothed_mix.get());
+	return out;
+}
+
+void
+FdnReverb::process_block(const float* in, float* out, unsigned int frames, GuiController* controller)
+{
+	float mix_percent = update_controls(current_parameters(controller), frames);
+	DenormalGuard guard;
+	
+	process_channel_block(channel_states[0], in, out, frames, mix_percent);
+}
+
+void
+FdnReverb::process_channels(const float* const* in, float* const* out, unsigned int frames, GuiController* controller)
+{
+	float mix_percent = update_controls(current_parameters(controller), frames);
+	DenormalGuard guard;
+	
+	// Same parameters (and gains) for all the channels
+	for (unsigned int c = 0; c < channels; c++) {
+		process_channel_block(channel_states[c], in[c], out[c], frames, mix_percent);
+	}
+}
+
+// Regroups 'rows' rows of 'from' floats into rows of 'to' floats in place, when switching between N and
+// N/2 lines: line j of the N/2 lines is line 2j of the N lines, the lines that do not exist yet are zeros.
+static void
+__regroup_lines(float* samples, unsigned int rows, unsigned int from, unsigned int to)
+{
+	float row[32];
+	if (to < from) {
+		// The rows shrink: in increasing order, a row is never written over one that was not read yet
+		for (unsigned int t = 0; t < rows; t++) {
+			for (unsigned int j = 0; j < to; j++)
+				row[j] = samples[t * from + 2 * j];
+			std::copy(row, row + to, samples + t * to);
+		}
+	}
+	else {
+		// The rows grow: the same in decreasing order
+		for (unsigned int t = rows; t-- > 0; ) {
+			std::copy(samples + t * from, samples + t * from + from, row);
+			std::fill(samples + t * to, samples + t * to + to, 0.0f);
+			for (unsigned int j = 0; j < from; j++)
+				samples[t * to + 2 * j] = row[j];
+		}
+	}
+}
+
+void
+FdnReverb::set_quality(unsigned int tier)
+{
+	quality = std::min(tier, get_quality_tiers() - 1);
+	unsigned int count = quality == 0 ? max_line_count : max_line_count / 2;
+	if (count == line_count)
+		return;
+	
+	for (ChannelState& state : channel_states) {
+		__regroup_lines((float*)state.lines.data(), capacity, line_count, count);
+		__regroup_lines((float*)state.lowpass.data(), 1, line_count, count);
+	}
+	for (unsigned int k = 0; k < count; k++)
+		delays[k] = all_delays[k * (max_line_count / count)];
+	line_count = count;
+	vectors = count / 4;
+	
+	// New gains for the delays and the matrix size of the lines running
+	float reverb_time = applied_reverb_time;
+	applied_reverb_time = -1;
+	set_reverb_time(reverb_time);
+}
+
+void
+FdnReverb::reset()
+{
+	for (ChannelState& state : channel_states) {
+		std::fill(state.lines.begin(), state.lines.end(), float4{0, 0, 0, 0});
+		std::fill(state.lowpass.begin(), state.lowpass.end(), float4{0, 0, 0, 0});
+		state.wr_ptr = 0;
+	}
+	smoothed_reverb_time.reset();
+	smoothed_damping.reset();
+	smoothed_mix.reset();
+	control_counter = 0;
+}
+
+// Ticks of now() in a second: fixed on ARMv8 and for clock_gettime, measured once for the time stamp counter
+static double
+__ticks_per_second()
+{
+#if defined(__x86_64__) || defined(__i386__)
+	static const double ticks_per_second = [] {
+		auto start_time = std::chrono::steady_clock::now();
+		CpuMonitor::Ticks start = CpuMonitor::now();
+		std::this_thread::sleep_for(std::chrono::milliseconds(20));
+		CpuMonitor::Ticks end = CpuMonitor::now();
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+		return (end - start) / seconds;
+	}();
+	return ticks_per_second;
+#elif defined(__aarch64__)
+	uint64_t frequency;
+	asm volatile("mrs %0, cntfrq_el0" : "=r"(frequency));
+	return frequency;
+#else
+	return 1e9;
+#endif
+}
+
+// Histogram bin of a tick count: exact below 8 ticks, then 8 bins per octave
+static unsigned int
+__histogram_bin(uint32_t ticks)
+{
+	if (ticks < 8)
+		return ticks;
+	unsigned int octave = 31 - __builtin_clz(ticks);
+	return (octave - 2) * 8 + ((ticks >> (octave - 3)) & 7);
+}
+
+// Middle of the range of tick counts of a histogram bin
+static double
+__histogram_value(unsigned int bin)
+{
+	if (bin < 8)
+		return bin;
+	unsigned int octave = bin / 8 + 2;
+	double low = (double)(8 + bin % 8) * (1u << (octave - 3));
+	return low + 0.5 * (1u << (octave - 3));
+}
+
+CpuMonitor::CpuMonitor(BelaContext *context, float deadline, unsigned int capacity) :
+		measurements(capacity), enabled(true), block_start(0), deadline_misses(0), dropped(0)
+{
+	sample_rate = context->audioSampleRate;
+	ticks_per_second = __ticks_per_second();
+	deadline_ticks_per_frame = deadline * ticks_per_second / sample_rate;
+	
+	// The whole blocks always come first
+	histogram(nullptr).name = "render";
+}
+
+void
+CpuMonitor::push(const Effects* effect, Ticks ticks, unsigned int frames)
+{
+	Measurement measurement = {effect, (uint32_t)std::min<Ticks>(ticks, UINT32_MAX), frames};
+	if (measurements.write(&measurement, 1) == 0)
+		dropped.store(dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+void
+CpuMonitor::end_block(unsigned int frames)
+{
+	if (!is_enabled())
+		return;
+	
+	Ticks ticks = now() - block_start;
+	if (ticks > deadline_ticks_per_frame * frames)
+		deadline_misses.store(deadline_misses.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	push(nullptr, ticks, frames);
+}
+
+CpuMonitor::Histogram&
+CpuMonitor::histogram(const Effects* effect)
+{
+	for (Histogram& h : histograms) {
+		if (h.effect == effect)
+			return h;
+	}
+	
+	Histogram h;
+	h.effect = effect;
+	h.name = "effect " + std::to_string(histograms.size());
+	h.count = 0;
+	h.frames = 0;
+	h.total_ticks = 0;
+	h.min_ticks = UINT32_MAX;
+	h.max_ticks = 0;
+	h.bins.fill(0);
+	histograms.push_back(h);
+	return histograms.back();
+}
+
+unsigned int
+CpuMonitor::poll()
+{
+	Measurement batch[256];
+	unsigned int total = 0;
+	
+	while (size_t count = measurements.read(batch, 256)) {
+		for (size_t i = 0; i < count; i++) {
+			const Measurement& m = batch[i];
+			Histogram& h = histogram(m.effect);
+			h.count++;
+			h.frames += m.frames;
+			h.total_ticks += m.ticks;
+			h.min_ticks = std::min(h.min_ticks, m.ticks);
+			h.max_ticks = std::max(h.max_ticks, m.ticks);
+			h.bins[__histogram_bin(m.ticks)]++;
+		}
+		total += count;
+	}
+	return total;
+}
+
+double
+CpuMonitor::percentile(const Histogram& h, double fraction) const
+{
+	uint64_t rank = (uint64_t)std::ceil(fraction * h.count);
+	uint64_t seen = 0;
+	for (unsigned int bin = 0; bin < histogram_bins; bin++) {
+		seen += h.bins[bin];
+		if (seen >= rank && seen > 0) {
+			// The bin's middle, but never outside of the values actually seen
+			double value = std::min(std::max(__histogram_value(bin), (double)h.min_ticks), (double)h.max_ticks);
+			return to_us(value);
+		}
+	}
+	return to_us(h.max_ticks);
+}
+
+std::vector<CpuMonitor::Statistics>
+CpuMonitor::get_statistics() const
+{
+	std::vector<Statistics> statistics;
+	for (const Histogram& h : histograms) {
+		Statistics s = {h.name, h.count, 0, 0, 0, 0, 0, 0, 0};
+		if (h.count > 0) {
+			s.min_us = to_us(h.min_ticks);
+			s.mean_us = to_us((double)h.total_ticks / h.count);
+			s.max_us = to_us(h.max_ticks);
+			s.p50_us = percentile(h, 0.5);
+			s.p90_us = percentile(h, 0.9);
+			s.p99_us = percentile(h, 0.99);
+			s.load = (h.total_ticks / ticks_per_second) / (h.frames / sample_rate);
+		}
+		statistics.push_back(s);
+	}
+	return statistics;
+}
+
+void
+CpuMonitor::print() const
+{
+	printf("%-16s %10s %9s %9s %9s %9s %9s %9s %7s\n",
+		   "effect", "blocks", "min us", "mean us", "p50 us", "p90 us", "p99 us", "max us", "load");
+	for (const Statistics& s : get_statistics()) {
+		printf("%-16s %10llu %9.2f %9.2f %9.2f %9.2f %9.2f %9.2f %6.2f%%\n", s.name.c_str(), (unsigned long long)s.blocks,
+			   s.min_us, s.mean_us, s.p50_us, s.p90_us, s.p99_us, s.max_us, 100 * s.load);
+	}
+	printf("deadline misses: %llu, dropped measurements: %llu\n",
+		   (unsigned long long)get_deadline_misses(), (unsigned long long)get_dropped());
+}
+
+void
+CpuMonitor::clear()
+{
+	for (Histogram& h : histograms) {
+		h.count = 0;
+		h.frames = 0;
+		h.total_ticks = 0;
+		h.min_ticks = UINT32_MAX;
+		h.max_ticks = 0;
+		h.bins.fill(0);
+	}
+}
+
+SignalMeter::SignalMeter(BelaContext *context, unsigned int channels, float updates_per_second,
+						 unsigned int max_taps, unsigned int capacity) :
+		channels(channels), max_taps(max_taps), updates(capacity), enabled(true), dropped(0)
+{
+	frames_per_update = std::max(1.0f, context->audioSampleRate / updates_per_second);
+	accumulators.resize(max_taps * channels, Accumulator{{0, 0, 0, 0}, {0, 0, 0, 0}, 0});
+	taps.reserve(max_taps);
+	
+	// The output of render() always comes first
+	tap_levels(nullptr).name = "output";
+}
+
+SignalMeter::Tap*
+SignalMeter::find_tap(const Effects* source, unsigned int tap_channels)
+{
+	for (Tap& t : taps) {
+		if (t.source == source)
+			return &t;
+	}
+	if (taps.size() == max_taps)
+		return nullptr;
+	
+	// The capacity was reserved, so adding a tap never allocates
+	taps.push_back(Tap{source, tap_channels, 0, 0, &accumulators[taps.size() * channels]});
+	return &taps.back();
+}
+
+void
+SignalMeter::measure(const Effects* source, const float* const* signal, unsigned int signal_channels, unsigned int frames)
+{
+	typedef int int4 __attribute__((vector_size(16)));
+	if (!is_enabled())
+		return;
+	assert(signal_channels <= channels);
+	Tap* t = find_tap(source, signal_channels);
+	if (!t)
+		return;
+	
+	const int4 abs_mask = {0x7fffffff, 0x7fffffff, 0x7fffffff, 0x7fffffff};
+	const float4 full_scale = {1, 1, 1, 1};
+	unsigned int done = 0;
+	while (done < frames) {
+		// A block may end in the middle of a frame of the meter
+		const unsigned int count = std::min(frames - done, frames_per_update - t->frames);
+		for (unsigned int c = 0; c < signal_channels; c++) {
+			Accumulator& a = t->accumulators[c];
+			const float* in = signal[c] + done;
+			float4 peak = a.peak;
+			float4 sum = a.sum;
+			int4 clips = {0, 0, 0, 0};
+			unsigned int n = 0;
+			for (; n + 4 <= count; n += 4) {
+				float4 x;
+				memcpy(&x, in + n, sizeof(x));		// the blocks are not always 16 bytes aligned
+				const float4 magnitude = (float4)((int4)x & abs_mask);
+				const int4 louder = magnitude > peak;
+				peak = (float4)(((int4)magnitude & louder) | ((int4)peak & ~louder));
+				sum += x * x;
+				clips -= magnitude >= full_scale;	// true is -1
+			}
+			a.clips += clips[0] + clips[1] + clips[2] + clips[3];
+			for (; n < count; n++) {
+				const float magnitude = fabsf(in[n]);
+				peak[0] = std::max(peak[0], magnitude);
+				sum[0] += in[n] * in[n];
+				a.clips += magnitude >= 1;
+			}
+			a.peak = peak;
+			a.sum = sum;
+		}
+		
+		t->frames += count;
+		t->time += count;
+		done += count;
+		if (t->frames == frames_per_update)
+			update(*t);
+	}
+}
+
+void
+SignalMeter::update(Tap& t)
+{
+	for (unsigned int c = 0; c < t.channels; c++) {
+		Accumulator& a = t.accumulators[c];
+		Frame frame;
+		frame.tap = t.source;
+		frame.channel = c;
+		frame.time = t.time;
+		frame.peak = std::max(std::max(a.peak[0], a.peak[1]), std::max(a.peak[2], a.peak[3]));
+		frame.rms = sqrtf((a.sum[0] + a.sum[1] + a.sum[2] + a.sum[3]) / t.frames);
+		frame.clips = a.clips;
+		if (updates.write(&frame, 1) == 0)
+			dropped.store(dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+		a = Accumulator{{0, 0, 0, 0}, {0, 0, 0, 0}, 0};
+	}
+	t.frames = 0;
+}
+
+SignalMeter::Levels&
+SignalMeter::tap_levels(const Effects* source)
+{
+	for (Levels& l : levels) {
+		if (l.tap == source)
+			return l;
+	}
+	
+	Levels l;
+	l.tap = source;
+	l.name = "tap " + std::to_string(levels.size());
+	l.channels = 0;
+	l.peak.assign(channels, 0);
+	l.rms.assign(channels, 0);
+	l.peak_hold.assign(channels, 0);
+	l.clips.assign(channels, 0);
+	levels.push_back(l);
+	return levels.back();
+}
+
+unsigned int
+SignalMeter::poll(const std::function<void(const Frame&)>& consumer)
+{
+	Frame batch[256];
+	unsigned int total = 0;
+	
+	while (size_t count = updates.read(batch, 256)) {
+		for (size_t i = 0; i < count; i++) {
+			const Frame& f = batch[i];
+			Levels& l = tap_levels(f.tap);
+			l.channels = std::max(l.channels, f.channel + 1);
+			l.peak[f.channel] = f.peak;
+			l.rms[f.channel] = f.rms;
+			l.peak_hold[f.channel] = std::max(l.peak_hold[f.channel], f.peak);
+			l.clips[f.channel] += f.clips;
+			if (consumer)
+				consumer(f);
+		}
+		total += count;
+	}
+	return total;
+}
+
+void
+SignalMeter::print() const
+{
+	// dBFS, with silence shown as -inf
+	auto db = [](float level) { return 20 * log10f(level); };
+	printf("%-16s %7s %9s %9s %9s %10s\n", "tap", "channel", "peak dB", "rms dB", "hold dB", "clips");
+	for (const Levels& l : levels) {
+		for (unsigned int c = 0; c < l.channels; c++) {
+			printf("%-16s %7u %9.1f %9.1f %9.1f %10llu\n", l.name.c_str(), c,
+				   db(l.peak[c]), db(l.rms[c]), db(l.peak_hold[c]), (unsigned long long)l.clips[c]);
+		}
+	}
+	printf("dropped frames: %llu\n", (unsigned long long)get_dropped());
+}
+
+void
+SignalMeter::clear()
+{
+	for (Levels& l : levels) {
+		std::fill(l.peak_hold.begin(), l.peak_hold.end(), 0);
+		std::fill(l.clips.begin(), l.clips.end(), 0);
+	}
+}
+
+EffectChain::EffectChain(BelaContext *context, unsigned int max_stages, unsigned int channels) :
+		Effects(context, channels), max_stages(max_stages), monitor(nullptr), meter(nullptr)
+{
+	stages.reserve(max_stages);
+}
+
+bool
+EffectChain::insert(unsigned int position, Effects* effect, bool bypassed)
+{
+	// The capacity was reserved, so inserting never allocates
+	if (stages.size() >= max_stages || position > stages.size())
+		return false;
+	stages.insert(stages.begin() + position, Stage{effect, bypassed});
+	return true;
+}
+
+Effects*
+EffectChain::remove(unsigned int position)
+{
+	if (position >= stages.size())
+		return nullptr;
+	Effects* effect = stages[position].effect;
+	stages.erase(stages.begin() + position);
+	return effect;
+}
+
+bool
+EffectChain::move(unsigned int from, unsigned int to)
+{
+	if (from >= stages.size() || to >= stages.size())
+		return false;
+	
+	if (from < to)
+		std::rotate(stages.begin() + from, stages.begin() + from + 1, stages.begin() + to + 1);
+	else
+		std::rotate(stages.begin() + to, stages.begin() + from, stages.begin() + from + 1);
+	return true;
+}
+
+void
+EffectChain::set_bypass(unsigned int position, bool bypassed)
+{
+	if (position < stages.size())
+		stages[position].bypassed = bypassed;
+}
+
+float
+EffectChain::process(float in, GuiController* controller)
+{
+	for (const Stage& stage : stages) {
+		if (!stage.bypassed)
+			in = stage.effect->process(in, controller);
+	}
+	return in;
+}
+
+void
+EffectChain::process_block(const float* in, float* out, unsigned int frames, GuiController* controller)
+{
+	const bool timed = monitor && monitor->is_enabled();
+	DenormalGuard guard;
+	for (const Stage& stage : stages) {
+		if (stage.bypassed)
+			continue;
+		CpuMonitor::Ticks start = timed ? CpuMonitor::now() : 0;
+		// The first active stage moves the input to the output block, the others work in place
+		stage.effect->process_block(in, out, frames, controller);
+		if (timed)
+			monitor->record(stage.effect, start, frames);
+		if (meter)
+			meter->measure(stage.effect, &out, 1, frames);
+		in = out;
+	}
+	
+	// Every stage is bypassed
+	if (in != out)
+		std::copy(in, in + frames, out);
+}
+
+void
+EffectChain::process_channels(const float* const* in, float* const* out, unsigned int frames, GuiController* controller)
+{
+	const bool timed = monitor && monitor->is_enabled();
+	DenormalGuard guard;
+	bool first = true;
+	for (const Stage& stage : stages) {
+		if (stage.bypassed)
+			continue;
+		assert(stage.effect->get_channels() == channels);
+		CpuMonitor::Ticks start = timed ? CpuMonitor::now() : 0;
+		// Same as process_block: the first active stage moves the input to the output blocks
+		stage.effect->process_channels(first ? in : out, out, frames, controller);
+		if (timed)
+			monitor->record(stage.effect, start, frames);
+		if (meter)
+			meter->measure(stage.effect, out, channels, frames);
+		first = false;
+	}
+	
+	// Every stage is bypassed
+	if (first) {
+		for (unsigned int c = 0; c < channels; c++) {
+			if (in[c] != out[c])
+				std::copy(in[c], in[c] + frames, out[c]);
+		}
+	}
+}
+
+void
+EffectChain::reset()
+{
+	for (const Stage& stage : stages)
+		stage.effect->reset();
+}
+
+void
+EffectChain::advance(unsigned int frames, GuiController* controller)
+{
+	for (const Stage& stage : stages) {
+		if (!stage.bypassed)
+			stage.effect->advance(frames, controller);
+	}
+}
+
+void
+EffectChain::publish(GuiController* controller)
+{
+	for (const Stage& stage : stages)
+		stage.effect->publish(controller);
+}
+
+PresetBank::PresetBank(BelaContext *context, unsigned int max_presets, unsigned int channels, float crossfade_ms) :
+		Effects(context, channels), max_presets(max_presets), request(0), active(0), outgoing(0),
+		fade_length(std::max(crossfade_ms, 0.0f) * sample_rate / 1000), fade_position(fade_length),
+		fade_step(1.0f / std::max(fade_length, 1u)), scratch(2 * this->channels * audio_frames),
+		outgoing_out(this->channels), incoming_out(this->channels), piece_in(this->channels), piece_out(this->channels)
+{
+	presets.reserve(max_presets);
+	
+	for (unsigned int c = 0; c < this->channels; c++) {
+		outgoing_out[c] = &scratch[c * audio_frames];
+		incoming_out[c] = &scratch[(this->channels + c) * audio_frames];
+	}
+}
+
+int
+PresetBank::add(Effects* preset)
+{
+	// The capacity was reserved, so adding never allocates
+	if (presets.size() >= max_presets)
+		return -1;
+	presets.push_back(preset);
+	return presets.size() - 1;
+}
+
+void
+PresetBank::run(Effects* preset, const float* const* in, float* const* out, unsigned int frames, bool planar,
+				GuiController* controller)
+{
+	if (planar)
+		preset->process_channels(in, out, frames, controller);
+	else
+		preset->process_block(in[0], out[0], frames, controller);
+}
+
+void
+PresetBank::render(const float* const* in, float* const* out, unsigned int frames, bool planar, GuiController* controller)
+{
+	const unsigned int count = planar ? channels : 1;
+	
+	// A request is taken at a block boundary, once the crossfade in progress (if any) is over
+	if (!is_crossfading()) {
+		unsigned int requested = request.load(std::memory_order_acquire);
+		unsigned int index = requested >> 1;
+		if (index != active && index < presets.size()) {
+			presets[index]->reset();
+			if ((requested & 1) && fade_length > 0) {
+				outgoing = active;
+				fade_position = 0;
+			}
+			active = index;
+		}
+	}
+	
+	if (presets.empty()) {
+		for (unsigned int c = 0; c < count; c++) {
+			if (in[c] != out[c])
+				std::copy(in[c], in[c] + frames, out[c]);
+		}
+		return;
+	}
+	
+	if (!is_crossfading()) {
+		run(presets[active], in, out, frames, planar, controller);
+		return;
+	}
+	
+	// Both presets read the input before the output is written, so 'in' may be 'out'
+	run(presets[outgoing], in, outgoing_out.data(), frames, planar, controller);
+	run(presets[active], in, incoming_out.data(), frames, planar, controller);
+	for (unsigned int c = 0; c < count; c++) {
+		const float* fading_out = outgoing_out[c];
+		const float* fading_in = incoming_out[c];
+		for (unsigned int n = 0; n < frames; n++) {
+			// Equal gain: the two gains always sum to 1
+			const float gain = std::min(fade_position + n + 1, fade_length) * fade_step;
+			out[c][n] = fading_out[n] + gain * (fading_in[n] - fading_out[n]);
+		}
+	}
+	fade_position = std::min(fade_position + frames, fade_length);
+}
+
+void
+PresetBank::render_pieces(const float* const* in, float* const* out, unsigned int frames, bool planar, GuiController* controller)
+{
+	if (frames <= audio_frames) {
+		render(in, out, frames, planar, controller);
+		return;
+	}
+	
+	// Longer blocks than the initialized block size are processed in pieces, the scratch is not resized
+	const unsigned int count = planar ? channels : 1;
+	for (unsigned int done = 0; done < frames; done += audio_frames) {
+		for (unsigned int c = 0; c < count; c++) {
+			piece_in[c] = in[c] + done;
+			piece_out[c] = out[c] + done;
+		}
+		render(piece_in.data(), piece_out.data(), std::min(frames - done, audio_frames), planar, controller);
+	}
+}
+
+float
+PresetBank::process(float in, GuiController* controller)
+{
+	const float* in_block = &in;
+	float out;
+	float* out_block = &out;
+	render(&in_block, &out_block, 1, false, controller);
+	return out;
+}
+
+void
+PresetBank::process_block(const float* in, float* out, unsigned int frames, GuiController* controller)
+{
+	render_pieces(&in, &out, frames, false, controller);
+}
+
+void
+PresetBank::process_channels(const float* const* in, float* const* out, unsigned int frames, GuiController* controller)
+{
+	render_pieces(in, out, frames, true, controller);
+}
+
+void
+PresetBank::reset()
+{
+	for (Effects* preset : presets)
+		preset->reset();
+	fade_position = fade_length;
+}
+
+void
+PresetBank::advance(unsigned int frames, GuiController* controller)
+{
+	for (Effects* preset : presets)
+		preset->advance(frames, controller);
+}
+
+void
+PresetBank::publish(GuiController* controller)
+{
+	for (Effects* preset : presets)
+		preset->publish(controller);
+}
+
+// After a change of quality, the LoadGovernor waits this long for the load to show the change
+const float governor_settle_ms = 50;
+// Time constant of the average load of the LoadGovernor
+const float governor_average_ms = 100;
+
+LoadGovernor::LoadGovernor(BelaContext *context, float high_load, float low_load, float recovery_ms, unsigned int max_effects) :
+		max_effects(max_effects), ticks_per_frame(__ticks_per_second() / context->audioSampleRate),
+		high_load(high_load), low_load(std::min(low_load, high_load)),
+		recovery_frames(std::max(recovery_ms, 0.0f) * context->audioSampleRate / 1000),
+		settle_frames(governor_settle_ms * context->audioSampleRate / 1000),
+		average_frames(governor_average_ms * context->audioSampleRate / 1000),
+		enabled(true), measuring(false), block_start(0), average_load(0), frames_below(0),
+		blocks_above(0), frames_to_settle(settle_frames), group(0), max_level(0), level(0), last_load(0)
+{
+	effects.reserve(max_effects);
+	groups.reserve(max_effects);
+}
+
+int
+LoadGovernor::add(Effects* effect, unsigned int group)
+{
+	// The capacity was reserved, so adding never allocates
+	if (effects.size() >= max_effects)
+		return -1;
+	effects.push_back(effect);
+	groups.push_back(group);
+	if (group == this->group)
+		max_level.store(get_max_level() + effect->get_quality_tiers() - 1, std::memory_order_relaxed);
+	return effects.size() - 1;
+}
+
+unsigned int
+LoadGovernor::group_max_level(unsigned int group) const
+{
+	unsigned int steps = 0;
+	for (unsigned int i = 0; i < effects.size(); i++) {
+		if (groups[i] == group)
+			steps += effects[i]->get_quality_tiers() - 1;
+	}
+	return steps;
+}
+
+void
+LoadGovernor::select_group(unsigned int new_group)
+{
+	if (new_group == group)
+		return;
+	group = new_group;
+	max_level.store(group_max_level(group), std::memory_order_relaxed);
+	apply(std::min(get_level(), get_max_level()));
+	// The load of the previous blocks was not the load of this group
+	frames_below = 0;
+	blocks_above = 0;
+	frames_to_settle = settle_frames;
+}
+
+void
+LoadGovernor::apply(unsigned int new_level)
+{
+	unsigned int steps = new_level;
+	for (unsigned int i = 0; i < effects.size(); i++) {
+		if (groups[i] != group)
+			continue;
+		Effects* effect = effects[i];
+		const unsigned int tier = std::min(steps, effect->get_quality_tiers() - 1);
+		if (effect->get_quality() != tier)
+			effect->set_quality(tier);
+		steps -= tier;
+	}
+	level.store(new_level, std::memory_order_relaxed);
+}
+
+void
+LoadGovernor::end_block(unsigned int frames)
+{
+	if (!measuring || !is_enabled())
+		return;
+	measuring = false;
+	
+	const float load = (CpuMonitor::now() - block_start) / (frames * ticks_per_frame);
+	last_load.store(load, std::memory_order_relaxed);
+	average_load += (load - average_load) * std::min(frames / average_frames, 1.0f);
+	
+	if (frames_to_settle > 0) {
+		frames_to_settle -= std::min(frames, frames_to_settle);
+		return;
+	}
+	
+	const unsigned int current = get_level();
+	frames_below = average_load < low_load ? frames_below + frames : 0;
+	blocks_above = load > high_load ? blocks_above + 1 : 0;
+	
+	// Down as soon as the blocks come close to the deadline, up only after a long enough quiet period
+	if (blocks_above >= 2 && current < get_max_level()) {
+		apply(current + 1);
+	}
+	else if (frames_below >= recovery_frames && current > 0) {
+		apply(current - 1);
+	}
+	else {
+		return;
+	}
+	frames_below = 0;
+	blocks_above = 0;
+	frames_to_settle = settle_frames;
+}
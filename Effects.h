@@ -5,18 +5,202 @@
  * ordadush100@gmail.com
 ***************************************/
 
+#pragma once
+
 #include <Bela.h>
 #include <libraries/AudioFile/AudioFile.h>
+#include <sndfile.h>
 #include <libraries/Gui/Gui.h>
 #include <libraries/GuiController/GuiController.h>
 #include <libraries/Scope/Scope.h>
 #include <libraries/Biquad/Biquad.h>
 #include <vector>
+#include <array>
+#include <algorithm>
 #include <cmath>
 #include <cassert>
+#include <cstdint>
+#include <atomic>
+#include <string>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <new>
+#include <type_traits>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
 //#include <iostream>
 
 
+/*********************************************************************************************
+ * 'Arena' holds the state of a set of effects (delay lines, filter histories, tables, scratch
+ * blocks) in a single contiguous block of memory allocated once, instead of scattered heap blocks.
+ * Allocations are taken in order (a bump pointer) and aligned to cache lines, so effects constructed
+ * in processing order lay out their state in that order: the working set of a chain is compact,
+ * fits the L2 cache of the Bela (256KB on the Cortex-A8) and is prefetched well.
+ * - The containers of the effects' state are ArenaVectors: while an Arena::Scope is alive on a
+ *   thread, the ArenaVectors constructed on that thread (inside the effects' constructors) take
+ *   their memory from the arena. Without a scope they use the heap as usual.
+ * - create() constructs an effect (or any object) inside the arena, with its state right after it,
+ *   and destroys it with the arena.
+ * Memory is only given back when the arena is destroyed, so it must outlive the effects using it.
+ * When the arena is full, allocations fall back to the heap and are counted (see get_overflow()).
+ * An arena is used by one thread at a time, normally during setup().
+**********************************************************************************************/
+
+class Arena
+{
+public:
+	static const size_t alignment = 64;		// cache line of the Cortex-A8 and of most desktop CPUs
+	
+	// Routes the ArenaVectors constructed on this thread to an arena while it is alive (scopes nest).
+	class Scope
+	{
+	private:
+		Arena* previous;
+		
+	public:
+		Scope(Arena* arena) : previous(active) { active = arena; }
+		~Scope() { active = previous; }
+		Scope(const Scope&) = delete;
+		Scope& operator=(const Scope&) = delete;
+	};
+	
+private:
+	struct Object
+	{
+		void* object;
+		void (*destroy)(void*);
+	};
+	
+	static thread_local Arena* active;		// arena of the innermost Scope of the thread
+	
+	unsigned char* base;			// the block allocated
+	unsigned char* memory;			// its first cache line
+	size_t capacity;
+	size_t used;
+	size_t overflow;				// bytes allocated from the heap because the arena was full
+	std::vector<Object> objects;	// constructed by create(), destroyed in reverse order
+	
+	template <typename T>
+	static void destroy_in_place(void* object) { static_cast<T*>(object)->~T(); }
+	template <typename T>
+	static void destroy_on_heap(void* object) { delete static_cast<T*>(object); }
+	
+public:
+	/**
+	 * @param capacity - size of the arena in bytes, allocated at once.
+	**/
+	Arena(size_t capacity);
+	// Destroys the objects of create() (newest first), then frees the memory.
+	~Arena();
+	Arena(const Arena&) = delete;
+	Arena& operator=(const Arena&) = delete;
+	
+	static Arena* get_active() { return active; }
+	
+	/**
+	 * Takes memory from the arena.
+	 * @param bytes - size of the allocation.
+	 * @returns memory aligned to 'alignment', or nullptr when the arena is full.
+	**/
+	void* allocate(size_t bytes);
+	
+	// True if 'pointer' was allocated from the arena.
+	bool owns(const void* pointer) const
+	{
+		return pointer >= memory && pointer < memory + capacity;
+	}
+	
+	// Counts an allocation that did not fit (made on the heap instead).
+	void add_overflow(size_t bytes) { overflow += bytes; }
+	
+	/**
+	 * Constructs an object inside the arena, within a Scope of the arena, so its ArenaVectors follow it.
+	 * The object is destroyed by the arena's destructor (do not delete it).
+	 * @param args - the arguments of the object's constructor.
+	 * @returns the new object (on the heap if the arena is full).
+	**/
+	template <typename T, typename... Args>
+	T* create(Args&&... args)
+	{
+		Scope scope(this);
+		void* place = allocate(sizeof(T));
+		T* object;
+		if (place) {
+			object = new (place) T(std::forward<Args>(args)...);
+			objects.push_back({object, &destroy_in_place<T>});
+		}
+		else {
+			add_overflow(sizeof(T));
+			object = new T(std::forward<Args>(args)...);
+			objects.push_back({object, &destroy_on_heap<T>});
+		}
+		return object;
+	}
+	
+	size_t get_capacity() const { return capacity; }
+	size_t get_used() const { return used; }
+	size_t get_overflow() const { return overflow; }
+};
+
+/*********************************************************************************************
+ * 'ArenaAllocator' is the standard allocator of ArenaVector: it takes memory from the arena that
+ * was active (see Arena::Scope) when the container was constructed, or from the heap.
+**********************************************************************************************/
+
+template <typename T>
+class ArenaAllocator
+{
+private:
+	Arena* arena;
+	
+	template <typename U> friend class ArenaAllocator;
+	
+public:
+	typedef T value_type;
+	typedef std::true_type propagate_on_container_move_assignment;
+	typedef std::true_type propagate_on_container_swap;
+	
+	ArenaAllocator() : arena(Arena::get_active()) {}
+	template <typename U>
+	ArenaAllocator(const ArenaAllocator<U>& other) : arena(other.arena) {}
+	
+	T* allocate(size_t count)
+	{
+		void* memory = arena ? arena->allocate(count * sizeof(T)) : nullptr;
+		if (!memory) {
+			if (arena)
+				arena->add_overflow(count * sizeof(T));
+			memory = ::operator new(count * sizeof(T));
+		}
+		return static_cast<T*>(memory);
+	}
+	
+	void deallocate(T* pointer, size_t count)
+	{
+		// Arena memory is given back with the whole arena
+		if (!arena || !arena->owns(pointer))
+			::operator delete(pointer);
+	}
+	
+	template <typename U>
+	bool operator==(const ArenaAllocator<U>& other) const { return arena == other.arena; }
+	template <typename U>
+	bool operator!=(const ArenaAllocator<U>& other) const { return arena != other.arena; }
+};
+
+// Vector for the state of the effects, in the active arena when there is one (see Arena).
+template <typename T>
+using ArenaVector = std::vector<T, ArenaAllocator<T>>;
+
+
+// 4 floats SIMD vector (GCC/clang vector extension): SSE on x86, NEON on ARM, plain scalar code elsewhere.
+typedef float float4 __attribute__((vector_size(16)));
+
 /*********************************************************************************************
  * This class implements a generic ring buffer.
  * Buffer size is determined at initalization and cannot be changed.
@@ -28,7 +212,7 @@ template <typename T>
 class RingBuffer
 {
 private:
-	std::vector<T> ring_buffer;
+	ArenaVector<T> ring_buffer;
 	unsigned int size;
 	unsigned int wr_ptr;
 		
@@ -38,7 +222,7 @@ public:
 		ring_buffer.resize(size);
 		if (other) {
 			assert(size >= other->size());
-			ring_buffer = *other;
+			std::copy(other->begin(), other->end(), ring_buffer.begin());
 			wr_ptr = other->size() % size;  
 		}
 	}
@@ -66,11 +250,524 @@ public:
 	}
 };
 
+/*************************************************************************************************
+ * This class implements a generic ring buffer with a power-of-two capacity and a mirrored layout.
+ * The requested size is rounded up to the next power of two at initalization and cannot be changed.
+ * Every sample is stored twice (at index i and at index i + capacity), so:
+ *   - reads wrap around with a bit mask instead of an integer modulo.
+ *   - any window of the last 'capacity' samples is a single contiguous span (see window()),
+ *     which allows block processing with plain (SIMD) loads and memcpy instead of per-sample reads.
+ *   - the block just written can be read back at a fractional delay per sample (read_linear(),
+ *     read_cubic(), read_allpass()) without any wrap per tap, for modulated delays (chorus, flanger,
+ *     vibrato): the interpolation weights of 4 samples are computed with single SIMD operations.
+**************************************************************************************************/
+
+template <typename T>
+class MirroredRingBuffer
+{
+private:
+	ArenaVector<T> ring_buffer;		// 2 * capacity elements
+	unsigned int capacity;
+	unsigned int mask;
+	unsigned int wr_ptr;
+	
+public:
+	MirroredRingBuffer(unsigned int size) : capacity(1), wr_ptr(0)
+	{
+		while (capacity < size)
+			capacity <<= 1;
+		mask = capacity - 1;
+		ring_buffer.resize(2 * capacity);
+	}
+	
+	/* Writes a new value to the ring buffer (and updates the write pointer).
+	 * @param val - the value to write.
+	 * @returns nothing (always succeeds).
+	**/
+	void write(const T val)
+	{
+		ring_buffer[wr_ptr] = val;
+		ring_buffer[wr_ptr + capacity] = val;
+		wr_ptr = (wr_ptr + 1) & mask;
+	}
+	
+	/* Writes a block of values to the ring buffer, equivalent to calling write() for each of them.
+	 * @param vals - the values to write (oldest first).
+	 * @param count - number of values, must not be bigger than the capacity.
+	 * @returns nothing (always succeeds).
+	**/
+	void write_block(const T* vals, unsigned int count)
+	{
+		assert(count <= capacity);
+		// wr_ptr < capacity, so the block always fits linearly in the doubled storage
+		T* dst = &ring_buffer[wr_ptr];
+		std::copy(vals, vals + count, dst);
+		
+		// Mirror the part that landed in the first half to the second half and vice versa
+		unsigned int first_half = std::min(count, capacity - wr_ptr);
+		std::copy(dst, dst + first_half, dst + capacity);
+		std::copy(dst + first_half, dst + count, &ring_buffer[0]);
+		
+		wr_ptr = (wr_ptr + count) & mask;
+	}
+	
+	/**
+	 * Reads a sample from the ring buffer.
+	 * @param samples_delay - delay to read from, must be smaller than the capacity.
+	 * @returns the value of the relevant sample.
+	**/
+	T read(unsigned int samples_delay = 0) const
+	{
+		assert(samples_delay < capacity);
+		return ring_buffer[(wr_ptr - 1 - samples_delay) & mask];
+	}
+	
+	/**
+	 * Gives direct access to a window of previous samples, without copying.
+	 * window(length, delay)[length - 1] is read(delay) and window(length, delay)[0] is read(delay + length - 1).
+	 * The pointer is valid until the next write.
+	 * @param length - number of samples in the window.
+	 * @param samples_delay - delay of the newest sample in the window.
+	 * @returns pointer to the oldest sample of a contiguous span of 'length' samples.
+	**/
+	const T* window(unsigned int length, unsigned int samples_delay = 0) const
+	{
+		assert(length + samples_delay <= capacity);
+		return &ring_buffer[(wr_ptr - length - samples_delay) & mask];
+	}
+	
+	unsigned int get_capacity() const { return capacity; }
+	
+	// Longest delay the fractional reads accept after a block of 'count' samples was written
+	// (0 when the block leaves no room for any, count + 2 must not be bigger than the capacity).
+	unsigned int get_max_delay(unsigned int count) const { return count + 2 < capacity ? capacity - count - 2 : 0; }
+	
+	/**
+	 * Reads the block just written at fractional delays, with linear interpolation.
+	 * out[n] is the signal delays[n] samples before sample n of the block (the last 'count' samples
+	 * written, e.g. with write_block()), a delay of 0 being the sample itself.
+	 * Cheap, but it lowpasses the signal more the closer the fraction is to 0.5.
+	 * @param delays - one delay per sample, from 0 to get_max_delay(count).
+	 * @param out - receives the 'count' samples, may be the block that was written.
+	 * @param count - number of samples of the block.
+	 * @returns nothing.
+	**/
+	void read_linear(const float* delays, T* out, unsigned int count) const
+	{
+		if (!count)
+			return;
+		const T* x = newest_block(count);
+		for (unsigned int n = 0; n < count; n += 4) {
+			int position[4];
+			const float4 f = split_delays(delays, n, count, 0, position);
+			float4 x0, x1;
+			for (unsigned int lane = 0; lane < 4; lane++) {
+				x0[lane] = x[position[lane]];
+				x1[lane] = x[position[lane] - 1];
+			}
+			store(x0 + f * (x1 - x0), out, n, count);
+		}
+	}
+	
+	/**
+	 * Reads the block just written at fractional delays, with 3rd order (4 points) Lagrange interpolation:
+	 * a flatter response than the linear interpolation, for about twice the cost. It is for accuracy, not
+	 * speed: on x86 it measured 4.6 ns per sample, slower than a sample by sample loop of read() with linear
+	 * interpolation (3.7 ns).
+	 * @param delays - one delay per sample, from 1 to get_max_delay(count) (the newest sample is one of the points).
+	 * @param out - receives the 'count' samples, may be the block that was written.
+	 * @param count - number of samples of the block.
+	 * @returns nothing.
+	**/
+	void read_cubic(const float* delays, T* out, unsigned int count) const
+	{
+		if (!count)
+			return;
+		const T* x = newest_block(count);
+		for (unsigned int n = 0; n < count; n += 4) {
+			int position[4];
+			// The 4 points are 0 to 3 samples older than position, the delay from position is D (1 to 2)
+			const float4 d = split_delays(delays, n, count, 1, position);
+			float4 x0, x1, x2, x3;
+			for (unsigned int lane = 0; lane < 4; lane++) {
+				x0[lane] = x[position[lane]];
+				x1[lane] = x[position[lane] - 1];
+				x2[lane] = x[position[lane] - 2];
+				x3[lane] = x[position[lane] - 3];
+			}
+			const float4 d1 = d - 1;
+			const float4 d2 = d - 2;
+			const float4 d3 = d - 3;
+			const float4 y = (d1 * d2 * d3) * (-1.0f / 6) * x0 + (d * d2 * d3) * 0.5f * x1
+							 + (d * d1 * d3) * -0.5f * x2 + (d * d1 * d2) * (1.0f / 6) * x3;
+			store(y, out, n, count);
+		}
+	}
+	
+	/**
+	 * Reads the block just written at fractional delays, with first order allpass interpolation:
+	 * a flat magnitude response (no lowpass, unlike the linear interpolation), but the interpolator has
+	 * a state and its phase is only accurate at low frequencies, so it suits slowly modulated delays
+	 * (chorus, vibrato, modulated reverb lines) rather than jumps. The fraction is kept between 0.5
+	 * and 1.5 samples, where the allpass coefficient stays small.
+	 * @param delays - one delay per sample, from 0.5 to get_max_delay(count).
+	 * @param out - receives the 'count' samples, may be the block that was written.
+	 * @param count - number of samples of the block.
+	 * @param state - the previous output of the interpolator, one per reader (starts at 0).
+	 * @returns nothing.
+	**/
+	void read_allpass(const float* delays, T* out, unsigned int count, T& state) const
+	{
+		if (!count)
+			return;
+		const T* x = newest_block(count);
+		for (unsigned int n = 0; n < count; n += 4) {
+			int position[4];
+			const float4 f = split_delays(delays, n, count, 0.5f, position);
+			float4 x0, x1;
+			for (unsigned int lane = 0; lane < 4; lane++) {
+				x0[lane] = x[position[lane]];
+				x1[lane] = x[position[lane] - 1];
+			}
+			// y[n] = eta * x[n - M] + x[n - M - 1] - eta * y[n - 1], everything but the recursion 4 at a time
+			const float4 eta = (1 - f) / (1 + f);
+			const float4 feed_forward = eta * x0 + x1;
+			for (unsigned int lane = 0; lane < 4 && n + lane < count; lane++) {
+				state = feed_forward[lane] - eta[lane] * state;
+				out[n + lane] = state;
+			}
+		}
+	}
+	
+	// Fills the buffer with zeros (does not allocate).
+	void clear()
+	{
+		std::fill(ring_buffer.begin(), ring_buffer.end(), T());
+		wr_ptr = 0;
+	}
+	
+private:
+	// Sample 0 of the last 'count' samples written (count > 0). The newest sample is taken from the second
+	// copy, so the reads of the whole block go up to 'capacity' samples back without wrapping.
+	const T* newest_block(unsigned int count) const
+	{
+		static_assert(std::is_same<T, float>::value, "the fractional reads need float samples");
+		assert(count + 2 <= capacity);
+		return &ring_buffer[((wr_ptr - 1) & mask) + capacity] - (count - 1);
+	}
+	
+	/* Splits the delays of samples n to n + 3 of a block into a whole part M and a fraction f, with
+	 * delay = M + f and f from 'shift' to 1 + 'shift' (lanes past the end repeat the last sample).
+	 * @param position - receives the position of every lane minus M, from the start of the block.
+	 * @returns the fractions.
+	**/
+	float4 split_delays(const float* delays, unsigned int n, unsigned int count, float shift, int* position) const
+	{
+		float4 fraction;
+		for (unsigned int lane = 0; lane < 4; lane++) {
+			const unsigned int sample = std::min(n + lane, count - 1);
+			const float delay = delays[sample];
+			assert(delay >= shift && delay <= get_max_delay(count));
+			const int whole = (int)(delay - shift);
+			position[lane] = (int)sample - whole;
+			fraction[lane] = delay - whole;
+		}
+		return fraction;
+	}
+	
+	// Writes the lanes of v that are inside the block.
+	static void store(const float4& v, T* out, unsigned int n, unsigned int count)
+	{
+		for (unsigned int lane = 0; lane < 4 && n + lane < count; lane++)
+			out[n + lane] = v[lane];
+	}
+};
+
+/*************************************************************************************************
+ * 'DenormalGuard' makes the CPU flush denormal numbers to zero while it is in scope, and restores
+ * the previous mode when it goes out of scope (flush-to-zero and denormals-are-zero in the MXCSR on x86,
+ * the FZ bit of the FPSCR/FPCR on ARM).
+ * The feedback loops of the recursive effects (reverb combs and allpasses, the wah-wah band-pass,
+ * IIR filters) decay toward zero when the input goes silent, and every operation on a denormal can cost
+ * tens to hundreds of cycles, so without it the CPU load peaks during quiet passages.
+ * The block methods of the effects with state (including ConvolutionReverb, whose input may be the tail
+ * of another effect) and of EffectChain hold a guard, per-sample process() calls do not: declare a guard
+ * at the top of render() when processing sample by sample. A guard inside another one only reads the
+ * control register.
+ * On other CPUs, or when EFFECTS_DENORMALS_OFFSET is defined, the guard does nothing and the recursive
+ * effects add a constant offset far below audibility (bias()) to the input of their feedback loops
+ * instead, so their state settles on a tiny normal number rather than decaying into denormals.
+**************************************************************************************************/
+
+#if !defined(EFFECTS_DENORMALS_OFFSET) && (defined(__SSE2__) || defined(__aarch64__) || (defined(__arm__) && defined(__VFP_FP__) && !defined(__SOFTFP__)))
+#define EFFECTS_FLUSH_DENORMALS 1
+#else
+#define EFFECTS_FLUSH_DENORMALS 0
+#endif
+
+class DenormalGuard
+{
+private:
+#if EFFECTS_FLUSH_DENORMALS
+#if defined(__SSE2__)
+	typedef unsigned int Mode;
+	static constexpr Mode flush_bits = 0x8040;	// FTZ | DAZ
+	static Mode read_mode() { return _mm_getcsr(); }
+	static void write_mode(Mode mode) { _mm_setcsr(mode); }
+#elif defined(__aarch64__)
+	typedef uint64_t Mode;
+	static constexpr Mode flush_bits = 1 << 24;	// FZ
+	static Mode read_mode() { Mode mode; asm volatile("mrs %0, fpcr" : "=r"(mode)); return mode; }
+	static void write_mode(Mode mode) { asm volatile("msr fpcr, %0" : : "r"(mode)); }
+#else
+	typedef uint32_t Mode;
+	static constexpr Mode flush_bits = 1 << 24;	// FZ
+	static Mode read_mode() { Mode mode; asm volatile("vmrs %0, fpscr" : "=r"(mode)); return mode; }
+	static void write_mode(Mode mode) { asm volatile("vmsr fpscr, %0" : : "r"(mode)); }
+#endif
+	
+	Mode previous;		// mode when the guard was created
+	bool changed;		// false when denormals were already flushed
+#endif
+	
+public:
+	DenormalGuard()
+	{
+#if EFFECTS_FLUSH_DENORMALS
+		previous = read_mode();
+		changed = (previous & flush_bits) != flush_bits;
+		if (changed)
+			write_mode(previous | flush_bits);
+#endif
+	}
+	
+	~DenormalGuard()
+	{
+#if EFFECTS_FLUSH_DENORMALS
+		if (changed)
+			write_mode(previous);
+#endif
+	}
+	
+	DenormalGuard(const DenormalGuard&) = delete;
+	DenormalGuard& operator=(const DenormalGuard&) = delete;
+	
+	// true when the CPU flushes denormals inside a guard, false when the effects rely on bias().
+	static constexpr bool hardware_flush() { return EFFECTS_FLUSH_DENORMALS; }
+	
+	// The input of a feedback loop: unchanged when the CPU flushes denormals, offset by 1e-18 (-360 dB) otherwise.
+	static float bias(float in)
+	{
+#if EFFECTS_FLUSH_DENORMALS
+		return in;
+#else
+		return in + 1e-18f;
+#endif
+	}
+};
+
+/*************************************************************************************************
+ * This class implements a bank of parallel feedback comb filters sharing the same input:
+ * y_k[n] = x[n] + g_k * y_k[n - D_k - 1], and the output is the average of the combs outputs
+ * (as in the Schroeder reverb).
+ * The delay lines are stored as a structure of arrays: the samples of all the combs at a given time
+ * are stored next to each other, so the feedback multiply, the add and the write of 4 combs are a
+ * single SIMD operation (float4). Lanes is the number of combs, a multiple of 4.
+ * The lines hold exactly the samples the longest comb reads (D + 2 rows), rather than a power of two,
+ * so a Reverb's state stays small enough for the cache. A block is processed in segments in which
+ * neither the write nor any read wraps, so the wrap costs a compare per segment rather than per read.
+ * Only the first 4 combs can run (see set_active_combs()), in the same lines: a cheaper configuration
+ * needs no storage of its own.
+**************************************************************************************************/
+
+template <unsigned int Lanes>
+class CombFilterBank
+{
+	static_assert(Lanes > 0 && Lanes % 4 == 0, "Lanes must be a multiple of 4");
+	
+private:
+	static constexpr unsigned int vectors = Lanes / 4;
+	
+	ArenaVector<float> storage;		// capacity * Lanes samples, plus padding for alignment
+	float4* lines;					// 16 bytes aligned start of the delay lines inside 'storage'
+	unsigned int capacity;			// rows of Lanes samples
+	unsigned int wr_ptr;
+	unsigned int active_vectors;	// vectors of 4 combs running, 1 or 'vectors'
+	std::array<unsigned int, Lanes> delays;
+	float4 gains[vectors];
+	
+	// Row written 'age' samples before the row 'position' (age <= capacity)
+	unsigned int row(unsigned int position, unsigned int age) const
+	{
+		return position >= age ? position - age : position + capacity - age;
+	}
+	
+	// y_k[n - D_k - 1] of comb k (vector types may alias their element type)
+	float delayed_sample(unsigned int k) const
+	{
+		return ((const float*)lines)[row(wr_ptr, delays[k] + 1) * Lanes + k];
+	}
+	
+	// Runs the first Vectors * 4 combs for a single sample, and averages them.
+	template <unsigned int Vectors>
+	float run(float in)
+	{
+		// Gather y_k[n - D_k - 1], every comb reads its own position
+		float4 delayed[Vectors];
+		for (unsigned int v = 0; v < Vectors; v++)
+			delayed[v] = float4{delayed_sample(4*v), delayed_sample(4*v + 1), delayed_sample(4*v + 2), delayed_sample(4*v + 3)};
+		
+		// Feedback, add and write of 4 combs at once
+		float4* current = lines + wr_ptr * vectors;
+		in = DenormalGuard::bias(in);
+		for (unsigned int v = 0; v < Vectors; v++)
+			current[v] = in + delayed[v] * gains[v];
+		if (++wr_ptr == capacity)
+			wr_ptr = 0;
+		
+		float sum = 0;
+		for (unsigned int k = 0; k < 4 * Vectors; k++)
+			sum += current[k / 4][k % 4];
+		return sum * (1.0f / (4 * Vectors));
+	}
+	
+	// Runs the first Vectors * 4 combs over a block, and averages them.
+	template <unsigned int Vectors>
+	void run(const float* in, float* out, unsigned int frames)
+	{
+		float* samples = (float*)lines;		// vector types may alias their element type
+		for (unsigned int done = 0; done < frames; ) {
+			// y_k[n - D_k - 1] of every comb, for as many samples as no pointer wraps
+			const float* taps[4 * Vectors];
+			unsigned int span = std::min(frames - done, capacity - wr_ptr);
+			for (unsigned int k = 0; k < 4 * Vectors; k++) {
+				const unsigned int read_row = row(wr_ptr, delays[k] + 1);
+				span = std::min(span, capacity - read_row);
+				taps[k] = samples + read_row * Lanes + k;
+			}
+			
+			float4* current = lines + wr_ptr * vectors;
+			for (unsigned int n = 0; n < span; n++) {
+				const float x = DenormalGuard::bias(in[done + n]);
+				// Feedback, add and write of 4 combs at once
+				for (unsigned int v = 0; v < Vectors; v++) {
+					const float4 delayed = {taps[4*v][n * Lanes], taps[4*v + 1][n * Lanes],
+											taps[4*v + 2][n * Lanes], taps[4*v + 3][n * Lanes]};
+					current[v] = x + delayed * gains[v];
+				}
+				float sum = 0;
+				for (unsigned int k = 0; k < 4 * Vectors; k++)
+					sum += current[k / 4][k % 4];
+				out[done + n] = sum * (1.0f / (4 * Vectors));
+				current += vectors;
+			}
+			
+			wr_ptr += span;
+			if (wr_ptr == capacity)
+				wr_ptr = 0;
+			done += span;
+		}
+	}
+	
+public:
+	/**
+	 * @param delays - the delay D_k of every comb (in units of samples).
+	**/
+	CombFilterBank(const std::array<unsigned int, Lanes>& delays) : wr_ptr(0), active_vectors(vectors), delays(delays)
+	{
+		// The oldest sample read (D + 1 samples ago) must not be the one being written
+		capacity = *std::max_element(delays.begin(), delays.end()) + 2;
+		
+		storage.resize(capacity * Lanes + 4);
+		uintptr_t address = (uintptr_t)storage.data();
+		lines = (float4*)((address + 15) & ~(uintptr_t)15);
+		
+		for (unsigned int v = 0; v < vectors; v++)
+			gains[v] = float4{0, 0, 0, 0};
+	}
+	
+	/**
+	 * Sets the feedback gains.
+	 * @param new_gains - Lanes gains, one per comb.
+	 * @returns nothing.
+	**/
+	void set_gains(const float* new_gains)
+	{
+		for (unsigned int k = 0; k < Lanes; k++)
+			gains[k / 4][k % 4] = new_gains[k];
+	}
+	
+	/**
+	 * Runs the active combs for a single sample.
+	 * @param in - the input sample x[n].
+	 * @returns the average of the combs outputs y_k[n].
+	**/
+	float process(float in)
+	{
+		return active_vectors == vectors ? run<vectors>(in) : run<1>(in);
+	}
+	
+	/**
+	 * Runs the active combs for a block of samples.
+	 * @param in - the input block.
+	 * @param out - the output block (average of the combs). May point to the same memory as 'in'.
+	 * @param frames - number of samples in the block.
+	 * @returns nothing.
+	**/
+	void process(const float* in, float* out, unsigned int frames)
+	{
+		if (active_vectors == vectors)
+			run<vectors>(in, out, frames);
+		else
+			run<1>(in, out, frames);
+	}
+	
+	/**
+	 * Runs the first 4 combs only, or all of them again. The first 4 combs continue from their history
+	 * either way, the other combs start empty when they run again. No memory is allocated.
+	 * @param count - 4 or Lanes.
+	 * @returns nothing.
+	**/
+	void set_active_combs(unsigned int count)
+	{
+		assert(count == 4 || count == Lanes);
+		const unsigned int new_vectors = count / 4;
+		if (new_vectors > active_vectors) {
+			for (unsigned int r = 0; r < capacity; r++) {
+				for (unsigned int v = active_vectors; v < new_vectors; v++)
+					lines[r * vectors + v] = float4{0, 0, 0, 0};
+			}
+		}
+		active_vectors = new_vectors;
+	}
+	unsigned int get_active_combs() const { return 4 * active_vectors; }
+	
+	// Fills the delay lines with zeros (does not allocate).
+	void clear()
+	{
+		std::fill(storage.begin(), storage.end(), 0.0f);
+		wr_ptr = 0;
+	}
+	
+	// 'lines' points inside 'storage': a copy would point to the original's samples, a move keeps the memory
+	CombFilterBank(const CombFilterBank&) = delete;
+	CombFilterBank& operator=(const CombFilterBank&) = delete;
+	CombFilterBank(CombFilterBank&&) = default;
+	CombFilterBank& operator=(CombFilterBank&&) = default;
+};
+
 /************************************************************************************************************************
  * This class implements a generic IIR filter.
  * It must be initalized with two arrays of FilterElement, where each element consist of delay and coefficient.
  * Then, the process method performs the following calculation according to the given arrays:
  * y[n] = (b0*x[n] + b1*x[n-1] + b2*x[n-2] + ...... bN*x[n - N]) - (a0*y[n] + a1*x[n-1] + a2*x[n-2] + ...... bN*x[n - M])
+ * It can be used in two ways:
+ * - With external RingBuffers: the caller writes x[n] to the inputs buffer before process(inputs, outputs),
+ *   and the result to the outputs buffer after it.
+ * - Stateful: process(in) and the block process() keep the history inside the filter, in two small arrays
+ *   sized to the largest delay (rounded up to a power of two), so the caller allocates nothing and the
+ *   history stays in the cache. The same FilterElement arrays give the same filter in both ways
+ *   (an output delay d reads the output written d + 1 calls ago).
 *************************************************************************************************************************/
 
 struct FilterElement
@@ -83,65 +780,1102 @@ class IIRFilter
 {
 private:
 	unsigned int input_elements_num;
-	FilterElement* input_elements;
+	ArenaVector<FilterElement> input_elements;
 	unsigned int output_elements_num;
-	FilterElement* output_elements;
+	ArenaVector<FilterElement> output_elements;
+	
+	// History of the stateful mode
+	ArenaVector<float> inputs;		// x[n] history
+	ArenaVector<float> outputs;		// y[n] history
+	unsigned int mask;
+	unsigned int wr_ptr;
 
 public:
 	IIRFilter(unsigned int input_elements_num, FilterElement* input_elements, unsigned int output_elements_num, FilterElement* output_elements);
-	~IIRFilter();
 	float process(const RingBuffer<float>& inputs_buffer, const RingBuffer<float>& outputs_buffer) const;
-};
-
-/*********************************************************************************************************
- * 'Effects' is an abstract class that defines the basic common structure of
- * all audio effects according to how we implemented them on Bela.
- * It is possible to add members and methods which may be relevant for multiple effects.
- * In addition, we have implemented three audio effects in this file: distortion, wah-wah and reverb.
- * Note: One must initialize a gui controller and give it as a reference to the classes' constructors and
- * methods. Sliders are initialized by the classes' constructors.
-**********************************************************************************************************/
-
-class Effects
-{
-protected:
-	float sample_rate;
-	unsigned int audio_frames_per_analog_frame;
 	
-public:
-	Effects(BelaContext *context);
-	virtual ~Effects() = default;
+	/**
+	 * Filters a single sample with the filter's own history.
+	 * @param in - the input sample x[n].
+	 * @returns the output sample y[n].
+	**/
+	float process(float in);
 	
 	/**
-	 * Every effect inherits from this class must override the process method.
-	 * Normally, it should be called once for every sample.
-	 * @param in - An input sample to be processed.
-	 * @param controller - the gui controller defined for the project.
-	 * @returns the processed output sample.
+	 * Filters a block of samples with the filter's own history.
+	 * @param in - the input block.
+	 * @param out - the output block. May point to the same memory as 'in'.
+	 * @param frames - number of samples in the block.
+	 * @returns nothing.
 	**/
-	virtual float process(float in, GuiController* controller = nullptr) = 0;
+	void process(const float* in, float* out, unsigned int frames);
+	
+	// Clears the filter's own history (does not allocate).
+	void reset();
 };
 
+/************************************************************************************************************************
+ * This class implements an IIR filter whose number of taps is known at compile time.
+ * It performs the same calculation as IIRFilter, with the following differences:
+ * - The coefficients are held in std::array members, and the filter owns its input and output history
+ *   (HistorySize samples each, HistorySize must be a power of two bigger than the largest input delay,
+ *   and than the largest output delay + 1).
+ * - Every loop has a compile-time trip count and history reads wrap with a bit mask, so the compiler fully unrolls
+ *   the taps into straight-line multiply-adds. When the filter is built from constant FilterElement arrays in the
+ *   same translation unit, the delays and coefficients are propagated as constants as well.
+ * The FilterElement arrays mean the same as for IIRFilter: an output delay d reads y[n-1-d] (delay 0 is y[n-1]),
+ * so the same arrays give the same filter.
+ * IIRFilter remains the fallback for designs which are only known at runtime.
+*************************************************************************************************************************/
 
-class Distortion : public Effects
+template <unsigned int InputTaps, unsigned int OutputTaps, unsigned int HistorySize>
+class StaticIIRFilter
 {
+	static_assert(HistorySize > 0 && (HistorySize & (HistorySize - 1)) == 0, "HistorySize must be a power of two");
+	
 private:
-
-	// Members to hold gui sliders indexes
-	unsigned int gain_slider_index;
-	unsigned int volume_slider_index;
-	unsigned int type_slider_index;
-
+	static constexpr unsigned int mask = HistorySize - 1;
+	
+	std::array<FilterElement, InputTaps> input_elements;
+	std::array<FilterElement, OutputTaps> output_elements;
+	std::array<float, HistorySize> inputs;		// x[n] history
+	std::array<float, HistorySize> outputs;		// y[n] history
+	unsigned int wr_ptr;
+	
 public:
-	Distortion(BelaContext *context, GuiController* controller);
-	float process(float in, GuiController* controller) override;
-	/**
-	 * This function is equivalent to the 'regular' process function.
+	StaticIIRFilter(const std::array<FilterElement, InputTaps>& input_elements,
+					const std::array<FilterElement, OutputTaps>& output_elements) :
+			input_elements(input_elements), output_elements(output_elements), wr_ptr(0)
+	{
+		for (const FilterElement& element : input_elements)
+			assert(element.delay < HistorySize);
+		for (const FilterElement& element : output_elements)
+			assert(element.delay + 1 < HistorySize);
+		inputs.fill(0);
+		outputs.fill(0);
+	}
+	
+	/**
+	 * Filters a single sample.
+	 * @param in - the input sample x[n].
+	 * @returns the output sample y[n].
+	**/
+	float process(float in)
+	{
+		inputs[wr_ptr] = DenormalGuard::bias(in);
+		
+		float result = 0;
+		for (unsigned int i = 0; i < InputTaps; i++) {
+			result += input_elements[i].coefficient * inputs[(wr_ptr - input_elements[i].delay) & mask];
+		}
+		for (unsigned int i = 0; i < OutputTaps; i++) {
+			result -= output_elements[i].coefficient * outputs[(wr_ptr - 1 - output_elements[i].delay) & mask];
+		}
+		
+		outputs[wr_ptr] = result;
+		wr_ptr = (wr_ptr + 1) & mask;
+		return result;
+	}
+	
+	/**
+	 * Filters a block of samples.
+	 * @param in - the input block.
+	 * @param out - the output block. May point to the same memory as 'in'.
+	 * @param frames - number of samples in the block.
+	 * @returns nothing.
+	**/
+	void process(const float* in, float* out, unsigned int frames)
+	{
+		DenormalGuard guard;
+		for (unsigned int n = 0; n < frames; n++) {
+			out[n] = process(in[n]);
+		}
+	}
+};
+
+/*********************************************************************************************************
+ * This class implements a memoryless waveshaper, y = f(x), with a selectable curve:
+ * hard clip, exponential soft clip (sign(x) * (1 - exp(-|x|))), tanh or a custom function.
+ * The soft curves are sampled once into a lookup table over [-input_range, input_range] and evaluated
+ * with linear interpolation. Inputs outside the range are clamped, so curves must be flat beyond it.
+ * Evaluation is branchless (min/max clamp, truncation and one multiply-add), costs the same for every
+ * curve and can be unrolled/vectorized over a block. Hard clip is a plain clamp, so it is computed directly.
+ * Error bound: linear interpolation of a curve with |f''| <= M is within M * h^2 / 8 of the curve,
+ * where h = 2 * input_range / table_size. With the defaults (range 16, 2048 intervals, h = 1/64) this is
+ * below 3.1e-5 (-90dB) for the exponential soft clip (M = 1) and below 2.4e-5 for tanh (M = 0.77).
+ * At the edges of the range both soft curves are within 1.2e-7 of +-1.
+**********************************************************************************************************/
+
+class Waveshaper
+{
+public:
+	enum Curve
+	{
+		HARD_CLIP,
+		EXPONENTIAL_SOFT_CLIP,
+		TANH,
+		CUSTOM
+	};
+	
+	/**
+	 * @param curve - the transfer curve.
+	 * @param custom_curve - the function to sample when curve is CUSTOM (without it, the curve is HARD_CLIP).
+	 * @param input_range - the table covers inputs in [-input_range, input_range].
+	 * @param table_size - number of table intervals.
+	**/
+	Waveshaper(Curve curve = HARD_CLIP, float (*custom_curve)(float) = nullptr, float input_range = 16, unsigned int table_size = 2048);
+	
+	/**
+	 * Changes the curve. Recomputes the table of the soft curves (no allocation), so prefer calling it outside
+	 * the audio thread.
+	 * @param curve - the transfer curve.
+	 * @param custom_curve - the function to sample when curve is CUSTOM. Without it the curve is HARD_CLIP,
+	 *                       get_curve() tells which one is used.
+	 * @returns nothing.
+	**/
+	void set_curve(Curve curve, float (*custom_curve)(float) = nullptr);
+	Curve get_curve() const { return curve; }
+	
+	/**
+	 * Shapes a single sample.
+	 * @param in - the input sample.
+	 * @returns f(in).
+	**/
+	float process(float in) const
+	{
+		if (curve == HARD_CLIP)
+			return fminf(fmaxf(in, -1.0f), 1.0f);
+		return lookup(in);
+	}
+	
+	/**
+	 * Shapes a block of samples: out[n] = f(in[n] * gain) * volume.
+	 * @param in - the input block.
+	 * @param out - the output block. May point to the same memory as 'in'.
+	 * @param frames - number of samples in the block.
+	 * @param gain - gain applied before the curve.
+	 * @param volume - gain applied after the curve.
+	 * @returns nothing.
+	**/
+	void process(const float* in, float* out, unsigned int frames, float gain = 1, float volume = 1) const;
+	
+private:
+	Curve curve;
+	float input_range;
+	unsigned int table_size;
+	float scale;					// table intervals per input unit
+	ArenaVector<float> table;		// (value, slope to the next point) pairs, table_size + 1 points
+	
+	float lookup(float in) const
+	{
+		float position = fminf(fmaxf((in + input_range) * scale, 0.0f), (float)table_size);
+		unsigned int index = (unsigned int)position;
+		float fraction = position - index;
+		return table[2*index] + fraction * table[2*index + 1];
+	}
+};
+
+/*********************************************************************************************************
+ * This class implements 2x oversampling with a halfband FIR filter, for nonlinear effects whose
+ * harmonics would otherwise alias back below the Nyquist frequency:
+ * upsample() doubles the rate of a block, the effect runs on the 2 * frames samples, and downsample()
+ * filters and decimates them back. Both filters are polyphase, half of the taps of a halfband filter
+ * are zero and the other phase is a pure delay, so a sample costs about 2 * half_taps multiply-adds.
+ * The filter is a Blackman windowed sinc of 4 * half_taps - 1 taps (about -70dB of stopband, flat to
+ * about a third of the sample rate). The latency of the round trip is latency() samples.
+ * delay() runs the same input history without oversampling, and delays the input by latency() samples,
+ * so an effect can switch between the two at runtime (after delay(), prime() rebuilds the history of
+ * the downsampler for the oversampled path to continue without a click).
+ * Blocks hold up to 'max_frames' samples, all the memory is allocated at initialization.
+**********************************************************************************************************/
+
+class Oversampler
+{
+public:
+	static const unsigned int half_taps = 8;	// nonzero taps on each side of the center
+	
+private:
+	static const unsigned int input_history = 4 * half_taps - 2;	// enough for delay() and prime()
+	static const unsigned int output_history = 4 * half_taps - 3;
+	
+	unsigned int max_frames;
+	float coefficients[half_taps];	// interpolation taps of the odd phase, they sum to 1/2
+	ArenaVector<float> inputs;		// input_history previous input samples, then the block
+	ArenaVector<float> outputs;		// output_history previous oversampled samples, then the block
+	
+	// The odd (interpolated) sample between input positions j and j + 1
+	float interpolate(const float* x, unsigned int j) const
+	{
+		float sum = 0;
+		for (unsigned int i = 0; i < half_taps; i++)
+			sum += coefficients[i] * (x[j - i] + x[j + 1 + i]);
+		return sum;
+	}
+	
+	// Moves the last samples of the blocks to the histories.
+	void shift_inputs(unsigned int frames);
+	
+public:
+	/**
+	 * @param max_frames - the largest block upsample(), downsample() and delay() are called with.
+	**/
+	Oversampler(unsigned int max_frames);
+	
+	static constexpr unsigned int latency() { return 2 * half_taps - 1; }
+	
+	/**
+	 * Doubles the sample rate of a block.
+	 * @param in - the input block, 'frames' samples.
+	 * @param out - the oversampled block, 2 * frames samples.
+	 * @param frames - number of input samples, up to max_frames.
+	 * @returns nothing.
+	**/
+	void upsample(const float* in, float* out, unsigned int frames);
+	
+	/**
+	 * Filters and decimates an oversampled block.
+	 * @param in - the oversampled block, 2 * frames samples.
+	 * @param out - the output block, 'frames' samples.
+	 * @param frames - number of output samples, up to max_frames.
+	 * @returns nothing.
+	**/
+	void downsample(const float* in, float* out, unsigned int frames);
+	
+	/**
+	 * Delays a block by latency() samples, instead of upsample() and downsample().
+	 * @param in - the input block.
+	 * @param out - the delayed block. May point to the same memory as 'in'.
+	 * @param frames - number of samples, up to max_frames.
+	 * @returns nothing.
+	**/
+	void delay(const float* in, float* out, unsigned int frames);
+	
+	/**
+	 * Rebuilds the history of the downsampler from the input history, as if the previous blocks had been
+	 * oversampled and processed by 'f'. Call it before the first upsample() that follows delay() calls.
+	 * @param f - the (memoryless) processing of the oversampled samples, a float(float) callable.
+	 * @returns nothing.
+	**/
+	template <typename Function>
+	void prime(Function f)
+	{
+		// The oversampled samples of the last 2 * half_taps - 1 input positions, the newest last
+		for (unsigned int m = 1; m <= 2 * half_taps - 1; m++) {
+			const unsigned int j = input_history - m;				// input m samples ago
+			const unsigned int odd = output_history + 1 - 2 * m;	// its odd sample in the history
+			outputs[odd] = f(interpolate(&inputs[0], j - half_taps));
+			if (odd > 0)
+				outputs[odd - 1] = f(inputs[j - half_taps]);
+		}
+	}
+	
+	// Fills the histories with zeros (does not allocate).
+	void clear();
+};
+
+/*********************************************************************************************************
+ * This class implements a real FFT of a power of two size N (at least 4), used for fast convolution.
+ * A real signal of N samples is transformed as a complex signal of N/2 samples (even samples as the
+ * real part, odd samples as the imaginary part) followed by a split step, which halves the work of a
+ * complex FFT of size N. The spectrum has N/2 + 1 bins (DC to Nyquist), stored as separate real and
+ * imaginary arrays so multiplying spectra is a plain loop the compiler can vectorize.
+ * Twiddles and the bit reversal permutation are computed at initialization, transforms do not allocate.
+ * A transform can also be computed a step at a time (forward_step() and inverse_step(), get_steps() steps
+ * of similar cost: the permutation, one pass of butterflies per power of two, the split), with a work
+ * buffer of the caller, so its cost can be spread over several audio callbacks.
+**********************************************************************************************************/
+
+class RealFFT
+{
+private:
+	unsigned int size;					// N
+	unsigned int passes;				// log2(N/2) passes of butterflies
+	ArenaVector<float> twiddles;		// e^(-2 pi i k / N), k < N/2, interleaved (re, im)
+	ArenaVector<unsigned int> bit_reverse;	// permutation of the N/2 points complex FFT
+	mutable ArenaVector<float> work;	// N/2 complex points, interleaved (forward() and inverse())
+	
+	// One pass of radix-2 butterflies (the 'pass'th, from 1) of the complex FFT of the N/2 points in 'data'
+	// (inverse uses the conjugate twiddles, unscaled).
+	void butterflies(float* data, unsigned int pass, bool inverse) const;
+	
+public:
+	/**
+	 * @param size - number of real samples N, a power of two, at least 4.
+	**/
+	RealFFT(unsigned int size);
+	
+	unsigned int get_size() const { return size; }
+	
+	// Number of steps of a transform with forward_step() or inverse_step().
+	unsigned int get_steps() const { return passes + 2; }
+	
+	/**
+	 * One step of a forward transform, the steps must be called in order from 0 to get_steps() - 1.
+	 * @param in - N real samples, only read by step 0.
+	 * @param re - receives the real parts of the N/2 + 1 bins, written by the last step.
+	 * @param im - receives the imaginary parts of the N/2 + 1 bins, written by the last step.
+	 * @param buffer - N floats, which hold the transform between the steps.
+	 * @param step - the step.
+	 * @returns nothing.
+	**/
+	void forward_step(const float* in, float* re, float* im, float* buffer, unsigned int step) const;
+	
+	/**
+	 * One step of an inverse transform (unscaled), the steps must be called in order from 0 to get_steps() - 1.
+	 * @param re - the real parts of the N/2 + 1 bins, only read by step 0.
+	 * @param im - the imaginary parts of the N/2 + 1 bins, only read by step 0.
+	 * @param out - receives N real samples, written by the last step.
+	 * @param buffer - N floats, which hold the transform between the steps.
+	 * @param step - the step.
+	 * @returns nothing.
+	**/
+	void inverse_step(const float* re, const float* im, float* out, float* buffer, unsigned int step) const;
+	
+	/**
+	 * Forward transform.
+	 * @param in - N real samples.
+	 * @param re - receives the real parts of the N/2 + 1 bins.
+	 * @param im - receives the imaginary parts of the N/2 + 1 bins.
+	 * @returns nothing.
+	**/
+	void forward(const float* in, float* re, float* im) const;
+	
+	/**
+	 * Inverse transform, unscaled: forward() then inverse() multiplies the signal by N.
+	 * @param re - the real parts of the N/2 + 1 bins.
+	 * @param im - the imaginary parts of the N/2 + 1 bins (those of DC and Nyquist are ignored).
+	 * @param out - receives N real samples.
+	 * @returns nothing.
+	**/
+	void inverse(const float* re, const float* im, float* out) const;
+};
+
+/*********************************************************************************************************
+ * 'TripleBuffer' hands complete values (such as a snapshot of an effect's parameters) from one thread
+ * to another without locks: one producer (the gui/control thread) and one consumer (the audio thread).
+ * The producer writes into its own buffer and publishes it, the consumer always reads the latest
+ * published value, and neither of them ever waits for the other (both sides are wait-free).
+ * The third buffer sits in the middle, it is swapped in by the producer and out by the consumer
+ * with a single atomic exchange.
+**********************************************************************************************************/
+
+template <typename T>
+class TripleBuffer
+{
+private:
+	static const unsigned int index_mask = 3;
+	static const unsigned int fresh_flag = 4;	// the middle buffer holds a value the consumer has not read yet
+	
+	T buffers[3];
+	std::atomic<unsigned int> middle;	// index of the middle buffer (and fresh_flag)
+	unsigned int back;					// owned by the producer
+	unsigned int front;					// owned by the consumer
+	
+public:
+	TripleBuffer(const T& initial = T()) : buffers{initial, initial, initial}, middle(1), back(2), front(0) {}
+	
+	/* Producer side: the buffer to fill before calling publish().
+	 * @returns a reference to the producer's buffer.
+	**/
+	T& write_buffer() { return buffers[back]; }
+	
+	/* Producer side: makes the content of write_buffer() the latest value.
+	 * @returns nothing.
+	**/
+	void publish()
+	{
+		back = middle.exchange(back | fresh_flag, std::memory_order_acq_rel) & index_mask;
+	}
+	
+	/* Producer side: copies a value to the producer's buffer and publishes it.
+	 * @param value - the new value.
+	 * @returns nothing.
+	**/
+	void write(const T& value)
+	{
+		buffers[back] = value;
+		publish();
+	}
+	
+	/* Consumer side: picks up the latest published value (if there is a new one).
+	 * The reference stays valid until the next call to read().
+	 * @returns the latest value.
+	**/
+	const T& read()
+	{
+		if (middle.load(std::memory_order_relaxed) & fresh_flag)
+			front = middle.exchange(front, std::memory_order_acq_rel) & index_mask;
+		return buffers[front];
+	}
+};
+
+/*********************************************************************************************************
+ * 'SpscRingBuffer' is a lock-free FIFO between exactly one producer thread and one consumer thread.
+ * Neither side ever blocks: write() stores as many values as there is room for, read() takes as many
+ * as are available, and both return how many they moved.
+ * The capacity is rounded up to a power of two at initialization and cannot be changed.
+**********************************************************************************************************/
+
+template <typename T>
+class SpscRingBuffer
+{
+private:
+	std::vector<T> buffer;
+	size_t mask;
+	std::atomic<size_t> written;	// total number of values written (only modified by the producer)
+	std::atomic<size_t> consumed;	// total number of values read (only modified by the consumer)
+	
+public:
+	SpscRingBuffer(size_t size) : written(0), consumed(0)
+	{
+		size_t capacity = 1;
+		while (capacity < size)
+			capacity <<= 1;
+		buffer.resize(capacity);
+		mask = capacity - 1;
+	}
+	
+	size_t capacity() const { return buffer.size(); }
+	
+	// Consumer side: number of values ready to be read.
+	size_t available() const
+	{
+		return written.load(std::memory_order_acquire) - consumed.load(std::memory_order_relaxed);
+	}
+	
+	// Producer side: number of values that can be written.
+	size_t space() const
+	{
+		return buffer.size() - (written.load(std::memory_order_relaxed) - consumed.load(std::memory_order_acquire));
+	}
+	
+	/* Producer side: appends values.
+	 * @param values - the values to write.
+	 * @param count - number of values.
+	 * @returns the number of values written (less than count if the buffer is full).
+	**/
+	size_t write(const T* values, size_t count)
+	{
+		size_t start = written.load(std::memory_order_relaxed);
+		count = std::min(count, space());
+		for (size_t i = 0; i < count; i++)
+			buffer[(start + i) & mask] = values[i];
+		written.store(start + count, std::memory_order_release);
+		return count;
+	}
+	
+	/* Consumer side: takes the oldest values.
+	 * @param values - destination.
+	 * @param count - number of values wanted.
+	 * @returns the number of values read (less than count if the buffer does not hold enough).
+	**/
+	size_t read(T* values, size_t count)
+	{
+		size_t start = consumed.load(std::memory_order_relaxed);
+		count = std::min(count, available());
+		for (size_t i = 0; i < count; i++)
+			values[i] = buffer[(start + i) & mask];
+		consumed.store(start + count, std::memory_order_release);
+		return count;
+	}
+};
+
+/*********************************************************************************************************
+ * 'AudioFileStream' plays an audio file without loading it in memory.
+ * A background thread keeps the file open (libsndfile), reads it a chunk of interleaved frames at a time
+ * and keeps an SpscRingBuffer of a fixed size ahead of the audio thread, which takes its blocks with read():
+ * no file access, no allocation and no lock inside render(), and the memory used does not depend
+ * on the length of the file. Only the first chunk is read at initialization, so it starts at once.
+ * The reader thread checks the ring every 50 ms and refills it once read() has emptied half of it: read()
+ * does not signal the reader either, so render() makes no system call.
+ * If the reader thread falls behind, read() outputs silence for the missing frames (see get_underruns()).
+ * Host builds (BELA_HOST, see host/Makefile) render faster than realtime, so there read() waits for the
+ * reader thread instead (see set_blocking()).
+**********************************************************************************************************/
+
+class AudioFileStream
+{
+private:
+	std::string path;
+	unsigned int channels;			// channels delivered by read()
+	unsigned int file_channels;
+	unsigned int file_frames;
+	bool loop;
+	unsigned int chunk_frames;
+	
+	SpscRingBuffer<float> ring;		// interleaved frames, written by the reader thread
+	size_t refill_space;			// room in the ring (in samples) from which the reader thread refills it
+	SNDFILE* file;					// open from the constructor to the destructor
+	unsigned int position;			// next frame of the file to read (reader thread)
+	std::vector<float> chunk;		// interleaved chunk read from the file, file_channels per frame (reader thread)
+	std::vector<float> frames_buffer;	// the chunk with 'channels' per frame (reader thread)
+	std::vector<float> read_buffer;	// interleaved frames taken from the ring (audio thread)
+	
+	std::atomic<bool> end_of_file;	// the reader reached the end of a file that does not loop
+	std::atomic<bool> stopping;
+	std::atomic<unsigned int> underruns;
+	bool blocking;
+	std::mutex reader_mutex;
+	std::condition_variable stop_requested;	// notified by the destructor, so the reader does not finish its wait
+	std::thread reader;
+	
+	// Reads up to max_chunks chunks from the file while the ring has room for them,
+	// returns false when a file that does not loop has been read to its end.
+	bool fill(unsigned int max_chunks);
+	void reader_loop();
+	
+public:
+	/**
+	 * @param path - the audio file.
+	 * @param channels - number of channels delivered by read(). Missing channels of the file repeat its last one.
+	 * @param loop - start again from the beginning at the end of the file.
+	 * @param buffer_frames - how many frames are read ahead (the memory used is buffer_frames * channels floats).
+	 * @param chunk_frames - number of frames read from the file at once.
+	**/
+	AudioFileStream(const std::string& path, unsigned int channels = 1, bool loop = true,
+					unsigned int buffer_frames = 32768, unsigned int chunk_frames = 4096);
+	~AudioFileStream();
+	
+	AudioFileStream(const AudioFileStream&) = delete;
+	AudioFileStream& operator=(const AudioFileStream&) = delete;
+	
+	// Whether the file could be opened (when it could not, read() outputs silence).
+	bool is_open() const { return file_frames > 0; }
+	
+	/**
+	 * Takes the next frames of the file (audio thread). Never blocks.
+	 * @param out - one block per channel (planar).
+	 * @param frames - number of frames.
+	 * @returns the number of frames taken from the file, the rest of the blocks is filled with silence.
+	**/
+	unsigned int read(float* const* out, unsigned int frames);
+	
+	// Whether a file that does not loop has been played to its end.
+	bool finished() const { return end_of_file.load() && ring.available() == 0; }
+	
+	// Number of read() calls that found fewer frames than requested before the end of the file.
+	unsigned int get_underruns() const { return underruns.load(); }
+	
+	// Makes read() wait for the reader thread when it falls behind. Only for offline rendering,
+	// never on the audio thread of the board.
+	void set_blocking(bool wait) { blocking = wait; }
+	
+	unsigned int get_file_frames() const { return file_frames; }
+};
+
+/*********************************************************************************************************
+ * 'ControlParameter' holds a parameter that is read at control rate (once per block from the sliders or
+ * the published parameters, once per analog frame from analogRead) and follows it with a one-pole
+ * lowpass, so the steps of a slider or of a potentiometer do not click (zipper noise). The value is held
+ * between two reads.
+ * Once the value gets close enough to the target it snaps to it and stops changing, so coefficients derived
+ * from it (such as the reverb comb gains) only need to be recomputed when get() changes.
+**********************************************************************************************************/
+
+class ControlParameter
+{
+private:
+	float target;
+	float value;
+	float smoothing_samples;	// time constant of the smoothing, in samples
+	unsigned int step_frames;	// frames of the last update, 'step' is cached for it
+	float step;					// fraction of the distance to the target covered in step_frames frames
+	bool primed;				// false until the first set() after initialization or reset()
+	
+public:
+	/**
+	 * @param sample_rate - the audio sample rate.
+	 * @param time_ms - time constant of the smoothing (0 follows the reads immediately).
+	**/
+	ControlParameter(float sample_rate, float time_ms) :
+			target(0), value(0), smoothing_samples(time_ms * sample_rate / 1000), step_frames(0), step(1), primed(false)
+	{}
+	
+	/**
+	 * Sets the value to follow (a new read of the slider or of the analog input).
+	 * The first read after initialization or reset() is taken immediately.
+	 * @param new_target - the value read.
+	 * @returns nothing.
+	**/
+	void set(float new_target)
+	{
+		target = new_target;
+		if (!primed) {
+			value = target;
+			primed = true;
+		}
+	}
+	
+	/**
+	 * Moves the value toward the target.
+	 * @param frames - number of samples since the previous update.
+	 * @returns the new value.
+	**/
+	float update(unsigned int frames)
+	{
+		if (value == target)
+			return value;
+		if (frames != step_frames) {
+			step_frames = frames;
+			step = smoothing_samples > 0 ? 1 - exp(-(float)frames / smoothing_samples) : 1;
+		}
+		value += step * (target - value);
+		if (std::fabs(target - value) <= 1e-4f * std::fabs(target) + 1e-6f)
+			value = target;
+		return value;
+	}
+	
+	float get() const { return value; }
+	
+	// The next read is taken immediately, without smoothing.
+	void reset() { primed = false; }
+};
+
+/*********************************************************************************************************
+ * 'Effects' is an abstract class that defines the basic common structure of
+ * all audio effects according to how we implemented them on Bela.
+ * It is possible to add members and methods which may be relevant for multiple effects.
+ * In addition, we have implemented three audio effects in this file: distortion, wah-wah and reverb.
+ * Note: One must initialize a gui controller and give it as a reference to the classes' constructors and
+ * methods. Sliders are initialized by the classes' constructors.
+ * Channels: the process methods work on a single channel (channel 0). An effect constructed with
+ * several channels also processes all of them at once with process_channels(), with its own state
+ * (delay lines, filters history) for every channel and the same parameters for all of them.
+ * Parameters: every effect keeps its parameters in a 'Parameters' snapshot. A control thread (a Bela
+ * auxiliary task, or any other source such as OSC or MIDI) publishes new snapshots with publish(),
+ * and the audio thread picks up the latest one once per block, without locks, when the process
+ * methods are called without a controller. Passing a controller reads the sliders directly instead.
+ * An effect constructed without a controller has no sliders: it starts with the defaults of its
+ * 'Parameters' and only follows publish(Parameters) (a preset, see PresetBank).
+**********************************************************************************************************/
+
+class Effects
+{
+protected:
+	float sample_rate;
+	unsigned int audio_frames_per_analog_frame;
+	unsigned int audio_frames;		// number of frames in a block (context->audioFrames)
+	unsigned int channels;			// number of channels process_channels() works on
+	bool has_sliders;				// false when the effect was constructed without a controller
+	unsigned int quality;			// current quality tier, see set_quality()
+	
+public:
+	Effects(BelaContext *context, unsigned int channels = 1);
+	virtual ~Effects() = default;
+	
+	/**
+	 * Every effect inherits from this class must override the process method.
+	 * Normally, it should be called once for every sample.
+	 * @param in - An input sample to be processed.
+	 * @param controller - the gui controller defined for the project.
+	 * @returns the processed output sample.
+	**/
+	virtual float process(float in, GuiController* controller = nullptr) = 0;
+	
+	/**
+	 * Processes a whole block of samples with a single call.
+	 * The effect's parameters are read once per block rather than once per sample,
+	 * so this is the preferred entry point inside render().
+	 * The default implementation simply calls process() for every sample,
+	 * effects override it with a dedicated inner loop.
+	 * @param in - the input block.
+	 * @param out - the output block. May point to the same memory as 'in'.
+	 * @param frames - number of samples in the block (normally context->audioFrames).
+	 * @param controller - the gui controller defined for the project, or nullptr to use
+	 *                     the latest parameters published with publish().
+	 * @returns nothing.
+	**/
+	virtual void process_block(const float* in, float* out, unsigned int frames, GuiController* controller = nullptr);
+	
+	/**
+	 * Processes a block of every channel of the effect with a single call (planar buffers, one per channel).
+	 * Parameters are read once for all the channels. Channel 0 shares its state with process_block().
+	 * The default implementation calls process_block() for every channel, which is only correct for
+	 * effects without state (effects with state override it).
+	 * @param in - the input blocks, one per channel.
+	 * @param out - the output blocks, one per channel. out[c] may point to the same memory as in[c].
+	 * @param frames - number of samples in each block.
+	 * @param controller - the gui controller defined for the project, or nullptr to use
+	 *                     the latest parameters published with publish().
+	 * @returns nothing.
+	**/
+	virtual void process_channels(const float* const* in, float* const* out, unsigned int frames, GuiController* controller = nullptr);
+	
+	unsigned int get_channels() const { return channels; }
+	
+	/**
+	 * Reads the effect's sliders and publishes them as the effect's new parameters.
+	 * Meant to be called from a control thread (such as a Bela auxiliary task), it never blocks
+	 * the audio thread. Only one thread may publish the parameters of an effect.
+	 * @param controller - the gui controller defined for the project.
+	 * @returns nothing.
+	**/
+	virtual void publish(GuiController* controller) {}
+	
+	/**
+	 * Clears the effect's internal state (delay lines, filters history, modulation),
+	 * so it behaves as if it had just been constructed. Sliders are not affected.
+	 * Does not allocate memory.
+	 * @returns nothing.
+	**/
+	virtual void reset() {}
+	
+	/**
+	 * Advances the effect's free running modulation (such as the wah-wah sweep) without processing audio,
+	 * so that processing can start in the middle of a track with the same modulation phase.
+	 * Delay lines and filters are not affected, feed them a warm-up of the preceding audio instead.
+	 * @param frames - number of frames to skip.
+	 * @param controller - the gui controller defined for the project.
+	 * @returns nothing.
+	**/
+	virtual void advance(unsigned int frames, GuiController* controller = nullptr) {}
+	
+	/**
+	 * Number of quality tiers the effect can run at. Tier 0 is the best sounding (and most expensive)
+	 * one, every following tier is cheaper. Effects with a single tier always run at their best.
+	 * @returns the number of tiers, at least 1.
+	**/
+	virtual unsigned int get_quality_tiers() const { return 1; }
+	
+	/**
+	 * Changes the quality tier, so a LoadGovernor can trade sound quality for CPU time at runtime.
+	 * Audio thread only, between two blocks: it does not allocate memory, and the effect keeps its
+	 * state (delay lines, filters) so the sound continues across the change.
+	 * @param tier - 0 (best) to get_quality_tiers() - 1 (cheapest), larger values select the cheapest tier.
+	 * @returns nothing.
+	**/
+	virtual void set_quality(unsigned int tier) {}
+	unsigned int get_quality() const { return quality; }
+};
+
+
+class Distortion : public Effects
+{
+public:
+	struct Parameters
+	{
+		float volume = 1;
+		float gain = 1;
+		bool is_overdrive = false;
+	};
+	
+private:
+
+	// Members to hold gui sliders indexes
+	unsigned int gain_slider_index;
+	unsigned int volume_slider_index;
+	unsigned int type_slider_index;
+	
+	Waveshaper clipper;			// distortion mode
+	Waveshaper overdrive;		// overdrive mode
+	const Waveshaper* shaper_in_use;		// curve of the last block (clipper or overdrive)
+	
+	unsigned int oversampling;				// 1, or 2 when quality tier 0 is oversampled
+	ArenaVector<Oversampler> oversamplers;	// one per channel when oversampling
+	ArenaVector<float> oversampled_block;	// 2 * audio_frames samples, allocated once at initialization
+	
+	TripleBuffer<Parameters> parameters;	// published by the control thread, read by the audio thread
+	ControlParameter smoothed_volume;		// the parameters as processed, following the reads
+	ControlParameter smoothed_gain;
+	
+	// Reads the parameters from the sliders.
+	Parameters read_sliders(GuiController* controller) const;
+	// The parameters to process with: the sliders when there is a controller (and the effect has sliders),
+	// the latest snapshot otherwise.
+	Parameters current_parameters(GuiController* controller)
+	{
+		return controller && has_sliders ? read_sliders(controller) : parameters.read();
+	}
+	
+	// Shapes a block of a channel, oversampled or not depending on the quality tier.
+	void shape_block(unsigned int channel, const Waveshaper& shaper, const float* in, float* out, unsigned int frames,
+					 float gain, float volume);
+
+public:
+	/**
+	 * @param context - the Bela context of the project.
+	 * @param controller - the gui controller defined for the project, or nullptr for an effect without sliders
+	 *                     (its parameters are the defaults until publish(Parameters) is called).
+	 * @param overdrive_curve - curve of the overdrive mode (exponential soft clipping by default).
+	 * @param custom_curve - the function to use when overdrive_curve is Waveshaper::CUSTOM.
+	 * @param channels - number of channels for process_channels().
+	 * @param oversampling - 1, or 2 to shape the signal at twice the sample rate (less aliasing of the
+	 *                       harmonics, about 4 times the cost and Oversampler::latency() samples of latency).
+	 *                       Quality tier 1 then shapes at the sample rate, with the same latency.
+	**/
+	Distortion(BelaContext *context, GuiController* controller,
+			   Waveshaper::Curve overdrive_curve = Waveshaper::EXPONENTIAL_SOFT_CLIP, float (*custom_curve)(float) = nullptr,
+			   unsigned int channels = 1, unsigned int oversampling = 1);
+	float process(float in, GuiController* controller) override;
+	void process_block(const float* in, float* out, unsigned int frames, GuiController* controller) override;
+	void process_channels(const float* const* in, float* const* out, unsigned int frames, GuiController* controller) override;
+	// Takes the next reads of the parameters without smoothing.
+	void reset() override;
+	void publish(GuiController* controller) override;
+	unsigned int get_quality_tiers() const override { return oversampling == 2 ? 2 : 1; }
+	void set_quality(unsigned int tier) override;
+	// Publishes parameters that do not come from the sliders (control thread only, see publish(controller)).
+	void publish(const Parameters& new_parameters) { parameters.write(new_parameters); }
+	/**
+	 * This function is equivalent to the 'regular' process function.
+	 * The only difference is that the effect's parameters are controlled
+	 * by potentiometers connected to the bella rather than through the IDE gui controller.
+	 * The potentiometers are read once per analog frame, their values are held and smoothed in between.
+	 * The distortion effect needs two potentiometers connected to 'analog in' channels 0 and 1.
+	 * Channel 0 is mapped to the volume parameter.
+	 * Channel 1 is mapped to the gain parameter.
+	 * @param in - An input sample to be processed.
+	 * @param index - index of the relevant sample in the current frame.
+	 * @param context - the Bela context of the project.
+	 * @returns the processed output sample.
+	**/
+	float process_hardware(float in, unsigned int index, BelaContext* context);
+};
+
+
+class WahWah : public Effects
+{
+public:
+	/**
+	 * How the band-pass coefficients follow the sweep:
+	 * PER_SAMPLE - the Biquad is redesigned (with trig functions) for every sample.
+	 * CONTROL_RATE - the coefficients are designed every 'control_period' samples and linearly
+	 *                interpolated in between, so the sweep stays smooth at a fraction of the cost.
+	 *                Interpolating between two stable designs always gives a stable filter.
+	 * TABLE - same as CONTROL_RATE, but the only trig function of the design, tan(pi * fc / fs),
+	 *         is read from a table precomputed at initialization (Q only costs a division).
+	**/
+	enum CoefficientMode
+	{
+		PER_SAMPLE,
+		CONTROL_RATE,
+		TABLE
+	};
+	
+	struct Parameters
+	{
+		float q = 2.5;
+		float movement_rate = 2000;	// Hz per second
+		float minf = 500;
+		float maxf = 5000;
+		float mix_percent = 0;
+	};
+	
+private:
+	ArenaVector<Biquad> bpFilters;	// Biquad band-pass of every channel (PER_SAMPLE mode)
+	double fc;			// Main frequency of the bandpass filter
+	bool direction;		// direction of "movement" of the bandpass filter
+	
+	// Members to hold gui sliders indexes
+	unsigned int q_slider_index;
+	unsigned int movement_rate_slider_index;
+	unsigned int minf_slider_index;
+	unsigned int maxf_slider_index;
+	unsigned int dry_wet_slider_index;
+	
+	TripleBuffer<Parameters> parameters;	// published by the control thread, read by the audio thread
+	
+	// Reads the parameters from the sliders.
+	Parameters read_sliders(GuiController* controller) const;
+	// The parameters to process with: the sliders when there is a controller (and the effect has sliders),
+	// the latest snapshot otherwise.
+	Parameters current_parameters(GuiController* controller)
+	{
+		return controller && has_sliders ? read_sliders(controller) : parameters.read();
+	}
+	
+	// Band-pass coefficients of the CONTROL_RATE and TABLE modes (b1 is always 0 and b2 is -b0)
+	struct BandpassCoefficients
+	{
+		float b0;
+		float a1;
+		float a2;
+	};
+	
+	CoefficientMode coefficient_mode;
+	unsigned int control_period;
+	unsigned int base_control_period;			// control period of quality tier 0
+	unsigned int control_counter;				// samples left until the next design
+	bool coefficients_valid;					// false until the first design after initialization/reset
+	BandpassCoefficients coefficients;			// current (interpolated) coefficients
+	BandpassCoefficients coefficients_step;		// added to the coefficients every sample
+	// Filter state (transposed direct form II) of every channel: channel c is lane c % 4 of vector c / 4,
+	// so up to 4 channels are filtered by a single SIMD operation.
+	ArenaVector<float4> z1, z2;
+	ArenaVector<float> tan_table;				// tan(pi * fc / fs), TABLE mode
+	float tan_table_scale;						// table entries per Hz
+	
+	// Moves the sweep one sample forward, returns the frequency to use for the current sample.
+	double next_fc(double delta, double minf, double maxf);
+	// Designs the band-pass coefficients for a center frequency and 1/Q.
+	BandpassCoefficients design(double fc_wave, float inv_q) const;
+	// Moves the interpolated coefficients one sample forward (CONTROL_RATE and TABLE modes), returns them.
+	const BandpassCoefficients& next_coefficients(double fc_wave, float inv_q)
+	{
+		if (!coefficients_valid) {
+			// First sample after initialization/reset: start from the exact design
+			coefficients = design(fc_wave, inv_q);
+			coefficients_step = {0, 0, 0};
+			coefficients_valid = true;
+		}
+		if (control_counter == 0) {
+			// Ramp from the current coefficients to the design of the frequency the sweep reaches
+			// at the last sample of the period ('fc' is already one sample ahead of 'fc_wave'),
+			// so the interpolated coefficients follow the sweep without lagging behind it.
+			BandpassCoefficients target = design(fc_wave + (control_period - 1) * (fc - fc_wave), inv_q);
+			coefficients_step.b0 = (target.b0 - coefficients.b0) / control_period;
+			coefficients_step.a1 = (target.a1 - coefficients.a1) / control_period;
+			coefficients_step.a2 = (target.a2 - coefficients.a2) / control_period;
+			control_counter = control_period;
+		}
+		control_counter--;
+		coefficients.b0 += coefficients_step.b0;
+		coefficients.a1 += coefficients_step.a1;
+		coefficients.a2 += coefficients_step.a2;
+		return coefficients;
+	}
+	// Filters one sample of a single channel in the CONTROL_RATE and TABLE modes, s1/s2 hold its state.
+	float filter_sample(float in, double fc_wave, float inv_q, float& s1, float& s2)
+	{
+		const BandpassCoefficients& c = next_coefficients(fc_wave, inv_q);
+		in = DenormalGuard::bias(in);
+		float out = c.b0 * in + s1;
+		s1 = s2 - c.a1 * out;
+		s2 = -c.b0 * in - c.a2 * out;
+		return out;
+	}
+	
+public:
+	/**
+	 * @param context - the Bela context of the project.
+	 * @param controller - the gui controller defined for the project, or nullptr for an effect without sliders
+	 *                     (its parameters are the defaults until publish(Parameters) is called).
+	 * @param coefficient_mode - how the band-pass coefficients follow the sweep (see CoefficientMode).
+	 * @param control_period - samples between two designs in the CONTROL_RATE and TABLE modes.
+	 * @param channels - number of channels for process_channels(), all of them follow the same sweep.
+	**/
+	WahWah(BelaContext *context, GuiController* controller, CoefficientMode coefficient_mode = CONTROL_RATE,
+		   unsigned int control_period = 16, unsigned int channels = 1);
+	float process(float in, GuiController* controller) override;
+	void process_block(const float* in, float* out, unsigned int frames, GuiController* controller) override;
+	void process_channels(const float* const* in, float* const* out, unsigned int frames, GuiController* controller) override;
+	void reset() override;
+	void advance(unsigned int frames, GuiController* controller) override;
+	void publish(GuiController* controller) override;
+	// Publishes parameters that do not come from the sliders (control thread only, see publish(controller)).
+	void publish(const Parameters& new_parameters) { parameters.write(new_parameters); }
+	
+	/**
+	 * Changes the number of samples between two designs (CONTROL_RATE and TABLE modes).
+	 * Takes effect at the next design, does not allocate.
+	 * @param period - number of samples, at least 1.
+	 * @returns nothing.
+	**/
+	void set_control_period(unsigned int period);
+	
+	// CONTROL_RATE and TABLE modes: tiers 0, 1 and 2 design the coefficients every 1, 2 and 4 times
+	// the control period given at initialization. PER_SAMPLE has a single tier.
+	unsigned int get_quality_tiers() const override { return coefficient_mode == PER_SAMPLE ? 1 : 3; }
+	void set_quality(unsigned int tier) override;
+};
+
+
+class Reverb : public Effects
+{
+public:
+	struct Parameters
+	{
+		float reverb_time = 1000;		// ms
+		float mix_percent = 0;
+	};
+	
+private:
+	// The delay lines of one channel
+	struct ChannelState
+	{
+		// The parallel combs: the classic 4 combs, or 8 combs for a denser tail (see max_comb_count),
+		// which also run the classic 4 only at quality tier 1
+		CombFilterBank<4> combs;
+		CombFilterBank<8> dense_combs;
+		
+		// Each allpass delay line is sized to its own delay plus one block, see Reverb::Reverb
+		MirroredRingBuffer<float> apf1_in;		// average of the combs
+		MirroredRingBuffer<float> apf1_out;		// also apf2 in..
+		MirroredRingBuffer<float> apf2_out;
+		
+		ChannelState(const std::array<unsigned int, 8>& comb_delays, bool dense, unsigned int apf1_size, unsigned int apf2_size);
+	};
+	
+	ArenaVector<ChannelState> channel_states;	// one per channel
+	unsigned int comb_count;					// number of combs running, see set_quality()
+	unsigned int max_comb_count;				// number of combs at the best quality
+	
+	// Members to hold the delay of each allpass filter (in units of samples)
+	unsigned int apf1_delay;
+	unsigned int apf2_delay;
+
+	// Members to hold gui sliders indexes
+	unsigned int reverb_time_slider_index;
+	unsigned int mix_slider_index;
+	
+	TripleBuffer<Parameters> parameters;	// published by the control thread, read by the audio thread
+	
+	// Reads the parameters from the sliders.
+	Parameters read_sliders(GuiController* controller) const;
+	// The parameters to process with: the sliders when there is a controller (and the effect has sliders),
+	// the latest snapshot otherwise.
+	Parameters current_parameters(GuiController* controller)
+	{
+		return controller && has_sliders ? read_sliders(controller) : parameters.read();
+	}
+	
+	ArenaVector<float> block_scratch;	// intermediate block results, allocated once at initialization
+	
+	ControlParameter smoothed_reverb_time;	// the parameters as processed, following the reads
+	ControlParameter smoothed_mix;
+	float applied_reverb_time;				// reverb time of the current comb gains
+	unsigned int control_counter;			// samples of process() left until the next read of the parameters
+	
+	// Computes the combs feedback gains of a given reverb time (only when it differs from the current one).
+	void set_reverb_time(float reverb_time);
+	// Follows a read of the parameters for 'frames' samples, updates the comb gains, returns the mix to use.
+	float update_controls(const Parameters& p, unsigned int frames);
+	// Runs the combs and allpasses of a channel for a single sample, shared by all the process methods.
+	float process_sample(ChannelState& state, float in, float mix_percent);
+	// Runs the combs and allpasses of a channel for a whole block using contiguous delay line windows.
+	// Requires frames <= audio_frames and frames <= apf2_delay + 1.
+	void process_block_windowed(ChannelState& state, const float* in, float* out, unsigned int frames, float mix_percent);
+	// Runs a block of a channel with the windowed path, in pieces short enough for it.
+	void process_channel_block(ChannelState& state, const float* in, float* out, unsigned int frames, float mix_percent);
+	
+public:
+	/**
+	 * @param context - the Bela context of the project.
+	 * @param controller - the gui controller defined for the project, or nullptr for an effect without sliders
+	 *                     (its parameters are the defaults until publish(Parameters) is called).
+	 * @param comb_count - number of parallel combs, 4 (classic Schroeder) or 8 (denser tail, higher cost).
+	 *                     With 8 combs, quality tier 1 runs the 4 classic combs only.
+	 * @param channels - number of channels for process_channels(), each with its own delay lines.
+	**/
+	Reverb(BelaContext *context, GuiController* controller, unsigned int comb_count = 4, unsigned int channels = 1);
+	float process(float in, GuiController* controller) override;
+	void process_block(const float* in, float* out, unsigned int frames, GuiController* controller) override;
+	void process_channels(const float* const* in, float* const* out, unsigned int frames, GuiController* controller) override;
+	void reset() override;
+	void publish(GuiController* controller) override;
+	unsigned int get_quality_tiers() const override { return max_comb_count == 8 ? 2 : 1; }
+	// The classic combs continue from their tail (see CombFilterBank::set_active_combs).
+	void set_quality(unsigned int tier) override;
+	// Publishes parameters that do not come from the sliders (control thread only, see publish(controller)).
+	void publish(const Parameters& new_parameters) { parameters.write(new_parameters); }
+	/**
+	 * This function is equivalent to the 'regular' process function.
 	 * The only difference is that the effect's parameters are controlled
 	 * by potentiometers connected to the bella rather than through the IDE gui controller.
-	 * The distortion effect needs two potentiometers connected to 'analog in' channels 0 and 1.
-	 * Channel 0 is mapped to the volume parameter.
-	 * Channel 1 is mapped to the gain parameter.
+	 * The potentiometers are read once per analog frame, their values are held and smoothed in between.
+	 * The reverb effect needs two potentiometers connected to 'analog in' channels 0 and 1.
+	 * Channel 0 is mapped to the 'reverb time' parameter.
+	 * Channel 1 is mapped to the 'mix percent' parameter.
 	 * @param in - An input sample to be processed.
 	 * @param index - index of the relevant sample in the current frame.
 	 * @param context - the Bela context of the project.
@@ -151,64 +1885,789 @@ public:
 };
 
 
-class WahWah : public Effects
+/*********************************************************************************************************
+ * 'ConvolutionReverb' convolves the input with a measured (or designed) impulse response, which may be
+ * several seconds long, with non-uniformly partitioned overlap-save FFT convolution:
+ * - The first 'head_size' taps are applied directly (a short FIR), so the effect adds no latency and
+ *   can be called with any block size, or sample by sample.
+ * - The rest of the response is split into stages of uniform partitions whose size grows 4 times from
+ *   one stage to the next (up to max_partition). A stage with partitions of P samples transforms the
+ *   last 2P input samples every P samples, multiplies and accumulates the spectra of its past inputs
+ *   with the precomputed spectra of its partitions (a frequency domain delay line), and adds the
+ *   result to an output accumulator.
+ * - The work of a partition is spread evenly over the head_size periods of the next P samples: the steps
+ *   of the transforms (see RealFFT::forward_step()) and the products of one partition each are run a few
+ *   at a time, so every callback does about the same share of it (instead of all of it in the callback that
+ *   completes a large partition). The stages after the first one start at least 2P taps into the response,
+ *   so the output is still computed before it is played and the spreading adds no latency.
+ * The spectra of the response are computed at initialization, and all the memory is allocated there.
+**********************************************************************************************************/
+
+class ConvolutionReverb : public Effects
 {
+public:
+	struct Parameters
+	{
+		float mix_percent = 0.5;
+	};
+	
 private:
-	Biquad bpFilter;	// Biquad band-pass
-	double fc;			// Main frequency of the bandpass filter
-	bool direction;		// direction of "movement" of the bandpass filter
+	// A set of uniform partitions of the response, see above
+	struct Stage
+	{
+		unsigned int partition;			// P, the FFT size is 2P
+		unsigned int offset;			// first tap of the response covered by the stage
+		unsigned int count;				// number of partitions
+		unsigned int ticks;				// number of head_size periods the work of a partition is spread over
+		unsigned int steps;				// forward transform steps, 'count' products, inverse transform steps
+		RealFFT fft;
+		ArenaVector<float> spectra_re;	// count spectra of P + 1 bins, scaled by 1 / 2P
+		ArenaVector<float> spectra_im;
+		
+		Stage(unsigned int partition, unsigned int offset, unsigned int count, unsigned int head_size);
+	};
 	
-	// Members to hold gui sliders indexes
-	unsigned int q_slider_index;
-	unsigned int movement_rate_slider_index;
-	unsigned int minf_slider_index;
-	unsigned int maxf_slider_index;
-	unsigned int dry_wet_slider_index;
+	// State of one channel
+	struct ChannelState
+	{
+		MirroredRingBuffer<float> history;			// last input samples, at least 2 * max_partition
+		ArenaVector<ArenaVector<float>> fdl_re;	// per stage: spectra of the last 'count' input frames
+		ArenaVector<ArenaVector<float>> fdl_im;
+		ArenaVector<unsigned int> fdl_position;	// per stage: slot of the newest spectrum
+		ArenaVector<ArenaVector<float>> work;		// per stage: the transform in progress (2P)
+		ArenaVector<ArenaVector<float>> sum_re;	// per stage: sum of the products of the partition in progress
+		ArenaVector<ArenaVector<float>> sum_im;
+		ArenaVector<unsigned int> progress;		// per stage: steps done for the partition in progress
+		ArenaVector<float> accumulator;			// future output of the stages, indexed by time
+		unsigned int time;							// number of samples processed (wraps)
+		
+		ChannelState(unsigned int history_size, unsigned int accumulator_size);
+	};
+	
+	unsigned int head_size;
+	ArenaVector<float> head;				// first head_size taps, reversed (convolution as a dot product)
+	ArenaVector<Stage> stages;
+	ArenaVector<ChannelState> channel_states;
+	unsigned int accumulator_mask;
+	
+	// Scratch of the stage computations, shared by the channels
+	ArenaVector<float> frame_out;
+	ArenaVector<float> wet_scratch;
+	
+	unsigned int mix_slider_index;
+	TripleBuffer<Parameters> parameters;	// published by the control thread, read by the audio thread
+	
+	// Reads the parameters from the sliders.
+	Parameters read_sliders(GuiController* controller) const;
+	// The parameters to process with: the sliders when there is a controller (and the effect has sliders),
+	// the latest snapshot otherwise.
+	Parameters current_parameters(GuiController* controller)
+	{
+		return controller && has_sliders ? read_sliders(controller) : parameters.read();
+	}
+	
+	// Runs one step of the work of a stage on its last complete partition.
+	void run_step(ChannelState& state, unsigned int stage_index, unsigned int step);
+	// Runs the share of the work of a stage that is due at the current time (a multiple of head_size).
+	void advance_stage(ChannelState& state, unsigned int stage_index);
+	// Convolves a block of a channel (wet signal only).
+	void convolve(ChannelState& state, const float* in, float* wet, unsigned int frames);
 	
 public:
-	WahWah(BelaContext *context, GuiController* controller);
+	/**
+	 * @param context - the Bela context of the project.
+	 * @param controller - the gui controller defined for the project, or nullptr for an effect without sliders
+	 *                     (its parameters are the defaults until publish(Parameters) is called).
+	 * @param impulse_response - the impulse response, at the sample rate of the project.
+	 * @param channels - number of channels for process_channels(), all of them use the same response.
+	 * @param head_size - number of taps applied directly (a power of two).
+	 * @param max_partition - largest partition size (a power of two, at least head_size).
+	**/
+	ConvolutionReverb(BelaContext *context, GuiController* controller, const std::vector<float>& impulse_response,
+					  unsigned int channels = 1, unsigned int head_size = 64, unsigned int max_partition = 4096);
+	
+	/**
+	 * Same as above, with the impulse response read from the first channel of an audio file.
+	 * @param impulse_response_path - the audio file.
+	**/
+	ConvolutionReverb(BelaContext *context, GuiController* controller, const std::string& impulse_response_path,
+					  unsigned int channels = 1, unsigned int head_size = 64, unsigned int max_partition = 4096);
+	
 	float process(float in, GuiController* controller) override;
+	void process_block(const float* in, float* out, unsigned int frames, GuiController* controller) override;
+	void process_channels(const float* const* in, float* const* out, unsigned int frames, GuiController* controller) override;
+	void reset() override;
+	void publish(GuiController* controller) override;
+	// Publishes parameters that do not come from the sliders (control thread only, see publish(controller)).
+	void publish(const Parameters& new_parameters) { parameters.write(new_parameters); }
 };
 
 
-class Reverb : public Effects
+/*********************************************************************************************************
+ * 'FdnReverb' is a feedback delay network reverb: N delay lines (4, 8, 16 or 32, a power of two) whose
+ * outputs are lowpass filtered (damping), mixed by a normalized Hadamard matrix and fed back into the lines
+ * with the gains that give the reverb time. Every echo is spread to all the lines at the next pass, so the
+ * echo density grows much faster than with parallel combs, for a few operations per line and sample:
+ * - The delay lines are stored as a structure of arrays, like CombFilterBank: the samples of all the
+ *   lines at a given time are next to each other, so damping, feedback and writes handle 4 lines per
+ *   SIMD operation (float4).
+ * - The Hadamard matrix is applied with the fast Walsh-Hadamard transform (N log2 N additions): the
+ *   butterflies inside a float4 are lane shuffles, the ones between float4s are vector additions.
+ * The line count and the delay lengths are set at construction: more lines give a denser, smoother tail
+ * at a cost that grows with it (see the fdn cases of host/tools/benchmark).
+**********************************************************************************************************/
+
+class FdnReverb : public Effects
 {
+public:
+	struct Parameters
+	{
+		float reverb_time = 2000;	// ms
+		float damping = 0.3;		// 0 (bright) to 1 (dark)
+		float mix_percent = 0;
+	};
+	
 private:
-	RingBuffer<float> cf1;
-	RingBuffer<float> cf2;
-	RingBuffer<float> cf3;
-	RingBuffer<float> cf4;
-	RingBuffer<float> apf1_in;		// sum of cf 1-4
-	RingBuffer<float> apf1_out;		// also apf2 in..
-	RingBuffer<float> apf2_out;
+	// The delay lines of one channel
+	struct ChannelState
+	{
+		ArenaVector<float4> lines;		// capacity * vectors float4 (max_line_count lines), the lines of time t at [t * vectors]
+		ArenaVector<float4> lowpass;	// damping filter state of every line
+		unsigned int wr_ptr;
+		
+		ChannelState(unsigned int capacity, unsigned int vectors);
+	};
+	
+	unsigned int max_line_count;			// lines at quality tier 0
+	unsigned int line_count;				// lines running, see set_quality()
+	unsigned int vectors;					// line_count / 4
+	ArenaVector<unsigned int> all_delays;	// delay of every line, in samples
+	ArenaVector<unsigned int> delays;		// delay of every line running
+	unsigned int capacity;					// samples of every line, a power of two
+	unsigned int mask;
+	ArenaVector<float4> feedback_gains;		// decay gain of every line, times the matrix normalization
+	float4 damping;							// the same damping for all the lines
+	ArenaVector<ChannelState> channel_states;
 	
-	// Members to hold the delay of each filter (in units of samples)
-	unsigned int cf1_delay;
-	unsigned int cf2_delay;
-	unsigned int cf3_delay;
-	unsigned int cf4_delay;
-	unsigned int apf1_delay;
-	unsigned int apf2_delay;
-
 	// Members to hold gui sliders indexes
 	unsigned int reverb_time_slider_index;
+	unsigned int damping_slider_index;
 	unsigned int mix_slider_index;
 	
+	TripleBuffer<Parameters> parameters;	// published by the control thread, read by the audio thread
+	ControlParameter smoothed_reverb_time;	// the parameters as processed, following the reads
+	ControlParameter smoothed_damping;
+	ControlParameter smoothed_mix;
+	float applied_reverb_time;				// reverb time of the current feedback gains
+	unsigned int control_counter;			// samples of process() left until the next read of the parameters
+	
+	// Reads the parameters from the sliders.
+	Parameters read_sliders(GuiController* controller) const;
+	// The parameters to process with: the sliders when there is a controller (and the effect has sliders),
+	// the latest snapshot otherwise.
+	Parameters current_parameters(GuiController* controller)
+	{
+		return controller && has_sliders ? read_sliders(controller) : parameters.read();
+	}
+	
+	// Computes the feedback gains of a given reverb time (only when it differs from the current one).
+	void set_reverb_time(float reverb_time);
+	// Follows a read of the parameters for 'frames' samples, updates the gains, returns the mix to use.
+	float update_controls(const Parameters& p, unsigned int frames);
+	// Runs the network of a channel over a block, with the number of float4 known at compile time.
+	template <unsigned int Vectors>
+	void process_network(ChannelState& state, const float* in, float* out, unsigned int frames, float mix_percent);
+	// Dispatches to process_network() for the line count of the reverb.
+	void process_channel_block(ChannelState& state, const float* in, float* out, unsigned int frames, float mix_percent);
+	
 public:
-	Reverb(BelaContext *context, GuiController* controller);
+	/**
+	 * @param context - the Bela context of the project.
+	 * @param controller - the gui controller defined for the project, or nullptr for an effect without sliders
+	 *                     (its parameters are the defaults until publish(Parameters) is called).
+	 * @param line_count - number of delay lines: 4, 8, 16 or 32.
+	 *                     With 8 lines or more, quality tier 1 runs the even lines only (half of them).
+	 * @param delays_ms - delay of every line (line_count values), or empty for lengths spread between
+	 *                    23 and 61 ms (rounded to prime numbers of samples, so the echoes do not pile up).
+	 * @param channels - number of channels for process_channels(), each with its own network.
+	**/
+	FdnReverb(BelaContext *context, GuiController* controller, unsigned int line_count = 8,
+			  const std::vector<float>& delays_ms = std::vector<float>(), unsigned int channels = 1);
 	float process(float in, GuiController* controller) override;
+	void process_block(const float* in, float* out, unsigned int frames, GuiController* controller) override;
+	void process_channels(const float* const* in, float* const* out, unsigned int frames, GuiController* controller) override;
+	void reset() override;
+	void publish(GuiController* controller) override;
+	// Publishes parameters that do not come from the sliders (control thread only, see publish(controller)).
+	void publish(const Parameters& new_parameters) { parameters.write(new_parameters); }
+	
+	unsigned int get_quality_tiers() const override { return max_line_count >= 8 ? 2 : 1; }
+	// The lines kept continue from their tail, the odd lines start empty when they come back.
+	void set_quality(unsigned int tier) override;
+	
+	// Number of lines running (the constructor's line_count, or half of it at tier 1).
+	unsigned int get_line_count() const { return line_count; }
+};
+
+
+/*********************************************************************************************************
+ * 'CpuMonitor' measures how much of the audio thread every effect takes, and how close render() is to
+ * overrunning its block.
+ * - Audio thread: begin_block() and end_block() wrap the whole render(), record() times a single effect
+ *   (an EffectChain given a monitor with set_monitor() records all its stages). A measurement is a read
+ *   of the CPU tick counter and a write to an SpscRingBuffer: no allocation, no lock and no system call.
+ *   A block that takes longer than the deadline is counted as a miss right away, even if the ring is full.
+ * - Control thread (a Bela auxiliary task, or any other non realtime thread): poll() drains the ring into
+ *   per-effect histograms, which get_statistics() and print() turn into min/mean/max and percentiles.
+ *   poll() must be called often enough for the ring not to fill up (see get_dropped()).
+ * When the monitor is disabled with set_enabled(false), the audio thread only tests a flag.
+ * Ticks come from the time stamp counter on x86, the virtual counter on ARMv8, and from
+ * clock_gettime(CLOCK_MONOTONIC) elsewhere, which Xenomai (on the Bela) serves without a system call.
+**********************************************************************************************************/
+
+class CpuMonitor
+{
+public:
+	typedef uint64_t Ticks;
+	
+	struct Statistics
+	{
+		std::string name;		// name given with set_name(), "render" for the whole blocks
+		uint64_t blocks;		// number of blocks measured
+		double min_us;
+		double mean_us;
+		double max_us;
+		double p50_us;
+		double p90_us;
+		double p99_us;
+		double load;			// time spent / duration of the audio processed (1 is the whole audio thread)
+	};
+	
+private:
+	struct Measurement
+	{
+		const Effects* effect;	// nullptr for a whole block (end_block)
+		uint32_t ticks;
+		uint32_t frames;
+	};
+	
+	// 8 logarithmic bins per octave (about 9% wide), enough for any 32 bit tick count
+	static const unsigned int histogram_bins = 256;
+	
+	struct Histogram
+	{
+		const Effects* effect;
+		std::string name;
+		uint64_t count;
+		uint64_t frames;
+		uint64_t total_ticks;
+		uint32_t min_ticks;
+		uint32_t max_ticks;
+		std::array<uint64_t, histogram_bins> bins;
+	};
+	
+	float sample_rate;
+	double ticks_per_second;
+	double deadline_ticks_per_frame;
+	
+	SpscRingBuffer<Measurement> measurements;
+	std::atomic<bool> enabled;
+	Ticks block_start;
+	std::atomic<uint64_t> deadline_misses;	// only modified by the audio thread
+	std::atomic<uint64_t> dropped;			// only modified by the audio thread
+	
+	std::vector<Histogram> histograms;		// control thread only, the whole blocks first
+	
+	void push(const Effects* effect, Ticks ticks, unsigned int frames);
+	Histogram& histogram(const Effects* effect);
+	double to_us(double ticks) const { return 1e6 * ticks / ticks_per_second; }
+	double percentile(const Histogram& h, double fraction) const;
+	
+public:
 	/**
-	 * This function is equivalent to the 'regular' process function.
-	 * The only difference is that the effect's parameters are controlled
-	 * by potentiometers connected to the bella rather than through the IDE gui controller.
-	 * The reverb effect needs two potentiometers connected to 'analog in' channels 0 and 1.
-	 * Channel 0 is mapped to the 'reverb time' parameter.
-	 * Channel 1 is mapped to the 'mix percent' parameter.
-	 * @param in - An input sample to be processed.
-	 * @param index - index of the relevant sample in the current frame.
 	 * @param context - the Bela context of the project.
-	 * @returns the processed output sample.
+	 * @param deadline - fraction of the duration of a block render() may take before it counts as a miss.
+	 * @param capacity - number of measurements the ring holds between two calls to poll().
 	**/
-	float process_hardware(float in, unsigned int index, BelaContext* context);
+	CpuMonitor(BelaContext *context, float deadline = 1.0, unsigned int capacity = 8192);
+	
+	// Reads the CPU tick counter.
+	static Ticks now()
+	{
+#if defined(__x86_64__) || defined(__i386__)
+		return __rdtsc();
+#elif defined(__aarch64__)
+		uint64_t ticks;
+		asm volatile("mrs %0, cntvct_el0" : "=r"(ticks));
+		return ticks;
+#else
+		timespec time;
+		clock_gettime(CLOCK_MONOTONIC, &time);
+		return (Ticks)time.tv_sec * 1000000000 + time.tv_nsec;
+#endif
+	}
+	
+	void set_enabled(bool enable) { enabled.store(enable, std::memory_order_relaxed); }
+	bool is_enabled() const { return enabled.load(std::memory_order_relaxed); }
+	
+	// Audio thread: call at the very beginning of render().
+	void begin_block()
+	{
+		if (is_enabled())
+			block_start = now();
+	}
+	
+	/* Audio thread: call at the very end of render().
+	 * @param frames - number of frames of the block (context->audioFrames).
+	**/
+	void end_block(unsigned int frames);
+	
+	/* Audio thread: records the time an effect took.
+	 * @param effect - the effect measured.
+	 * @param start - now() before the effect was called.
+	 * @param frames - number of frames it processed.
+	**/
+	void record(const Effects* effect, Ticks start, unsigned int frames)
+	{
+		push(effect, now() - start, frames);
+	}
+	
+	/**
+	 * Control thread: moves the measurements of the audio thread into the histograms.
+	 * @returns the number of measurements taken.
+	**/
+	unsigned int poll();
+	
+	// Control thread: names an effect in the statistics (unnamed effects are numbered).
+	void set_name(const Effects* effect, const std::string& name) { histogram(effect).name = name; }
+	
+	// Control thread: the statistics of the whole blocks ("render") followed by those of every effect.
+	std::vector<Statistics> get_statistics() const;
+	
+	// Control thread: prints the statistics as a table, with the deadline misses and dropped measurements.
+	void print() const;
+	
+	// Control thread: clears the histograms (the counters are kept).
+	void clear();
+	
+	uint64_t get_deadline_misses() const { return deadline_misses.load(std::memory_order_relaxed); }
+	// Measurements lost because poll() was not called often enough.
+	uint64_t get_dropped() const { return dropped.load(std::memory_order_relaxed); }
+};
+
+
+/*********************************************************************************************************
+ * 'SignalMeter' measures the level of signals inside the audio thread (taps), for meters, a scope or a log,
+ * without calling into any of them from render().
+ * - Audio thread: measure() takes a whole block of a tap (an EffectChain given a meter with set_meter()
+ *   measures the output of every stage) and folds it into the tap's peak, sum of squares and clip count,
+ *   4 samples per vector operation. Every 'frames_per_update' frames the levels of the tap are written to
+ *   an SpscRingBuffer, one Frame per channel: no allocation, no lock and no call per sample.
+ * - Control thread: poll() drains the ring, keeps the latest levels, the peak hold and the number of clipped
+ *   samples of every tap, and hands every frame to an optional consumer (a Scope, the GUI, a log file).
+ *   poll() must be called often enough for the ring not to fill up (see get_dropped()).
+ * A tap is the output of an effect, or nullptr for any other signal (e.g. the output of render()).
+ * The first max_taps taps measured get a slot, the others are ignored.
+ * When the meter is disabled with set_enabled(false), the audio thread only tests a flag.
+**********************************************************************************************************/
+
+class SignalMeter
+{
+public:
+	struct Frame
+	{
+		const Effects* tap;
+		uint32_t channel;
+		uint64_t time;			// frames measured on the tap at the end of this frame
+		float peak;				// largest absolute value
+		float rms;
+		uint32_t clips;			// samples at or above full scale
+	};
+	
+	struct Levels
+	{
+		const Effects* tap;
+		std::string name;		// name given with set_name(), "output" for nullptr
+		unsigned int channels;	// channels measured so far
+		std::vector<float> peak;		// latest frame, per channel
+		std::vector<float> rms;			// latest frame, per channel
+		std::vector<float> peak_hold;	// largest peak since clear(), per channel
+		std::vector<uint64_t> clips;	// clipped samples since clear(), per channel
+	};
+	
+private:
+	struct Accumulator
+	{
+		float4 peak;
+		float4 sum;				// sum of squares
+		uint32_t clips;
+	};
+	
+	struct Tap
+	{
+		const Effects* source;
+		unsigned int channels;
+		unsigned int frames;	// frames accumulated since the last update
+		uint64_t time;
+		Accumulator* accumulators;	// one per channel
+	};
+	
+	unsigned int channels;
+	unsigned int frames_per_update;
+	unsigned int max_taps;
+	
+	SpscRingBuffer<Frame> updates;
+	std::atomic<bool> enabled;
+	std::atomic<uint64_t> dropped;	// only modified by the audio thread
+	std::vector<Accumulator> accumulators;	// audio thread only, max_taps * channels
+	std::vector<Tap> taps;					// audio thread only, capacity reserved at initialization
+	
+	std::vector<Levels> levels;		// control thread only
+	
+	Tap* find_tap(const Effects* source, unsigned int tap_channels);
+	void update(Tap& tap);
+	Levels& tap_levels(const Effects* source);
+	
+public:
+	/**
+	 * @param context - the Bela context of the project.
+	 * @param channels - maximum number of channels of a tap.
+	 * @param updates_per_second - frames written per tap and channel every second (the decimation).
+	 * @param max_taps - maximum number of taps.
+	 * @param capacity - number of frames the ring holds between two calls to poll().
+	**/
+	SignalMeter(BelaContext *context, unsigned int channels = 1, float updates_per_second = 50,
+				unsigned int max_taps = 16, unsigned int capacity = 4096);
+	
+	void set_enabled(bool enable) { enabled.store(enable, std::memory_order_relaxed); }
+	bool is_enabled() const { return enabled.load(std::memory_order_relaxed); }
+	
+	/* Audio thread: measures a block of a tap.
+	 * @param source - the tap, the effect that produced the signal (or nullptr).
+	 * @param signal - one pointer per channel.
+	 * @param signal_channels - number of channels, at most the channels of the meter.
+	 * @param frames - number of frames.
+	**/
+	void measure(const Effects* source, const float* const* signal, unsigned int signal_channels, unsigned int frames);
+	
+	/**
+	 * Control thread: takes the frames of the audio thread.
+	 * @param consumer - called with every frame, in order (optional).
+	 * @returns the number of frames taken.
+	**/
+	unsigned int poll(const std::function<void(const Frame&)>& consumer = nullptr);
+	
+	// Control thread: names a tap in the levels (unnamed taps are numbered).
+	void set_name(const Effects* source, const std::string& name) { tap_levels(source).name = name; }
+	
+	// Control thread: the levels of every tap, in the order they were first seen.
+	const std::vector<Levels>& get_levels() const { return levels; }
+	
+	// Control thread: prints the levels as a table (dBFS), with the dropped frames.
+	void print() const;
+	
+	// Control thread: clears the peak holds and the clip counts.
+	void clear();
+	
+	unsigned int get_frames_per_update() const { return frames_per_update; }
+	// Frames lost because poll() was not called often enough.
+	uint64_t get_dropped() const { return dropped.load(std::memory_order_relaxed); }
+};
+
+
+/*********************************************************************************************************
+ * 'EffectChain' runs a list of effects one after the other, and is an effect by itself
+ * (so chains can be nested, or used anywhere an Effects* is expected).
+ * - The order can be changed at runtime (insert/remove/move), without allocating memory:
+ *   room for 'max_stages' effects is reserved at initialization.
+ * - A bypassed stage is skipped entirely (it costs nothing and its state is frozen), unlike an
+ *   effect running with mix = 0.
+ * - Blocks are processed in place: the first active stage reads the input block and writes the
+ *   output block, the following stages work in the output block, so no copies are made between stages.
+ * - Given a CpuMonitor (set_monitor), it measures the time every stage takes.
+ * - Given a SignalMeter (set_meter), it measures the output of every stage.
+ * The chain does not own the effects, the caller allocates and deletes them.
+**********************************************************************************************************/
+
+class EffectChain : public Effects
+{
+private:
+	struct Stage
+	{
+		Effects* effect;
+		bool bypassed;
+	};
+	
+	ArenaVector<Stage> stages;		// capacity reserved at initialization
+	unsigned int max_stages;
+	CpuMonitor* monitor;			// times every stage when not null (see set_monitor)
+	SignalMeter* meter;				// measures the output of every stage when not null (see set_meter)
+	
+public:
+	/**
+	 * @param context - the Bela context of the project.
+	 * @param max_stages - maximum number of effects in the chain.
+	 * @param channels - number of channels for process_channels(), the effects must have as many.
+	**/
+	EffectChain(BelaContext *context, unsigned int max_stages = 16, unsigned int channels = 1);
+	
+	/**
+	 * Inserts an effect into the chain.
+	 * @param position - index of the new stage (0 is first, size() is last).
+	 * @param effect - the effect.
+	 * @param bypassed - initial bypass state.
+	 * @returns false if the chain is full or the position is out of range.
+	**/
+	bool insert(unsigned int position, Effects* effect, bool bypassed = false);
+	
+	// Appends an effect at the end of the chain, returns false if the chain is full.
+	bool add(Effects* effect, bool bypassed = false) { return insert(stages.size(), effect, bypassed); }
+	
+	/**
+	 * Removes a stage from the chain (the effect itself is not deleted).
+	 * @param position - index of the stage.
+	 * @returns the removed effect, or nullptr if the position is out of range.
+	**/
+	Effects* remove(unsigned int position);
+	
+	/**
+	 * Moves a stage to another position, the other stages keep their relative order.
+	 * @param from - current index of the stage.
+	 * @param to - new index of the stage.
+	 * @returns false if one of the positions is out of range.
+	**/
+	bool move(unsigned int from, unsigned int to);
+	
+	/**
+	 * Bypasses a stage (or brings it back). A bypassed stage is not processed at all.
+	 * @param position - index of the stage.
+	 * @param bypassed - the new state.
+	 * @returns nothing.
+	**/
+	void set_bypass(unsigned int position, bool bypassed);
+	bool is_bypassed(unsigned int position) const { return stages[position].bypassed; }
+	
+	unsigned int size() const { return stages.size(); }
+	Effects* get(unsigned int position) const { return stages[position].effect; }
+	
+	/**
+	 * Times every stage that process_block() or process_channels() runs (process() is not timed).
+	 * The monitor is not owned by the chain.
+	 * @param new_monitor - the monitor, or nullptr to stop timing.
+	 * @returns nothing.
+	**/
+	void set_monitor(CpuMonitor* new_monitor) { monitor = new_monitor; }
+	
+	/**
+	 * Measures the output of every stage that process_block() or process_channels() runs.
+	 * The meter is not owned by the chain.
+	 * @param new_meter - the meter, or nullptr to stop measuring.
+	 * @returns nothing.
+	**/
+	void set_meter(SignalMeter* new_meter) { meter = new_meter; }
+	
+	float process(float in, GuiController* controller = nullptr) override;
+	void process_block(const float* in, float* out, unsigned int frames, GuiController* controller = nullptr) override;
+	void process_channels(const float* const* in, float* const* out, unsigned int frames, GuiController* controller = nullptr) override;
+	void reset() override;
+	void advance(unsigned int frames, GuiController* controller = nullptr) override;
+	// Publishes the parameters of every stage (including the bypassed ones).
+	// The stages are not locked: do not insert, remove or move stages while another thread publishes.
+	void publish(GuiController* controller) override;
+};
+
+
+/*********************************************************************************************************
+ * 'PresetBank' switches between complete sounds (presets) on stage, without allocating or locking:
+ * every preset is an effect (usually an EffectChain of effects constructed without a controller, set up
+ * with publish(Parameters)) allocated with all its state beforehand, and select() only asks the audio
+ * thread to switch.
+ * - The switch happens at the beginning of the next block (or when the crossfade in progress ends),
+ *   so a program change takes effect after at most one block, plus one crossfade.
+ * - With a crossfade, the outgoing and the incoming presets both run for the crossfade time, and their
+ *   outputs are mixed with linear gains that sum to 1 (equal gain), so there is no click. The presets
+ *   process the same input and share its dry part, so their outputs are correlated: equal-power gains
+ *   (cos and sin) would sum to up to sqrt(2) (+3 dB) in the middle of the crossfade, equal gains do not.
+ *   Without it, the switch is immediate.
+ * - The incoming preset is reset() when it is switched to, so it starts from silence rather than from the
+ *   state it was left in. Only the active preset (two presets while crossfading) is processed.
+ * The bank does not own the presets, the caller allocates and deletes them.
+**********************************************************************************************************/
+
+class PresetBank : public Effects
+{
+private:
+	ArenaVector<Effects*> presets;			// capacity reserved at initialization
+	unsigned int max_presets;
+	std::atomic<unsigned int> request;		// (index << 1) | crossfade, written by select()
+	unsigned int active;					// preset processed (the incoming one while crossfading)
+	unsigned int outgoing;					// preset faded out while crossfading
+	unsigned int fade_length;				// frames of a crossfade
+	unsigned int fade_position;				// frames of the crossfade done, fade_length when there is none
+	float fade_step;						// 1 / fade_length, the incoming gain after i frames is i * fade_step
+	ArenaVector<float> scratch;				// outputs of the two presets while crossfading, audio_frames per channel each
+	ArenaVector<float*> outgoing_out;
+	ArenaVector<float*> incoming_out;
+	ArenaVector<const float*> piece_in;		// pointers into the blocks longer than audio_frames
+	ArenaVector<float*> piece_out;
+	
+	// Runs a preset on a block of one channel (process_block) or of every channel (process_channels).
+	static void run(Effects* preset, const float* const* in, float* const* out, unsigned int frames, bool planar,
+					GuiController* controller);
+	// Processes at most audio_frames frames: takes a pending request, then runs and mixes the presets.
+	void render(const float* const* in, float* const* out, unsigned int frames, bool planar, GuiController* controller);
+	// Processes a block of any length, in pieces of audio_frames frames.
+	void render_pieces(const float* const* in, float* const* out, unsigned int frames, bool planar, GuiController* controller);
+	
+public:
+	/**
+	 * @param context - the Bela context of the project.
+	 * @param max_presets - maximum number of presets in the bank.
+	 * @param channels - number of channels for process_channels(), the presets must have as many.
+	 * @param crossfade_ms - length of the crossfade between two presets (0 switches immediately).
+	**/
+	PresetBank(BelaContext *context, unsigned int max_presets = 8, unsigned int channels = 1, float crossfade_ms = 20);
+	
+	/**
+	 * Adds a preset to the bank, before processing starts. The first preset is the active one.
+	 * @param preset - the preset.
+	 * @returns the index of the preset, or -1 if the bank is full.
+	**/
+	int add(Effects* preset);
+	
+	/**
+	 * Asks the audio thread to switch to another preset. Lock-free, can be called from any one thread
+	 * (a Bela auxiliary task, a MIDI callback...) or from render() itself.
+	 * If several presets are selected before the audio thread takes the request, the last one wins.
+	 * @param index - index of the preset.
+	 * @param crossfade - false to switch immediately instead of crossfading.
+	 * @returns nothing.
+	**/
+	void select(unsigned int index, bool crossfade = true)
+	{
+		request.store((index << 1) | (crossfade ? 1 : 0), std::memory_order_release);
+	}
+	
+	// Audio thread: the preset being processed (the incoming one while crossfading).
+	unsigned int get_active() const { return active; }
+	// Audio thread: true while two presets are being mixed.
+	bool is_crossfading() const { return fade_position < fade_length; }
+	
+	unsigned int size() const { return presets.size(); }
+	Effects* get(unsigned int index) const { return presets[index]; }
+	
+	float process(float in, GuiController* controller = nullptr) override;
+	void process_block(const float* in, float* out, unsigned int frames, GuiController* controller = nullptr) override;
+	void process_channels(const float* const* in, float* const* out, unsigned int frames, GuiController* controller = nullptr) override;
+	// Resets every preset and ends a crossfade in progress.
+	void reset() override;
+	// Advances every preset, so the inactive ones keep the same modulation phase.
+	void advance(unsigned int frames, GuiController* controller = nullptr) override;
+	// Publishes the parameters of every preset.
+	void publish(GuiController* controller) override;
 };
 
+
+/*********************************************************************************************************
+ * 'LoadGovernor' keeps render() within its deadline by lowering the quality tier of effects (see
+ * Effects::set_quality) while the CPU is too busy, and raising it back when there is room again, so
+ * the sound degrades gracefully instead of dropping out:
+ * - begin_block() and end_block() wrap render(), as those of CpuMonitor, and measure the load of every
+ *   block (the time render() took over the duration of the block).
+ * - Two blocks in a row above 'high_load' lower the quality by one step right away (a single late block
+ *   is usually a preemption or a page fault, which a lower quality would not prevent). The quality is
+ *   raised by one step once the average load has stayed below 'low_load' for 'recovery_ms'. After a step,
+ *   the governor waits for the measurements to show its effect before stepping again. The gap between the thresholds
+ *   and the recovery time are the hysteresis that keeps the quality from oscillating.
+ * - A step is one tier of one effect: the effects are lowered in the order they were added (add the most
+ *   expensive ones first), each down to its cheapest tier before the next one, and raised in reverse order.
+ * - The effects can be added in groups (e.g. one per preset of a PresetBank), and only the group selected
+ *   with select_group() is governed: the effects that do not run cannot lower the load, so they are not
+ *   stepped, and they get the current level when their group is selected.
+ * The tiers change on the audio thread, between two blocks, and nothing is allocated.
+ * The governor does not own the effects, the caller allocates and deletes them.
+**********************************************************************************************************/
+
+class LoadGovernor
+{
+private:
+	std::vector<Effects*> effects;		// in stepping down order, capacity reserved at initialization
+	std::vector<unsigned int> groups;	// group of every effect
+	unsigned int max_effects;
+	double ticks_per_frame;				// duration of a frame in CpuMonitor ticks
+	float high_load;
+	float low_load;
+	unsigned int recovery_frames;		// frames of low average load before stepping up
+	unsigned int settle_frames;			// frames without stepping after a step
+	float average_frames;				// time constant of the average load
+	
+	std::atomic<bool> enabled;
+	bool measuring;						// begin_block() read the start time of the current block
+	CpuMonitor::Ticks block_start;
+	float average_load;
+	unsigned int frames_below;			// frames the average load has been below low_load
+	unsigned int blocks_above;			// consecutive blocks above high_load
+	unsigned int frames_to_settle;		// frames left without stepping (also the first blocks, with cold caches)
+	unsigned int group;					// group governed
+	std::atomic<unsigned int> max_level;	// steps from the best to the cheapest quality of the group, only modified by the audio thread
+	std::atomic<unsigned int> level;	// only modified by the audio thread
+	std::atomic<float> last_load;		// only modified by the audio thread
+	
+	// Sets the tier of every effect of the group for a number of steps down from the best quality.
+	void apply(unsigned int new_level);
+	// Steps from the best to the cheapest quality of the effects of a group.
+	unsigned int group_max_level(unsigned int group) const;
+	
+public:
+	/**
+	 * @param context - the Bela context of the project.
+	 * @param high_load - load of a block (fraction of its duration) above which the quality is lowered.
+	 * @param low_load - average load below which the quality can be raised, lower than high_load.
+	 * @param recovery_ms - time the average load must stay below low_load before the quality is raised.
+	 * @param max_effects - maximum number of effects the governor controls.
+	**/
+	LoadGovernor(BelaContext *context, float high_load = 0.75, float low_load = 0.5, float recovery_ms = 2000,
+				 unsigned int max_effects = 16);
+	
+	/**
+	 * Puts an effect under the control of the governor, before processing starts.
+	 * Effects with a single quality tier can be added, but are never changed.
+	 * @param effect - the effect, at its best quality.
+	 * @param group - the group of the effect, group 0 is governed until select_group() is called.
+	 * @returns the index of the effect, or -1 if the governor is full.
+	**/
+	int add(Effects* effect, unsigned int group = 0);
+	
+	/**
+	 * Audio thread: governs the effects of another group (e.g. the active preset) from the next block on,
+	 * at the current level (or the cheapest quality of the group if it has fewer steps). Does nothing if the
+	 * group is already governed, so it can be called at every block.
+	 * @param new_group - the group to govern.
+	 * @returns nothing.
+	**/
+	void select_group(unsigned int new_group);
+	
+	// When disabled, the effects stay at their current tiers and the audio thread only tests a flag.
+	void set_enabled(bool enable) { enabled.store(enable, std::memory_order_relaxed); }
+	bool is_enabled() const { return enabled.load(std::memory_order_relaxed); }
+	
+	// Audio thread: call at the very beginning of render().
+	void begin_block()
+	{
+		measuring = is_enabled();
+		if (measuring)
+			block_start = CpuMonitor::now();
+	}
+	
+	/* Audio thread: call at the very end of render(), changes the tiers when needed.
+	 * @param frames - number of frames of the block (context->audioFrames).
+	**/
+	void end_block(unsigned int frames);
+	
+	// Any thread: steps down from the best quality, 0 to get_max_level().
+	unsigned int get_level() const { return level.load(std::memory_order_relaxed); }
+	unsigned int get_max_level() const { return max_level.load(std::memory_order_relaxed); }
+	unsigned int get_group() const { return group; }
+	// Any thread: load of the last block measured.
+	float get_load() const { return last_load.load(std::memory_order_relaxed); }
+};
@@ -8,8 +8,11 @@
 
 #include "Effects.h"
 
-std::vector<float> input_buffer;
-int rd_ptr = 0;
+const unsigned int channels = 2;	// the effects process the left and right channels separately (true stereo)
+
+AudioFileStream* song = nullptr;				// streams the track from the disk, whatever its length
+std::vector<std::vector<float>> block_buffers;	// one block of samples per channel, processed in place by the effects
+float* blocks[channels];						// planar pointers to block_buffers
 std::string song_path = "../Californication_Instrumental.wav";		// change path for different track
 std::string song_path_2 = "../speech.wav";
 
@@ -17,10 +20,78 @@ Scope scope;
 Gui gui;
 GuiController controller;
 
+// All the effects and their state (delay lines, filters, tables) live in a single block of memory,
+// laid out in processing order (see Arena), and are destroyed with it.
+Arena* arena = nullptr;
+const size_t arena_bytes = 1 << 20;
+
 // 1. Declare global pointers for each of the effects we will use.
 Distortion* distortion = nullptr;	// Effects* will work as well
 WahWah* wahwah = nullptr;
 Reverb* reverb = nullptr;
+EffectChain* chain = nullptr;		// runs the effects one after the other
+
+// Two more sounds, allocated at setup and switched with a crossfade by the "Preset" slider.
+// Their effects have no sliders (no controller), their parameters are published once in setup().
+FdnReverb* hall_reverb = nullptr;
+EffectChain* hall = nullptr;
+Distortion* crunch_distortion = nullptr;
+WahWah* crunch_wahwah = nullptr;
+EffectChain* crunch = nullptr;
+PresetBank* presets = nullptr;		// 0: the chain above (sliders), 1: hall, 2: crunch
+unsigned int preset_slider;
+CpuMonitor* monitor = nullptr;		// measures the time every effect and the whole render() take
+LoadGovernor* governor = nullptr;	// lowers the quality of the effects when render() gets close to its deadline
+SignalMeter* meter = nullptr;		// peak/RMS/clips of every stage and of the output, shown on the scope
+const float meter_updates_per_second = 50;
+
+// GUI sliders (0/1) that bypass each stage of the chain
+unsigned int bypass_sliders[3];
+
+// The sliders are read by an auxiliary task, which publishes them to the effects (see publish_parameters),
+// so render() never reads the gui controller while processing.
+AuxiliaryTask publish_task;
+std::atomic<unsigned int> bypass_mask(0);
+
+void publish_parameters(void*)
+{
+	chain->publish(&controller);
+	
+	unsigned int mask = 0;
+	for (unsigned int i = 0; i < 3; i++) {
+		if (controller.getSliderValue(bypass_sliders[i]) > 0.5f)
+			mask |= 1 << i;
+	}
+	bypass_mask.store(mask, std::memory_order_relaxed);
+	
+	// Lock-free, the audio thread switches at its next block
+	presets->select(controller.getSliderValue(preset_slider));
+}
+
+// The CPU measurements are collected and printed by a low priority auxiliary task, never by render()
+AuxiliaryTask cpu_report_task;
+bool print_cpu_usage = true;		// set to false to stop measuring
+const float cpu_poll_seconds = 0.25;
+const unsigned int cpu_polls_per_report = 20;	// print every 5 seconds
+unsigned int cpu_poll_interval;		// in blocks
+unsigned int blocks_to_cpu_poll;
+
+void report_cpu_usage(void*)
+{
+	static unsigned int polls = 0;
+	monitor->poll();
+	// The scope shows the peak and RMS of the left output, once per frame of the meter
+	meter->poll([](const SignalMeter::Frame& frame) {
+		if (!frame.tap && frame.channel == 0)
+			scope.log(frame.peak, frame.rms);
+	});
+	if (++polls % cpu_polls_per_report == 0) {
+		monitor->print();
+		meter->print();
+		meter->clear();
+		rt_printf("Quality: %u step(s) down of %u\n", governor->get_level(), governor->get_max_level());
+	}
+}
 
 bool is_live = false; // set to true to process live input
 
@@ -29,15 +100,114 @@ bool setup(BelaContext *context, void *userData)
 	gui.setup(context->projectName);
 	controller.setup(&gui, "Effects");
 	
-	scope.setup(1, context->audioSampleRate);
+	scope.setup(2, meter_updates_per_second);
+	
+	// 2. Alllocate effects' classes, in the arena and in the order they process
+	arena = new Arena(arena_bytes);
+	distortion = arena->create<Distortion>(context, &controller, Waveshaper::EXPONENTIAL_SOFT_CLIP, nullptr, channels);
+	wahwah = arena->create<WahWah>(context, &controller, WahWah::CONTROL_RATE, 16, channels);
+	reverb = arena->create<Reverb>(context, &controller, 8, channels);
+	
+	// 3. Put the effects in a chain (the chain does not delete them)
+	chain = arena->create<EffectChain>(context, 16, channels);
+	chain->add(distortion);
+	chain->add(wahwah);
+	chain->add(reverb);
+	bypass_sliders[0] = controller.addSlider("Bypass Distortion", 0, 0, 1, 1);
+	bypass_sliders[1] = controller.addSlider("Bypass WahWah", 0, 0, 1, 1);
+	bypass_sliders[2] = controller.addSlider("Bypass Reverb", 0, 0, 1, 1);
+	
+	// 4. Measure the effects (optional)
+	monitor = new CpuMonitor(context);
+	monitor->set_name(distortion, "Distortion");
+	monitor->set_name(wahwah, "WahWah");
+	monitor->set_name(reverb, "Reverb");
+	monitor->set_enabled(print_cpu_usage);
+	chain->set_monitor(monitor);
+	
+	// 5. Allocate the other presets and put all of them in a bank (the bank does not delete them)
+	// 8 lines of 19 to 41 ms: up to 48 kHz a line holds 2048 samples (a power of two, see FdnReverb), so
+	// the hall fits in the L2 cache of the board (64 KB per channel, instead of 128 KB with the default delays)
+	const std::vector<float> hall_delays_ms = {19, 21.2, 23.7, 26.4, 29.5, 32.9, 36.7, 41};
+	hall_reverb = arena->create<FdnReverb>(context, nullptr, 8, hall_delays_ms, channels);
+	FdnReverb::Parameters hall_parameters;
+	hall_parameters.reverb_time = 3000;
+	hall_parameters.mix_percent = 0.5;
+	hall_reverb->publish(hall_parameters);
+	hall = arena->create<EffectChain>(context, 4, channels);
+	hall->add(hall_reverb);
 	
-	// 2. Alllocate effects' classes
-	distortion = new Distortion(context, &controller);
-	wahwah = new WahWah(context, &controller);
-	reverb = new Reverb(context, &controller);
+	crunch_distortion = arena->create<Distortion>(context, nullptr, Waveshaper::EXPONENTIAL_SOFT_CLIP, nullptr, channels);
+	Distortion::Parameters crunch_parameters;
+	crunch_parameters.gain = 20;
+	crunch_parameters.volume = 0.7;
+	crunch_parameters.is_overdrive = true;
+	crunch_distortion->publish(crunch_parameters);
+	crunch_wahwah = arena->create<WahWah>(context, nullptr, WahWah::CONTROL_RATE, 16, channels);
+	WahWah::Parameters wah_parameters;
+	wah_parameters.q = 5;
+	wah_parameters.mix_percent = 0.6;
+	crunch_wahwah->publish(wah_parameters);
+	crunch = arena->create<EffectChain>(context, 4, channels);
+	crunch->add(crunch_distortion);
+	crunch->add(crunch_wahwah);
+	
+	presets = arena->create<PresetBank>(context, 4, channels, 30);
+	presets->add(chain);
+	presets->add(hall);
+	presets->add(crunch);
+	preset_slider = controller.addSlider("Preset", 0, 0, 2, 1);
+	
+	hall->set_monitor(monitor);
+	crunch->set_monitor(monitor);
+	monitor->set_name(hall_reverb, "Hall Reverb");
+	monitor->set_name(crunch_distortion, "Crunch Dist.");
+	monitor->set_name(crunch_wahwah, "Crunch WahWah");
+	
+	// 6. Let a governor trade quality for CPU time when the blocks get close to their deadline (optional).
+	// One group per preset, only the active preset is governed. The most expensive effects first:
+	// the reverbs lose half of their combs or delay lines before the wah-wahs slow down.
+	governor = new LoadGovernor(context);
+	governor->add(reverb, 0);
+	governor->add(wahwah, 0);
+	governor->add(hall_reverb, 1);
+	governor->add(crunch_wahwah, 2);
+	
+	// 7. Tap the output of every stage and of render() (optional), instead of logging every sample to the scope
+	meter = new SignalMeter(context, channels, meter_updates_per_second);
+	meter->set_name(distortion, "Distortion");
+	meter->set_name(wahwah, "WahWah");
+	meter->set_name(reverb, "Reverb");
+	meter->set_name(hall_reverb, "Hall Reverb");
+	meter->set_name(crunch_distortion, "Crunch Dist.");
+	meter->set_name(crunch_wahwah, "Crunch WahWah");
+	chain->set_meter(meter);
+	hall->set_meter(meter);
+	crunch->set_meter(meter);
+	
+	rt_printf("Effects: %zu KB in the arena", arena->get_used() / 1024);
+	if (arena->get_overflow())
+		rt_printf(", %zu KB did not fit (increase arena_bytes)", arena->get_overflow() / 1024);
+	rt_printf("\n");
+	
+	publish_task = Bela_createAuxiliaryTask(publish_parameters, 50, "publish-parameters");
+	cpu_report_task = Bela_createAuxiliaryTask(report_cpu_usage, 10, "report-cpu-usage");
+	cpu_poll_interval = std::max(1.0f, cpu_poll_seconds * context->audioSampleRate / context->audioFrames);
+	blocks_to_cpu_poll = cpu_poll_interval;
+	
+	// Allocate the block buffers here, never inside render()
+	block_buffers.assign(channels, std::vector<float>(context->audioFrames));
+	for (unsigned int c = 0; c < channels; c++) {
+		blocks[c] = block_buffers[c].data();
+	}
 
 	if (!is_live) { 
-		input_buffer = AudioFileUtilities::loadMono(song_path_2);
+		// A mono file feeds both channels
+		song = new AudioFileStream(song_path_2, channels);
+		if (!song->is_open()) {
+			rt_printf("Could not open '%s'\n", song_path_2.c_str());
+			return false;
+		}
 	}
 	
 	return true;
@@ -45,44 +215,65 @@ bool setup(BelaContext *context, void *userData)
 
 void render(BelaContext *context, void *userData)
 {
-	for(unsigned int n = 0; n < context->audioFrames; n++) {
-    	
-	    if(++rd_ptr >= input_buffer.size()) {
-	        rd_ptr = 0;
-	    }
-	            
-		float in = 0;
-		if (is_live){
-			in = audioRead(context, n, 0);
+	// Flush denormals for the whole callback: the effects' own guards then cost nothing,
+	// and the sample by sample calls below are covered as well
+	DenormalGuard denormal_guard;
+	monitor->begin_block();
+	governor->begin_block();
+	
+	if (is_live) {
+		// A mono input feeds both channels, no input at all gives silence
+		for(unsigned int n = 0; n < context->audioFrames; n++) {
+			for (unsigned int c = 0; c < channels; c++) {
+				blocks[c][n] = context->audioInChannels ? audioRead(context, n, std::min(c, context->audioInChannels - 1)) : 0;
+			}
 		}
-		
-	    else {
-	    	in = input_buffer[rd_ptr];
-	    }
-	    
-	    float out = 0;
-    	// 3. Activate the effects (in this case one after the other in a row).
-    	out = distortion->process(in, &controller);
-    	out = wahwah->process(out, &controller);
-    	out = reverb->process(out, &controller);
-    	
-    	// Out comment to activate effects with potentiometers 
-    	//out = distortion->process_hardware(in, n, context);
-    	//out = reverb->process_hardware(in, n, context);
-    	
-    	scope.log(out);
-    	
+	}
+	
+	else {
+		// Never waits for the disk, the stream is read ahead by a background thread
+		song->read(blocks, context->audioFrames);
+	}
+	
+	// 8. Activate the selected preset on the whole block, with the latest published parameters (no controller is given).
+	unsigned int mask = bypass_mask.load(std::memory_order_relaxed);
+	for (unsigned int i = 0; i < chain->size(); i++)
+		chain->set_bypass(i, mask & (1 << i));
+	presets->process_channels(blocks, blocks, context->audioFrames);
+	// To control the effects with potentiometers instead (sample by sample, left channel only),
+	// comment out the line above and out comment these ones:
+	//for(unsigned int n = 0; n < context->audioFrames; n++) {
+	//	blocks[0][n] = distortion->process_hardware(blocks[0][n], n, context);
+	//	blocks[0][n] = reverb->process_hardware(blocks[0][n], n, context);
+	//}
+	meter->measure(nullptr, blocks, channels, context->audioFrames);
+	governor->select_group(presets->get_active());
+	
+	// Ask for fresh parameters, they will be picked up by one of the next blocks
+	Bela_scheduleAuxiliaryTask(publish_task);
+	
+	for(unsigned int n = 0; n < context->audioFrames; n++) {
+		// Left and right to the first two outputs, any other output repeats the right channel
 		for(unsigned int channel = 0; channel < context->audioOutChannels; channel++) {
-			audioWrite(context, n, channel, out);
+			audioWrite(context, n, channel, blocks[std::min(channel, channels - 1)][n]);
 		}
     }
+	
+	governor->end_block(context->audioFrames);
+	monitor->end_block(context->audioFrames);
+	if (print_cpu_usage && --blocks_to_cpu_poll == 0) {
+		Bela_scheduleAuxiliaryTask(cpu_report_task);
+		blocks_to_cpu_poll = cpu_poll_interval;
+	}
 }
 
 void cleanup(BelaContext *context, void *userData)
 {
-	// 4. Deallocate memory
-	delete distortion;
-	delete wahwah;
-	delete reverb;
+	// 9. Deallocate memory (the arena destroys the effects, chains and presets it holds)
+	delete arena;
+	delete monitor;
+	delete governor;
+	delete meter;
+	delete song;
 }
 
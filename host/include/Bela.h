@@ -0,0 +1,118 @@
+/*********************************************************************************************
+ * Host-side stand-in for <Bela.h>.
+ * It provides the subset of the Bela API used by the Effects class and the example projects,
+ * so they can be built, profiled and run offline on a regular Linux machine.
+ * Buffers are interleaved, as with BELA_FLAG_INTERLEAVED on the board.
+ * Only meant for host builds (see host/Makefile), never copy it to a Bela project.
+**********************************************************************************************/
+
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+#define MAX_PROJECTNAME_LENGTH 256
+#define rt_printf printf
+#define rt_fprintf fprintf
+
+struct BelaContext
+{
+	const float* audioIn;
+	float* audioOut;
+	const float* analogIn;
+	float* analogOut;
+	
+	uint32_t audioFrames;
+	uint32_t audioInChannels;
+	uint32_t audioOutChannels;
+	float audioSampleRate;
+	
+	uint32_t analogFrames;
+	uint32_t analogInChannels;
+	uint32_t analogOutChannels;
+	float analogSampleRate;
+	
+	uint64_t audioFramesElapsed;
+	uint32_t flags;
+	char projectName[MAX_PROJECTNAME_LENGTH];
+};
+
+static inline float audioRead(BelaContext* context, int frame, int channel)
+{
+	return context->audioIn[frame * context->audioInChannels + channel];
+}
+
+static inline void audioWrite(BelaContext* context, int frame, int channel, float value)
+{
+	context->audioOut[frame * context->audioOutChannels + channel] = value;
+}
+
+static inline float analogRead(BelaContext* context, int frame, int channel)
+{
+	return context->analogIn[frame * context->analogInChannels + channel];
+}
+
+static inline void analogWrite(BelaContext* context, int frame, int channel, float value)
+{
+	for (unsigned int f = frame; f < context->analogFrames; f++)
+		context->analogOut[f * context->analogOutChannels + channel] = value;
+}
+
+/*********************************************************************************************
+ * Auxiliary tasks: each task is a thread that runs its callback once every time it is scheduled
+ * (a task scheduled again while running runs once more afterwards), like the Bela core does.
+ * Priorities and names are ignored on the host. Bela_deleteAllAuxiliaryTasks() waits for the
+ * running callbacks and stops the threads, the host runner calls it before cleanup().
+**********************************************************************************************/
+
+typedef void* AuxiliaryTask;
+
+AuxiliaryTask Bela_createAuxiliaryTask(void (*callback)(void*), int priority, const char* name, void* arg = nullptr);
+int Bela_scheduleAuxiliaryTask(AuxiliaryTask task);
+void Bela_deleteAllAuxiliaryTasks();
+
+static inline float map(float x, float in_min, float in_max, float out_min, float out_max)
+{
+	return (x - in_min) * (out_max - out_min) / (in_max - in_min) + out_min;
+}
+
+static inline float constrain(float x, float min_val, float max_val)
+{
+	if (x < min_val) return min_val;
+	if (x > max_val) return max_val;
+	return x;
+}
+
+/*********************************************************************************************
+ * Owns the buffers behind a BelaContext, the way the Bela core does on the board.
+ * Analog inputs run at half the audio rate (the Bela default with 8 analog channels),
+ * and all analog inputs are 0 until set with set_analog_input().
+**********************************************************************************************/
+
+class HostContext
+{
+private:
+	BelaContext context;
+	std::vector<float> audio_in;
+	std::vector<float> audio_out;
+	std::vector<float> analog_in;
+	std::vector<float> analog_out;
+	
+public:
+	HostContext(float sample_rate, unsigned int block_size, unsigned int in_channels = 1, unsigned int out_channels = 1,
+				const char* project_name = "host");
+	
+	BelaContext* get() { return &context; }
+	
+	// Interleaved input of the current block (block_size * in_channels samples).
+	float* input() { return audio_in.data(); }
+	// Interleaved output of the current block (block_size * out_channels samples).
+	const float* output() const { return audio_out.data(); }
+	
+	// Holds an analog input (potentiometer) at the given value, normally between 0 and 1.
+	void set_analog_input(unsigned int channel, float value);
+	
+	// Advances audioFramesElapsed after a block has been rendered.
+	void advance() { context.audioFramesElapsed += context.audioFrames; }
+};
@@ -0,0 +1,48 @@
+/*********************************************************************************************
+ * Host-side stand-in for the Bela AudioFile library.
+ * Reads and writes RIFF/WAVE files (8/16/24/32 bit integer PCM and 32/64 bit float).
+ * Functions marked "host only" do not exist on the board.
+**********************************************************************************************/
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+namespace AudioFileUtilities
+{
+	/**
+	 * Loads the samples of an audio file, one vector per channel.
+	 * @param file - path of the file.
+	 * @param maxCount - maximum number of frames to load, -1 for the whole file.
+	 * @param start - first frame to load.
+	 * @returns the samples, or an empty vector if the file could not be read.
+	**/
+	std::vector<std::vector<float>> load(const std::string& file, int maxCount = -1, unsigned int start = 0);
+	
+	// Loads the first channel of an audio file.
+	std::vector<float> loadMono(const std::string& file);
+	
+	/**
+	 * Writes an audio file.
+	 * @param file - path of the file.
+	 * @param dataIn - the samples, one vector per channel (all of the same length).
+	 * @param sampleRate - sample rate stored in the file.
+	 * @param bitsPerSample - host only: 16 or 24 for integer PCM, 32 for float.
+	 * @returns 0 on success, a negative value otherwise.
+	**/
+	int write(const std::string& file, const std::vector<std::vector<float>>& dataIn, unsigned int sampleRate,
+			  unsigned int bitsPerSample = 16);
+	
+	int getNumChannels(const std::string& file);
+	int getNumFrames(const std::string& file);
+	// Host only: sample rate of the file, or a negative value if it could not be read.
+	int getSampleRate(const std::string& file);
+	
+	/**
+	 * Reads one channel of a range of frames.
+	 * @param buf - destination, at least endFrame - startFrame samples.
+	 * @returns 0 on success, a negative value otherwise.
+	**/
+	int getSamples(const std::string& file, float* buf, unsigned int channel, unsigned int startFrame, unsigned int endFrame);
+}
@@ -0,0 +1,62 @@
+/*********************************************************************************************
+ * Host-side stand-in for the Bela Biquad library.
+ * Same interface and design equations as the library on the board
+ * (based on Nigel Redmon's biquad, transposed direct form II), so results match.
+**********************************************************************************************/
+
+#pragma once
+
+class Biquad
+{
+public:
+	typedef enum
+	{
+		lowpass,
+		highpass,
+		bandpass,
+		notch,
+		peak,
+		lowshelf,
+		highshelf,
+	} Type;
+	
+	struct Settings
+	{
+		double fs;			// Sample rate in Hz
+		double cutoff;		// Cutoff in Hz
+		Type type;			// Filter type
+		double q;			// Quality factor
+		double peakGainDb;	// Maximum filter gain
+	};
+	
+	Biquad() {}
+	Biquad(const Settings& settings) { setup(settings); }
+	int setup(const Settings& settings);
+	void clean() { z1 = z2 = 0.0; }
+	
+	float process(float in)
+	{
+		double out = in * a0 + z1;
+		z1 = in * a1 + z2 - b1 * out;
+		z2 = in * a2 - b2 * out;
+		return out;
+	}
+	
+	void setType(Type type) { this->type = type; calc(); }
+	void setQ(double Q) { this->Q = Q; calc(); }
+	void setFc(double Fc) { this->Fc = Fc / Fs; calc(); }
+	void setPeakGain(double peakGainDB) { this->peakGain = peakGainDB; calc(); }
+	
+	Type getType() const { return type; }
+	double getQ() const { return Q; }
+	double getFc() const { return Fc * Fs; }
+	double getPeakGain() const { return peakGain; }
+	
+private:
+	void calc();
+	
+	Type type = lowpass;
+	double a0 = 1.0, a1 = 0.0, a2 = 0.0, b1 = 0.0, b2 = 0.0;
+	double Fc = 0.5, Q = 0.707, peakGain = 0.0, Fs = 1.0;
+	double z1 = 0.0, z2 = 0.0;
+};
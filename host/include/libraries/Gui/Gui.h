@@ -0,0 +1,18 @@
+/*********************************************************************************************
+ * Host-side stand-in for the Bela Gui library.
+ * There is no browser on the host, so the Gui only keeps the project name.
+**********************************************************************************************/
+
+#pragma once
+
+#include <string>
+
+class Gui
+{
+private:
+	std::string project_name;
+	
+public:
+	int setup(std::string projectName) { project_name = projectName; return 0; }
+	const std::string& getProjectName() const { return project_name; }
+};
@@ -0,0 +1,76 @@
+/*********************************************************************************************
+ * Host-side stand-in for the Bela GuiController library.
+ * Sliders behave like the real ones (they are clamped to their range), but instead of a browser
+ * they are moved by name, either directly with setSliderValue() or by a script of timed
+ * assignments loaded with loadScript() and applied with update().
+ * Script lines look like "<time in seconds> <slider name> = <value>", for example:
+ *     0    Gain = 20
+ *     2.5  Mix Percentage = 0.4
+ * Slider names are compared without leading/trailing spaces, and '#' starts a comment.
+**********************************************************************************************/
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+class Gui;
+
+class GuiController
+{
+private:
+	struct Slider
+	{
+		std::string name;
+		float value;
+		float min;
+		float max;
+		float step;
+	};
+	
+	struct ScriptEvent
+	{
+		double time;
+		std::string name;
+		float value;
+	};
+	
+	std::vector<Slider> sliders;
+	std::vector<ScriptEvent> script;	// sorted by time
+	unsigned int next_event = 0;
+	
+public:
+	int setup(Gui* gui, std::string name) { return 0; }
+	
+	int addSlider(std::string name, float value = 0.5f, float min = 0.0f, float max = 1.0f, float step = 0.001f);
+	float getSliderValue(int sliderIndex) const { return sliders[sliderIndex].value; }
+	unsigned int getNumSliders() const { return sliders.size(); }
+	const std::string& getSliderName(int sliderIndex) const { return sliders[sliderIndex].name; }
+	
+	/**
+	 * Host only: moves a slider.
+	 * @param name - name of the slider (leading/trailing spaces are ignored).
+	 * @param value - new value, clamped to the slider range.
+	 * @returns false if there is no slider with this name.
+	**/
+	bool setSliderValue(const std::string& name, float value);
+	
+	/**
+	 * Host only: parses an assignment of the form "<slider name>=<value>" and applies it.
+	 * @returns false if the assignment could not be parsed or the slider does not exist.
+	**/
+	bool applyAssignment(const std::string& assignment);
+	
+	/**
+	 * Host only: loads a script of timed slider assignments (see the format above).
+	 * @returns false if the file could not be read or a line could not be parsed.
+	**/
+	bool loadScript(const std::string& path);
+	
+	/**
+	 * Host only: applies every scripted assignment due at or before the given time.
+	 * @param time - current time in seconds.
+	 * @returns nothing.
+	**/
+	void update(double time);
+};
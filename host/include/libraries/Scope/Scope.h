@@ -0,0 +1,18 @@
+/*********************************************************************************************
+ * Host-side stand-in for the Bela Scope library.
+ * Logged values are discarded; offline tools write their results to WAV files instead.
+**********************************************************************************************/
+
+#pragma once
+
+class Scope
+{
+private:
+	unsigned int num_channels = 0;
+	
+public:
+	void setup(unsigned int numChannels, float sampleRate) { num_channels = numChannels; }
+	void log(double chn1, ...) {}
+	void log(const float* values) {}
+	unsigned int getNumChannels() const { return num_channels; }
+};
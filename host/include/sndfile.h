@@ -0,0 +1,50 @@
+/*********************************************************************************************
+ * Host-side stand-in for libsndfile (<sndfile.h>, installed on the board with the Bela core).
+ * Only the subset used by the Effects class: opening a file for reading, seeking, and reading
+ * interleaved float frames. The files are read by the RIFF/WAVE reader of the host AudioFile
+ * library (see libraries/AudioFile/AudioFile.h), with the same formats.
+**********************************************************************************************/
+
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+
+typedef int64_t sf_count_t;
+
+# define SFM_READ (0x10)
+
+struct SF_INFO
+{
+	sf_count_t frames;
+	int samplerate;
+	int channels;
+	int format;
+	int sections;
+	int seekable;
+};
+
+typedef struct SNDFILE_tag SNDFILE;
+
+/**
+ * Opens a file.
+ * @param path - path of the file.
+ * @param mode - SFM_READ, the only mode of the host build.
+ * @param info - receives the frames, the sample rate and the channels of the file.
+ * @returns the file, or nullptr if it could not be opened.
+**/
+SNDFILE* sf_open(const char* path, int mode, SF_INFO* info);
+int sf_close(SNDFILE* file);
+
+/**
+ * Moves the next frame to read.
+ * @param frames - the frame, relative to 'whence' (SEEK_SET, SEEK_CUR or SEEK_END).
+ * @returns the new position, or -1 if it is outside of the file.
+**/
+sf_count_t sf_seek(SNDFILE* file, sf_count_t frames, int whence);
+
+/**
+ * Reads frames (all of the channels, interleaved) from the current position.
+ * @returns the number of frames read, fewer than 'frames' at the end of the file.
+**/
+sf_count_t sf_readf_float(SNDFILE* file, float* ptr, sf_count_t frames);
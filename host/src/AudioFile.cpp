@@ -0,0 +1,374 @@
+/*********************************************************************************************
+ * Implementation of the host-side AudioFile library (see libraries/AudioFile/AudioFile.h),
+ * and of the subset of libsndfile used by the Effects class (see sndfile.h).
+ * A minimal RIFF/WAVE reader and writer, so the host build has no external dependencies.
+**********************************************************************************************/
+
+#include <libraries/AudioFile/AudioFile.h>
+#include <sndfile.h>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <fstream>
+#include <algorithm>
+
+# define WAVE_FORMAT_PCM (1)
+# define WAVE_FORMAT_IEEE_FLOAT (3)
+# define WAVE_FORMAT_EXTENSIBLE (0xFFFE)
+
+namespace {
+
+struct WavInfo
+{
+	unsigned int format;
+	unsigned int channels;
+	unsigned int sample_rate;
+	unsigned int bits_per_sample;
+	unsigned int block_align;
+	unsigned int frames;
+	std::streamoff data_offset;
+};
+
+uint32_t
+__le32(const unsigned char* p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+uint16_t
+__le16(const unsigned char* p)
+{
+	return p[0] | (p[1] << 8);
+}
+
+// Parses the RIFF chunks up to the 'data' chunk. The stream is left positioned on the first sample.
+bool
+__read_header(std::ifstream& file, WavInfo& info)
+{
+	unsigned char riff[12];
+	if (!file.read((char*)riff, sizeof(riff)) || memcmp(riff, "RIFF", 4) || memcmp(riff + 8, "WAVE", 4))
+		return false;
+	
+	bool have_format = false;
+	unsigned char chunk[8];
+	while (file.read((char*)chunk, sizeof(chunk))) {
+		uint32_t chunk_size = __le32(chunk + 4);
+		
+		if (!memcmp(chunk, "fmt ", 4)) {
+			unsigned char fmt[40] = {0};
+			if (chunk_size < 16 || !file.read((char*)fmt, std::min<uint32_t>(chunk_size, sizeof(fmt))))
+				return false;
+			info.format = __le16(fmt);
+			info.channels = __le16(fmt + 2);
+			info.sample_rate = __le32(fmt + 4);
+			info.block_align = __le16(fmt + 12);
+			info.bits_per_sample = __le16(fmt + 14);
+			if (info.format == WAVE_FORMAT_EXTENSIBLE && chunk_size >= 26)
+				info.format = __le16(fmt + 24);		// first two bytes of the sub-format GUID
+			file.seekg(chunk_size - std::min<uint32_t>(chunk_size, sizeof(fmt)) + (chunk_size & 1), std::ios::cur);
+			have_format = true;
+		}
+		
+		else if (!memcmp(chunk, "data", 4)) {
+			if (!have_format || !info.channels || !info.block_align)
+				return false;
+			bool supported = (info.format == WAVE_FORMAT_PCM && info.bits_per_sample % 8 == 0 &&
+							  info.bits_per_sample >= 8 && info.bits_per_sample <= 32) ||
+							 (info.format == WAVE_FORMAT_IEEE_FLOAT && (info.bits_per_sample == 32 || info.bits_per_sample == 64));
+			if (!supported)
+				return false;
+			info.frames = chunk_size / info.block_align;
+			info.data_offset = file.tellg();
+			return true;
+		}
+		
+		else {
+			// Chunks are word aligned
+			file.seekg(chunk_size + (chunk_size & 1), std::ios::cur);
+		}
+	}
+	return false;
+}
+
+bool
+__open(const std::string& path, std::ifstream& file, WavInfo& info)
+{
+	file.open(path, std::ios::binary);
+	return file && __read_header(file, info);
+}
+
+float
+__decode_sample(const unsigned char* p, const WavInfo& info)
+{
+	if (info.format == WAVE_FORMAT_IEEE_FLOAT) {
+		if (info.bits_per_sample == 32) {
+			float value;
+			memcpy(&value, p, sizeof(value));
+			return value;
+		}
+		double value;
+		memcpy(&value, p, sizeof(value));
+		return value;
+	}
+	
+	switch (info.bits_per_sample) {
+		case 8:
+			return (p[0] - 128) / 128.0f;
+		case 16:
+			return (int16_t)__le16(p) / 32768.0f;
+		case 24:
+			return (int32_t)(__le32(p - 1) & 0xFFFFFF00) / 2147483648.0f;
+		default:
+			return (int32_t)__le32(p) / 2147483648.0f;
+	}
+}
+
+// Decodes whole frames, interleaved. 'raw' holds one byte before the first frame (see __read_frames).
+void
+__decode_frames(const unsigned char* raw, const WavInfo& info, unsigned int frames, float* out)
+{
+	const unsigned int bytes_per_sample = info.bits_per_sample / 8;
+	for (unsigned int f = 0; f < frames; f++) {
+		const unsigned char* frame = raw + 1 + f * info.block_align;
+		for (unsigned int c = 0; c < info.channels; c++)
+			out[f * info.channels + c] = __decode_sample(frame + c * bytes_per_sample, info);
+	}
+}
+
+// Reads frames [start, start + count) of every channel, planar.
+std::vector<std::vector<float>>
+__read_frames(std::ifstream& file, const WavInfo& info, unsigned int start, unsigned int count)
+{
+	std::vector<std::vector<float>> data(info.channels, std::vector<float>(count));
+	file.seekg(info.data_offset + (std::streamoff)start * info.block_align);
+	
+	// Decode a chunk at a time, reading one sample before each so 24 bit samples can be read as 32 bit words
+	const unsigned int chunk_frames = 4096;
+	const unsigned int bytes_per_sample = info.bits_per_sample / 8;
+	std::vector<unsigned char> raw(1 + chunk_frames * info.block_align);
+	
+	for (unsigned int done = 0; done < count; ) {
+		unsigned int frames = std::min(chunk_frames, count - done);
+		if (!file.read((char*)raw.data() + 1, frames * info.block_align)) {
+			frames = file.gcount() / info.block_align;
+			for (auto& channel : data)
+				channel.resize(done + frames);
+			count = done + frames;
+		}
+		for (unsigned int f = 0; f < frames; f++) {
+			const unsigned char* frame = raw.data() + 1 + f * info.block_align;
+			for (unsigned int c = 0; c < info.channels; c++)
+				data[c][done + f] = __decode_sample(frame + c * bytes_per_sample, info);
+		}
+		done += frames;
+	}
+	return data;
+}
+
+void
+__put32(std::vector<unsigned char>& out, uint32_t value)
+{
+	for (int i = 0; i < 4; i++)
+		out.push_back((value >> (8 * i)) & 0xFF);
+}
+
+void
+__put16(std::vector<unsigned char>& out, uint16_t value)
+{
+	out.push_back(value & 0xFF);
+	out.push_back(value >> 8);
+}
+
+} // namespace
+
+namespace AudioFileUtilities
+{
+
+std::vector<std::vector<float>>
+load(const std::string& file, int maxCount, unsigned int start)
+{
+	std::ifstream stream;
+	WavInfo info;
+	if (!__open(file, stream, info) || start > info.frames)
+		return {};
+	
+	unsigned int count = info.frames - start;
+	if (maxCount >= 0)
+		count = std::min(count, (unsigned int)maxCount);
+	return __read_frames(stream, info, start, count);
+}
+
+std::vector<float>
+loadMono(const std::string& file)
+{
+	std::vector<std::vector<float>> data = load(file);
+	if (data.empty())
+		return {};
+	return data[0];
+}
+
+int
+write(const std::string& file, const std::vector<std::vector<float>>& dataIn, unsigned int sampleRate,
+	  unsigned int bitsPerSample)
+{
+	if (dataIn.empty() || (bitsPerSample != 16 && bitsPerSample != 24 && bitsPerSample != 32))
+		return -1;
+	
+	const unsigned int channels = dataIn.size();
+	const unsigned int frames = dataIn[0].size();
+	const unsigned int bytes_per_sample = bitsPerSample / 8;
+	const bool is_float = bitsPerSample == 32;
+	const uint32_t data_size = frames * channels * bytes_per_sample;
+	
+	std::vector<unsigned char> out;
+	out.reserve(58 + data_size);
+	
+	out.insert(out.end(), {'R', 'I', 'F', 'F'});
+	__put32(out, (is_float ? 50 : 36) + data_size);
+	out.insert(out.end(), {'W', 'A', 'V', 'E', 'f', 'm', 't', ' '});
+	__put32(out, is_float ? 18 : 16);
+	__put16(out, is_float ? WAVE_FORMAT_IEEE_FLOAT : WAVE_FORMAT_PCM);
+	__put16(out, channels);
+	__put32(out, sampleRate);
+	__put32(out, sampleRate * channels * bytes_per_sample);
+	__put16(out, channels * bytes_per_sample);
+	__put16(out, bitsPerSample);
+	if (is_float) {
+		__put16(out, 0);	// cbSize
+		out.insert(out.end(), {'f', 'a', 'c', 't'});
+		__put32(out, 4);
+		__put32(out, frames);
+	}
+	out.insert(out.end(), {'d', 'a', 't', 'a'});
+	__put32(out, data_size);
+	
+	for (unsigned int f = 0; f < frames; f++) {
+		for (unsigned int c = 0; c < channels; c++) {
+			float value = f < dataIn[c].size() ? dataIn[c][f] : 0;
+			if (is_float) {
+				uint32_t bits;
+				memcpy(&bits, &value, sizeof(bits));
+				__put32(out, bits);
+				continue;
+			}
+			
+			value = std::min(std::max(value, -1.0f), 1.0f);
+			int32_t quantized = lrintf(value * ((1 << (bitsPerSample - 1)) - 1));
+			for (unsigned int b = 0; b < bytes_per_sample; b++)
+				out.push_back((quantized >> (8 * b)) & 0xFF);
+		}
+	}
+	
+	std::ofstream stream(file, std::ios::binary);
+	if (!stream.write((const char*)out.data(), out.size()))
+		return -1;
+	return 0;
+}
+
+int
+getNumChannels(const std::string& file)
+{
+	std::ifstream stream;
+	WavInfo info;
+	return __open(file, stream, info) ? (int)info.channels : -1;
+}
+
+int
+getNumFrames(const std::string& file)
+{
+	std::ifstream stream;
+	WavInfo info;
+	return __open(file, stream, info) ? (int)info.frames : -1;
+}
+
+int
+getSampleRate(const std::string& file)
+{
+	std::ifstream stream;
+	WavInfo info;
+	return __open(file, stream, info) ? (int)info.sample_rate : -1;
+}
+
+int
+getSamples(const std::string& file, float* buf, unsigned int channel, unsigned int startFrame, unsigned int endFrame)
+{
+	std::ifstream stream;
+	WavInfo info;
+	if (!__open(file, stream, info) || channel >= info.channels || startFrame > endFrame || endFrame > info.frames)
+		return -1;
+	
+	std::vector<std::vector<float>> data = __read_frames(stream, info, startFrame, endFrame - startFrame);
+	if (data[channel].size() != endFrame - startFrame)
+		return -1;
+	std::copy(data[channel].begin(), data[channel].end(), buf);
+	return 0;
+}
+
+} // namespace AudioFileUtilities
+
+struct SNDFILE_tag
+{
+	std::ifstream file;
+	WavInfo info;
+	sf_count_t position;				// next frame to read
+	std::vector<unsigned char> raw;		// one byte, then the frames of the last read
+};
+
+SNDFILE*
+sf_open(const char* path, int mode, SF_INFO* info)
+{
+	if (mode != SFM_READ)
+		return nullptr;
+	SNDFILE* file = new SNDFILE;
+	if (!__open(path, file->file, file->info)) {
+		delete file;
+		return nullptr;
+	}
+	file->position = 0;
+	if (info) {
+		info->frames = file->info.frames;
+		info->samplerate = file->info.sample_rate;
+		info->channels = file->info.channels;
+		info->format = 0;
+		info->sections = 1;
+		info->seekable = 1;
+	}
+	return file;
+}
+
+int
+sf_close(SNDFILE* file)
+{
+	delete file;
+	return 0;
+}
+
+sf_count_t
+sf_seek(SNDFILE* file, sf_count_t frames, int whence)
+{
+	sf_count_t position = frames;
+	if (whence == SEEK_CUR)
+		position += file->position;
+	else if (whence == SEEK_END)
+		position += file->info.frames;
+	if (position < 0 || position > file->info.frames)
+		return -1;
+	
+	file->file.clear();
+	file->file.seekg(file->info.data_offset + (std::streamoff)position * file->info.block_align);
+	file->position = position;
+	return position;
+}
+
+sf_count_t
+sf_readf_float(SNDFILE* file, float* ptr, sf_count_t frames)
+{
+	frames = std::max<sf_count_t>(std::min<sf_count_t>(frames, file->info.frames - file->position), 0);
+	file->raw.resize(1 + frames * file->info.block_align);
+	file->file.read((char*)file->raw.data() + 1, frames * file->info.block_align);
+	frames = file->file.gcount() / file->info.block_align;
+	
+	__decode_frames(file->raw.data(), file->info, frames, ptr);
+	file->position += frames;
+	return frames;
+}
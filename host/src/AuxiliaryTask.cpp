@@ -0,0 +1,78 @@
+/*********************************************************************************************
+ * Implementation of the auxiliary tasks declared in the host-side <Bela.h>.
+**********************************************************************************************/
+
+#include <Bela.h>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+struct HostAuxiliaryTask
+{
+	void (*callback)(void*);
+	void* arg;
+
+	std::mutex mutex;
+	std::condition_variable wake_up;
+	bool scheduled = false;
+	bool stopping = false;
+	std::thread thread;
+
+	void run()
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		while (true) {
+			wake_up.wait(lock, [this] { return scheduled || stopping; });
+			if (stopping)
+				return;
+			scheduled = false;
+			lock.unlock();
+			callback(arg);
+			lock.lock();
+		}
+	}
+};
+
+static std::mutex __tasks_mutex;
+static std::vector<std::unique_ptr<HostAuxiliaryTask>> __tasks;
+
+AuxiliaryTask
+Bela_createAuxiliaryTask(void (*callback)(void*), int priority, const char* name, void* arg)
+{
+	std::unique_ptr<HostAuxiliaryTask> task(new HostAuxiliaryTask);
+	task->callback = callback;
+	task->arg = arg;
+	task->thread = std::thread(&HostAuxiliaryTask::run, task.get());
+
+	std::lock_guard<std::mutex> lock(__tasks_mutex);
+	__tasks.push_back(std::move(task));
+	return __tasks.back().get();
+}
+
+int
+Bela_scheduleAuxiliaryTask(AuxiliaryTask task)
+{
+	HostAuxiliaryTask* aux = static_cast<HostAuxiliaryTask*>(task);
+	{
+		std::lock_guard<std::mutex> lock(aux->mutex);
+		aux->scheduled = true;
+	}
+	aux->wake_up.notify_one();
+	return 0;
+}
+
+void
+Bela_deleteAllAuxiliaryTasks()
+{
+	std::lock_guard<std::mutex> lock(__tasks_mutex);
+	for (auto& task : __tasks) {
+		{
+			std::lock_guard<std::mutex> task_lock(task->mutex);
+			task->stopping = true;
+		}
+		task->wake_up.notify_one();
+		task->thread.join();
+	}
+	__tasks.clear();
+}
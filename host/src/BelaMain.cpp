@@ -0,0 +1,114 @@
+/*********************************************************************************************
+ * Host-side replacement for the Bela core: runs a Bela project (setup/render/cleanup) offline.
+ * Link it with one of the example render files to run or profile the project on the host.
+ * The audio input is read from a WAV file (or is silent), the audio output is written to a WAV file.
+ * Run with -h for usage.
+**********************************************************************************************/
+
+#include <Bela.h>
+#include <libraries/AudioFile/AudioFile.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <getopt.h>
+#include <string>
+
+bool setup(BelaContext* context, void* userData);
+void render(BelaContext* context, void* userData);
+void cleanup(BelaContext* context, void* userData);
+
+static void
+__usage(const char* program)
+{
+	fprintf(stderr,
+			"Usage: %s [options]\n"
+			"  -b, --block N       block size in frames (default 16)\n"
+			"  -r, --rate HZ       sample rate when there is no input file (default 44100)\n"
+			"  -d, --duration SEC  length of the rendering (default: input length, or 10 seconds)\n"
+			"  -i, --input FILE    WAV file fed to the audio input (channel 0)\n"
+			"  -o, --output FILE   WAV file receiving the audio output (default output.wav)\n"
+			"  -c, --channels N    number of audio output channels (default 2)\n",
+			program);
+}
+
+int main(int argc, char* argv[])
+{
+	unsigned int block_size = 16;
+	float sample_rate = 44100;
+	float duration = -1;
+	std::string input_path;
+	std::string output_path = "output.wav";
+	unsigned int out_channels = 2;
+	
+	const struct option options[] = {
+		{"block", required_argument, nullptr, 'b'},
+		{"rate", required_argument, nullptr, 'r'},
+		{"duration", required_argument, nullptr, 'd'},
+		{"input", required_argument, nullptr, 'i'},
+		{"output", required_argument, nullptr, 'o'},
+		{"channels", required_argument, nullptr, 'c'},
+		{"help", no_argument, nullptr, 'h'},
+		{nullptr, 0, nullptr, 0}
+	};
+	
+	int opt;
+	while ((opt = getopt_long(argc, argv, "b:r:d:i:o:c:h", options, nullptr)) != -1) {
+		switch (opt) {
+			case 'b': block_size = atoi(optarg); break;
+			case 'r': sample_rate = atof(optarg); break;
+			case 'd': duration = atof(optarg); break;
+			case 'i': input_path = optarg; break;
+			case 'o': output_path = optarg; break;
+			case 'c': out_channels = atoi(optarg); break;
+			default: __usage(argv[0]); return opt == 'h' ? 0 : 1;
+		}
+	}
+	if (!block_size || !out_channels) {
+		__usage(argv[0]);
+		return 1;
+	}
+	
+	std::vector<float> input;
+	if (!input_path.empty()) {
+		input = AudioFileUtilities::loadMono(input_path);
+		sample_rate = AudioFileUtilities::getSampleRate(input_path);
+		if (input.empty() || sample_rate <= 0) {
+			fprintf(stderr, "Could not read '%s'\n", input_path.c_str());
+			return 1;
+		}
+	}
+	if (duration < 0)
+		duration = input.empty() ? 10 : (float)input.size() / sample_rate;
+	
+	const size_t blocks = (size_t)(duration * sample_rate) / block_size;
+	HostContext host(sample_rate, block_size, 1, out_channels, argv[0]);
+	BelaContext* context = host.get();
+	std::vector<std::vector<float>> output(out_channels, std::vector<float>(blocks * block_size));
+	
+	if (!setup(context, nullptr)) {
+		fprintf(stderr, "setup() failed\n");
+		return 1;
+	}
+	
+	for (size_t b = 0; b < blocks; b++) {
+		size_t first = b * block_size;
+		for (unsigned int n = 0; n < block_size; n++)
+			host.input()[n] = first + n < input.size() ? input[first + n] : 0;
+		
+		render(context, nullptr);
+		
+		for (unsigned int n = 0; n < block_size; n++)
+			for (unsigned int c = 0; c < out_channels; c++)
+				output[c][first + n] = host.output()[n * out_channels + c];
+		host.advance();
+	}
+	
+	Bela_deleteAllAuxiliaryTasks();
+	cleanup(context, nullptr);
+	
+	if (AudioFileUtilities::write(output_path, output, sample_rate)) {
+		fprintf(stderr, "Could not write '%s'\n", output_path.c_str());
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,122 @@
+/*********************************************************************************************
+ * Implementation of the host-side Biquad (see libraries/Biquad/Biquad.h).
+**********************************************************************************************/
+
+#include <libraries/Biquad/Biquad.h>
+#include <cmath>
+
+int
+Biquad::setup(const Settings& settings)
+{
+	Fs = settings.fs;
+	type = settings.type;
+	Q = settings.q;
+	Fc = settings.cutoff / Fs;
+	peakGain = settings.peakGainDb;
+	calc();
+	clean();
+	return 0;
+}
+
+void
+Biquad::calc()
+{
+	double norm;
+	double V = pow(10, fabs(peakGain) / 20.0);
+	double K = tan(M_PI * Fc);
+	
+	switch (type) {
+		case lowpass:
+			norm = 1 / (1 + K / Q + K * K);
+			a0 = K * K * norm;
+			a1 = 2 * a0;
+			a2 = a0;
+			b1 = 2 * (K * K - 1) * norm;
+			b2 = (1 - K / Q + K * K) * norm;
+			break;
+		
+		case highpass:
+			norm = 1 / (1 + K / Q + K * K);
+			a0 = 1 * norm;
+			a1 = -2 * a0;
+			a2 = a0;
+			b1 = 2 * (K * K - 1) * norm;
+			b2 = (1 - K / Q + K * K) * norm;
+			break;
+		
+		case bandpass:
+			norm = 1 / (1 + K / Q + K * K);
+			a0 = K / Q * norm;
+			a1 = 0;
+			a2 = -a0;
+			b1 = 2 * (K * K - 1) * norm;
+			b2 = (1 - K / Q + K * K) * norm;
+			break;
+		
+		case notch:
+			norm = 1 / (1 + K / Q + K * K);
+			a0 = (1 + K * K) * norm;
+			a1 = 2 * (K * K - 1) * norm;
+			a2 = a0;
+			b1 = a1;
+			b2 = (1 - K / Q + K * K) * norm;
+			break;
+		
+		case peak:
+			if (peakGain >= 0) {
+				norm = 1 / (1 + 1/Q * K + K * K);
+				a0 = (1 + V/Q * K + K * K) * norm;
+				a1 = 2 * (K * K - 1) * norm;
+				a2 = (1 - V/Q * K + K * K) * norm;
+				b1 = a1;
+				b2 = (1 - 1/Q * K + K * K) * norm;
+			}
+			else {
+				norm = 1 / (1 + V/Q * K + K * K);
+				a0 = (1 + 1/Q * K + K * K) * norm;
+				a1 = 2 * (K * K - 1) * norm;
+				a2 = (1 - 1/Q * K + K * K) * norm;
+				b1 = a1;
+				b2 = (1 - V/Q * K + K * K) * norm;
+			}
+			break;
+		
+		case lowshelf:
+			if (peakGain >= 0) {
+				norm = 1 / (1 + sqrt(2) * K + K * K);
+				a0 = (1 + sqrt(2*V) * K + V * K * K) * norm;
+				a1 = 2 * (V * K * K - 1) * norm;
+				a2 = (1 - sqrt(2*V) * K + V * K * K) * norm;
+				b1 = 2 * (K * K - 1) * norm;
+				b2 = (1 - sqrt(2) * K + K * K) * norm;
+			}
+			else {
+				norm = 1 / (1 + sqrt(2*V) * K + V * K * K);
+				a0 = (1 + sqrt(2) * K + K * K) * norm;
+				a1 = 2 * (K * K - 1) * norm;
+				a2 = (1 - sqrt(2) * K + K * K) * norm;
+				b1 = 2 * (V * K * K - 1) * norm;
+				b2 = (1 - sqrt(2*V) * K + V * K * K) * norm;
+			}
+			break;
+		
+		case highshelf:
+			if (peakGain >= 0) {
+				norm = 1 / (1 + sqrt(2) * K + K * K);
+				a0 = (V + sqrt(2*V) * K + K * K) * norm;
+				a1 = 2 * (K * K - V) * norm;
+				a2 = (V - sqrt(2*V) * K + K * K) * norm;
+				b1 = 2 * (K * K - 1) * norm;
+				b2 = (1 - sqrt(2) * K + K * K) * norm;
+			}
+			else {
+				norm = 1 / (V + sqrt(2*V) * K + K * K);
+				a0 = (1 + sqrt(2) * K + K * K) * norm;
+				a1 = 2 * (K * K - 1) * norm;
+				a2 = (1 - sqrt(2) * K + K * K) * norm;
+				b1 = 2 * (K * K - V) * norm;
+				b2 = (V - sqrt(2*V) * K + K * K) * norm;
+			}
+			break;
+	}
+}
@@ -0,0 +1,106 @@
+/*********************************************************************************************
+ * Implementation of the host-side GuiController (see libraries/GuiController/GuiController.h).
+**********************************************************************************************/
+
+#include <libraries/GuiController/GuiController.h>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <cstdlib>
+
+static std::string
+__trim(const std::string& str)
+{
+	size_t begin = str.find_first_not_of(" \t\r\n");
+	if (begin == std::string::npos)
+		return "";
+	size_t end = str.find_last_not_of(" \t\r\n");
+	return str.substr(begin, end - begin + 1);
+}
+
+// Splits "<name>=<value>", returns false if the string is not an assignment.
+static bool
+__parse_assignment(const std::string& assignment, std::string& name, float& value)
+{
+	size_t equals = assignment.rfind('=');
+	if (equals == std::string::npos)
+		return false;
+	
+	name = __trim(assignment.substr(0, equals));
+	std::string value_str = __trim(assignment.substr(equals + 1));
+	char* end = nullptr;
+	value = strtof(value_str.c_str(), &end);
+	return !name.empty() && !value_str.empty() && *end == '\0';
+}
+
+int
+GuiController::addSlider(std::string name, float value, float min, float max, float step)
+{
+	sliders.push_back({name, std::min(std::max(value, min), max), min, max, step});
+	return sliders.size() - 1;
+}
+
+bool
+GuiController::setSliderValue(const std::string& name, float value)
+{
+	std::string trimmed = __trim(name);
+	bool found = false;
+	
+	// Several effects may register sliders with the same name, all of them are moved
+	for (Slider& slider : sliders) {
+		if (__trim(slider.name) == trimmed) {
+			slider.value = std::min(std::max(value, slider.min), slider.max);
+			found = true;
+		}
+	}
+	return found;
+}
+
+bool
+GuiController::applyAssignment(const std::string& assignment)
+{
+	std::string name;
+	float value;
+	if (!__parse_assignment(assignment, name, value))
+		return false;
+	return setSliderValue(name, value);
+}
+
+bool
+GuiController::loadScript(const std::string& path)
+{
+	std::ifstream file(path);
+	if (!file)
+		return false;
+	
+	std::string line;
+	while (std::getline(file, line)) {
+		line = __trim(line.substr(0, line.find('#')));
+		if (line.empty())
+			continue;
+		
+		std::istringstream stream(line);
+		ScriptEvent event;
+		if (!(stream >> event.time))
+			return false;
+		std::string assignment;
+		std::getline(stream, assignment);
+		if (!__parse_assignment(assignment, event.name, event.value))
+			return false;
+		script.push_back(event);
+	}
+	
+	std::stable_sort(script.begin(), script.end(),
+					 [](const ScriptEvent& a, const ScriptEvent& b) { return a.time < b.time; });
+	next_event = 0;
+	return true;
+}
+
+void
+GuiController::update(double time)
+{
+	while (next_event < script.size() && script[next_event].time <= time) {
+		setSliderValue(script[next_event].name, script[next_event].value);
+		next_event++;
+	}
+}
@@ -0,0 +1,38 @@
+/*********************************************************************************************
+ * Implementation of the HostContext class declared in the host-side <Bela.h>.
+**********************************************************************************************/
+
+#include <Bela.h>
+#include <cstring>
+
+HostContext::HostContext(float sample_rate, unsigned int block_size, unsigned int in_channels, unsigned int out_channels,
+						 const char* project_name) :
+		audio_in(block_size * in_channels), audio_out(block_size * out_channels)
+{
+	const unsigned int analog_channels = 8;
+	const unsigned int analog_frames = block_size > 1 ? block_size / 2 : 1;
+	analog_in.resize(analog_frames * analog_channels);
+	analog_out.resize(analog_frames * analog_channels);
+	
+	memset(&context, 0, sizeof(context));
+	context.audioIn = audio_in.data();
+	context.audioOut = audio_out.data();
+	context.analogIn = analog_in.data();
+	context.analogOut = analog_out.data();
+	context.audioFrames = block_size;
+	context.audioInChannels = in_channels;
+	context.audioOutChannels = out_channels;
+	context.audioSampleRate = sample_rate;
+	context.analogFrames = analog_frames;
+	context.analogInChannels = analog_channels;
+	context.analogOutChannels = analog_channels;
+	context.analogSampleRate = sample_rate * analog_frames / block_size;
+	strncpy(context.projectName, project_name, MAX_PROJECTNAME_LENGTH - 1);
+}
+
+void
+HostContext::set_analog_input(unsigned int channel, float value)
+{
+	for (unsigned int f = 0; f < context.analogFrames; f++)
+		analog_in[f * context.analogInChannels + channel] = value;
+}
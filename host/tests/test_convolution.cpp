@@ -0,0 +1,128 @@
+/*********************************************************************************************
+ * ConvolutionReverb against a direct convolution (double precision FIR) of random signals:
+ * - responses shorter than the head, on and around the boundaries of the partition stages,
+ *   and several times max_partition long;
+ * - block sizes that are not powers of two (and sample by sample with process());
+ * - reset() in the middle of a signal, after which the output starts from silence again;
+ * - two channels with process_channels().
+ * Returns a non zero exit code if any output is further than the tolerance from the reference.
+**********************************************************************************************/
+
+#include "Effects.h"
+#include <cstdio>
+#include <random>
+
+// Small stages, so the test covers many partitions and stages quickly
+static const unsigned int head_size = 16;
+static const unsigned int max_partition = 256;
+// Error allowed, relative to the largest output sample (float FFTs against a double FIR)
+static const double tolerance = 1e-5;
+
+static unsigned int failures = 0;
+
+static std::vector<float>
+__random_signal(std::mt19937& rng, unsigned int length)
+{
+	std::uniform_real_distribution<float> uniform(-1, 1);
+	std::vector<float> signal(length);
+	for (float& x : signal)
+		x = uniform(rng);
+	return signal;
+}
+
+static std::vector<double>
+__direct_convolution(const std::vector<float>& x, const std::vector<float>& h)
+{
+	std::vector<double> y(x.size(), 0);
+	for (size_t n = 0; n < x.size(); n++) {
+		for (size_t k = 0; k < h.size() && k <= n; k++)
+			y[n] += (double)h[k] * x[n - k];
+	}
+	return y;
+}
+
+static void
+__compare(const char* what, unsigned int length, unsigned int block, const std::vector<float>& y, const std::vector<double>& reference)
+{
+	double peak = 0;
+	double error = 0;
+	for (size_t n = 0; n < y.size(); n++) {
+		peak = std::max(peak, fabs(reference[n]));
+		error = std::max(error, fabs(y[n] - reference[n]));
+	}
+	if (error > tolerance * peak) {
+		printf("FAIL %s: response %u, block %u, error %g (peak %g)\n", what, length, block, error, peak);
+		failures++;
+	}
+}
+
+// Runs a mono signal through the reverb (wet only) in blocks of 'block' samples, 0 for process()
+static std::vector<float>
+__render(ConvolutionReverb& reverb, const std::vector<float>& x, unsigned int block)
+{
+	std::vector<float> y(x.size());
+	if (!block) {
+		for (size_t n = 0; n < x.size(); n++)
+			y[n] = reverb.process(x[n], nullptr);
+		return y;
+	}
+	for (size_t n = 0; n < x.size(); n += block) {
+		unsigned int frames = std::min<size_t>(block, x.size() - n);
+		reverb.process_block(&x[n], &y[n], frames, nullptr);
+	}
+	return y;
+}
+
+int main()
+{
+	HostContext host(48000, 128);
+	std::mt19937 rng(1);
+	ConvolutionReverb::Parameters wet_only;
+	wet_only.mix_percent = 1;
+	
+	// Stages start at 16, 64 (P = 16), 256 (P = 64), then every 256 samples (P = 256)
+	const unsigned int lengths[] = {1, 15, 16, 17, 63, 64, 65, 255, 256, 257, 1000, 2049};
+	const unsigned int blocks[] = {0, 1, 7, 100, 128, 333};
+	
+	for (unsigned int length : lengths) {
+		const std::vector<float> h = __random_signal(rng, length);
+		const std::vector<float> x = __random_signal(rng, 3 * length + 1500);
+		const std::vector<double> reference = __direct_convolution(x, h);
+		
+		for (unsigned int block : blocks) {
+			ConvolutionReverb reverb(host.get(), nullptr, h, 1, head_size, max_partition);
+			reverb.publish(wet_only);
+			__compare("process_block", length, block, __render(reverb, x, block), reference);
+		}
+		
+		// reset() forgets the first signal: the second one must come out as from a new reverb
+		{
+			ConvolutionReverb reverb(host.get(), nullptr, h, 1, head_size, max_partition);
+			reverb.publish(wet_only);
+			const std::vector<float> first = __random_signal(rng, length + 777);
+			__render(reverb, first, 100);
+			reverb.reset();
+			__compare("reset", length, 100, __render(reverb, x, 100), reference);
+		}
+		
+		// Two channels, each with its own state
+		{
+			ConvolutionReverb reverb(host.get(), nullptr, h, 2, head_size, max_partition);
+			reverb.publish(wet_only);
+			const std::vector<float> x2 = __random_signal(rng, x.size());
+			const std::vector<double> reference2 = __direct_convolution(x2, h);
+			std::vector<float> y(x.size()), y2(x.size());
+			for (size_t n = 0; n < x.size(); n += 77) {
+				unsigned int frames = std::min<size_t>(77, x.size() - n);
+				const float* in[2] = {&x[n], &x2[n]};
+				float* out[2] = {&y[n], &y2[n]};
+				reverb.process_channels(in, out, frames, nullptr);
+			}
+			__compare("process_channels left", length, 77, y, reference);
+			__compare("process_channels right", length, 77, y2, reference2);
+		}
+	}
+	
+	printf("%s: %u failure(s)\n", __FILE__, failures);
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,93 @@
+/*********************************************************************************************
+ * AudioFileStream against the whole file loaded with AudioFileUtilities::load:
+ * - a stereo file several times longer than the ring, read in blocks that do not divide the chunks;
+ * - fewer channels than the file (the first ones), and more (the last channel of the file repeats);
+ * - looping (the frames after the end start again from the first one), and the end of a file that
+ *   does not loop (silence, then finished()).
+ * Returns a non zero exit code if any frame differs.
+**********************************************************************************************/
+
+#include "Effects.h"
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <unistd.h>
+
+static const unsigned int file_frames = 50003;
+static const unsigned int buffer_frames = 8192;
+static const unsigned int chunk_frames = 1000;
+static const unsigned int block = 100;
+
+static unsigned int failures = 0;
+
+// Reads 'length' frames from the stream, and compares them with the file ('loop' past its end)
+static void
+__check(const std::string& path, const std::vector<std::vector<float>>& file, unsigned int channels, bool loop,
+		unsigned int length)
+{
+	AudioFileStream stream(path, channels, loop, buffer_frames, chunk_frames);
+	std::vector<std::vector<float>> blocks(channels, std::vector<float>(block));
+	std::vector<float*> out(channels);
+	for (unsigned int c = 0; c < channels; c++)
+		out[c] = blocks[c].data();
+	
+	unsigned int errors = 0;
+	for (unsigned int frame = 0; frame < length; frame += block) {
+		const unsigned int taken = stream.read(out.data(), block);
+		for (unsigned int n = 0; n < block; n++) {
+			const unsigned int position = frame + n;
+			const bool in_file = loop || position < file_frames;
+			if (in_file != (n < taken))
+				errors++;
+			for (unsigned int c = 0; c < channels; c++) {
+				const float expected = in_file ? file[std::min<size_t>(c, file.size() - 1)][position % file_frames] : 0;
+				if (blocks[c][n] != expected)
+					errors++;
+			}
+		}
+	}
+	if (errors) {
+		printf("FAIL %u channel(s), loop %d: %u sample(s) differ from the file\n", channels, loop, errors);
+		failures++;
+	}
+	if (!loop && !stream.finished()) {
+		printf("FAIL %u channel(s): not finished after the end of the file\n", channels);
+		failures++;
+	}
+}
+
+int main()
+{
+	char path[] = "/tmp/test_file_stream_XXXXXX";
+	int fd = mkstemp(path);
+	if (fd < 0) {
+		printf("FAIL could not create a file\n");
+		return 1;
+	}
+	close(fd);
+	
+	std::mt19937 rng(1);
+	std::uniform_real_distribution<float> uniform(-1, 1);
+	std::vector<std::vector<float>> samples(2, std::vector<float>(file_frames));
+	for (std::vector<float>& channel : samples) {
+		for (float& x : channel)
+			x = uniform(rng);
+	}
+	// Read back, so the reference has the rounding of the 24 bit samples
+	const std::vector<std::vector<float>> file = AudioFileUtilities::write(path, samples, 48000, 24) == 0 ?
+												 AudioFileUtilities::load(path) : std::vector<std::vector<float>>();
+	if (file.size() != 2 || file[0].size() != file_frames) {
+		printf("FAIL could not write and load '%s'\n", path);
+		unlink(path);
+		return 1;
+	}
+	
+	for (unsigned int channels : {1u, 2u, 3u}) {
+		__check(path, file, channels, true, 3 * file_frames + 5 * block);
+		__check(path, file, channels, false, file_frames + 20 * block);
+	}
+	
+	unlink(path);
+	printf("%s: %u failure(s)\n", __FILE__, failures);
+	return failures ? 1 : 0;
+}
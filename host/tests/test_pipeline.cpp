@@ -0,0 +1,143 @@
+/*********************************************************************************************
+ * PipelineExecutor against the serial chain: the same effects (built twice, the same way) render
+ * the same stereo signal, with a script that moves the sliders while rendering, once in an
+ * EffectChain and once split into pipeline stages. The outputs must be bit-identical, for several
+ * stage splits, latencies and block sizes (including blocks that do not divide the signal).
+ * Returns a non zero exit code if any output differs.
+**********************************************************************************************/
+
+#include "EffectFactory.h"
+#include "PipelineExecutor.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <unistd.h>
+
+static const unsigned int channels = 2;
+static const int sample_rate = 48000;
+
+static unsigned int failures = 0;
+
+// The effects of a chain, built with their own controller (the same sliders every time)
+struct EffectSet
+{
+	GuiController controller;
+	std::vector<std::unique_ptr<Effects>> effects;
+	
+	EffectSet(BelaContext* context, const std::vector<std::string>& names, const std::string& script)
+	{
+		for (const std::string& name : names)
+			effects.emplace_back(create_effect(name, context, &controller, channels));
+		controller.applyAssignment("Gain=20");
+		if (!controller.loadScript(script)) {
+			printf("FAIL could not load the script '%s'\n", script.c_str());
+			exit(1);
+		}
+	}
+};
+
+static std::vector<std::vector<float>>
+__render_serial(BelaContext* context, const std::vector<std::string>& names, const std::string& script,
+				const std::vector<std::vector<float>>& input, unsigned int block)
+{
+	EffectSet set(context, names, script);
+	EffectChain chain(context, names.size(), channels);
+	for (std::unique_ptr<Effects>& effect : set.effects)
+		chain.add(effect.get());
+	
+	const size_t length = input[0].size();
+	std::vector<std::vector<float>> output(channels, std::vector<float>(length));
+	for (size_t frame = 0; frame < length; frame += block) {
+		unsigned int frames = std::min<size_t>(block, length - frame);
+		const float* in[channels] = {&input[0][frame], &input[1][frame]};
+		float* out[channels] = {&output[0][frame], &output[1][frame]};
+		set.controller.update((double)frame / sample_rate);
+		chain.process_channels(in, out, frames, &set.controller);
+	}
+	return output;
+}
+
+// 'split' is the number of effects in every stage
+static std::vector<std::vector<float>>
+__render_pipeline(BelaContext* context, const std::vector<std::string>& names, const std::string& script,
+				  const std::vector<std::vector<float>>& input, unsigned int block,
+				  const std::vector<unsigned int>& split, unsigned int latency)
+{
+	EffectSet set(context, names, script);
+	std::vector<std::unique_ptr<EffectChain>> stages;
+	PipelineExecutor executor(context, channels, latency);
+	unsigned int next = 0;
+	for (unsigned int count : split) {
+		stages.emplace_back(new EffectChain(context, count, channels));
+		for (unsigned int i = 0; i < count; i++)
+			stages.back()->add(set.effects[next++].get());
+		executor.add_stage(stages.back().get());
+	}
+	executor.start(&set.controller);
+	
+	const size_t length = input[0].size();
+	std::vector<std::vector<float>> output(channels, std::vector<float>(length));
+	size_t output_frame = 0;
+	for (size_t frame = 0; frame < length || executor.in_flight(); ) {
+		if (frame < length && executor.in_flight() < executor.get_latency()) {
+			unsigned int frames = std::min<size_t>(block, length - frame);
+			const float* in[channels] = {&input[0][frame], &input[1][frame]};
+			executor.push(in, frames, (double)frame / sample_rate);
+			frame += frames;
+			continue;
+		}
+		float* out[channels] = {&output[0][output_frame], &output[1][output_frame]};
+		output_frame += executor.pop(out);
+	}
+	if (output_frame != length) {
+		printf("FAIL pipeline returned %zu frames instead of %zu\n", output_frame, length);
+		failures++;
+	}
+	return output;
+}
+
+int main()
+{
+	// Sliders move during the render, so every stage must see them change at the same block as the serial chain
+	char script[] = "/tmp/test_pipeline_XXXXXX";
+	int fd = mkstemp(script);
+	const char* lines = "0 Gain = 20\n0.1 Mix Percentage = 0.8\n0.25 Gain = 5\n0.3 FDN Mix = 0.7\n0.4 Distortion/Overdrive = 1\n";
+	if (fd < 0 || write(fd, lines, strlen(lines)) != (ssize_t)strlen(lines)) {
+		printf("FAIL could not write the script\n");
+		return 1;
+	}
+	close(fd);
+	
+	std::mt19937 rng(1);
+	std::uniform_real_distribution<float> uniform(-0.5, 0.5);
+	std::vector<std::vector<float>> input(channels, std::vector<float>(sample_rate / 2));
+	for (std::vector<float>& channel : input) {
+		for (float& x : channel)
+			x = uniform(rng);
+	}
+	
+	const std::vector<std::string> names = {"distortion", "wahwah", "densereverb", "fdn-16"};
+	const std::vector<std::vector<unsigned int>> splits = {{4}, {2, 2}, {1, 3}, {1, 1, 1, 1}};
+	const unsigned int blocks[] = {16, 7, 128};
+	const unsigned int latencies[] = {0, 1, 3};
+	
+	for (unsigned int block : blocks) {
+		HostContext host(sample_rate, block);
+		const std::vector<std::vector<float>> serial = __render_serial(host.get(), names, script, input, block);
+		for (const std::vector<unsigned int>& split : splits) {
+			for (unsigned int latency : latencies) {
+				if (__render_pipeline(host.get(), names, script, input, block, split, latency) != serial) {
+					printf("FAIL block %u, %zu stages, latency %u: output differs from the serial chain\n",
+						   block, split.size(), latency);
+					failures++;
+				}
+			}
+		}
+	}
+	
+	unlink(script);
+	printf("%s: %u failure(s)\n", __FILE__, failures);
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,142 @@
+/*********************************************************************************************
+ * Quality tiers of the reverbs (what the LoadGovernor switches while they run):
+ * - a switch in the middle of a tail keeps the tail going (no dropout) and does not make it louder
+ *   than before the switch (no burst), in both directions;
+ * - once the lines have mixed again (100 ms after the switch), the tail decays at the reverb time
+ *   of the sliders, at both tiers;
+ * - back at tier 0 after a reset(), the output is the same as the output of a new reverb.
+ * Returns a non zero exit code if any check fails.
+**********************************************************************************************/
+
+#include "Effects.h"
+#include <cmath>
+#include <cstdio>
+#include <memory>
+#include <random>
+
+static const int sample_rate = 48000;
+static const unsigned int block = 64;
+static const float reverb_time = 3000;		// ms
+
+static unsigned int failures = 0;
+
+// A burst of noise followed by silence, so the end of the signal is the tail of the reverb
+static std::vector<float>
+__burst(unsigned int length)
+{
+	std::mt19937 rng(1);
+	std::uniform_real_distribution<float> uniform(-0.5, 0.5);
+	std::vector<float> signal(length, 0);
+	for (unsigned int n = 0; n < sample_rate / 20; n++)
+		signal[n] = uniform(rng);
+	return signal;
+}
+
+// Renders the signal (wet only), switching to 'tier' at sample 'switch_at'
+static std::vector<float>
+__render(Effects& reverb, const std::vector<float>& x, unsigned int switch_at, unsigned int tier)
+{
+	std::vector<float> y(x.size());
+	for (size_t n = 0; n < x.size(); n += block) {
+		if (n == switch_at)
+			reverb.set_quality(tier);
+		reverb.process_block(&x[n], &y[n], std::min<size_t>(block, x.size() - n), nullptr);
+	}
+	return y;
+}
+
+static double
+__rms(const std::vector<float>& y, unsigned int from, unsigned int length)
+{
+	double sum = 0;
+	for (unsigned int n = from; n < from + length; n++)
+		sum += (double)y[n] * y[n];
+	return sqrt(sum / length);
+}
+
+static void
+__check(const char* name, Effects& reverb, Effects& fresh)
+{
+	if (reverb.get_quality_tiers() != 2) {
+		printf("FAIL %s: %u quality tiers instead of 2\n", name, reverb.get_quality_tiers());
+		failures++;
+		return;
+	}
+	
+	// The tail after the burst, with a switch at 0.5 s: 20 ms windows before and after it
+	const std::vector<float> x = __burst(sample_rate);
+	const unsigned int switch_at = sample_rate / 2;
+	const unsigned int window = sample_rate / 50;
+	for (unsigned int tier : {1u, 0u}) {
+		reverb.set_quality(1 - tier);
+		reverb.reset();
+		const std::vector<float> y = __render(reverb, x, switch_at, tier);
+		const double before = __rms(y, switch_at - window, window);
+		const double after = __rms(y, switch_at, window);
+		const double settled = __rms(y, switch_at + sample_rate / 10, window);
+		const double later = __rms(y, switch_at + sample_rate / 10 + sample_rate / 4, window);
+		float peak = 0;
+		for (unsigned int n = switch_at; n < x.size(); n++)
+			peak = std::max(peak, fabsf(y[n]));
+		if (!std::isfinite(after) || after < 0.25 * before || after > 2 * before) {
+			printf("FAIL %s: tier %u -> %u, rms %g before the switch, %g after\n", name, 1 - tier, tier, before, after);
+			failures++;
+		}
+		if (peak > 4 * before * sqrt(2.0) + 1e-3) {
+			printf("FAIL %s: tier %u -> %u, peak %g after the switch (rms %g before)\n", name, 1 - tier, tier, peak, before);
+			failures++;
+		}
+		// -60 dB in reverb_time, within a factor of 2
+		const double expected = pow(0.001, 250 / reverb_time);
+		if (later < 0.5 * expected * settled || later > 2 * expected * settled) {
+			printf("FAIL %s: tier %u, the tail decays by %g in 250 ms instead of %g\n", name, tier, later / settled, expected);
+			failures++;
+		}
+	}
+	
+	// The last render ended at tier 0: after a reset it must be a new reverb again
+	reverb.reset();
+	if (__render(reverb, x, x.size(), 0) != __render(fresh, x, x.size(), 0)) {
+		printf("FAIL %s: tier 0 after tier 1 differs from a new reverb\n", name);
+		failures++;
+	}
+}
+
+int main()
+{
+	HostContext host(sample_rate, block);
+	
+	{
+		Reverb::Parameters p;
+		p.reverb_time = reverb_time;
+		p.mix_percent = 1;
+		Reverb reverb(host.get(), nullptr, 8), fresh(host.get(), nullptr, 8);
+		reverb.publish(p);
+		fresh.publish(p);
+		__check("densereverb", reverb, fresh);
+	}
+	
+	for (unsigned int lines : {8u, 16u, 32u}) {
+		FdnReverb::Parameters p;
+		p.reverb_time = reverb_time;
+		p.mix_percent = 1;
+		FdnReverb reverb(host.get(), nullptr, lines), fresh(host.get(), nullptr, lines);
+		reverb.publish(p);
+		fresh.publish(p);
+		char name[16];
+		snprintf(name, sizeof(name), "fdn-%u", lines);
+		__check(name, reverb, fresh);
+		if (reverb.get_line_count() != lines) {
+			printf("FAIL %s: %u lines at tier 0\n", name, reverb.get_line_count());
+			failures++;
+		}
+		reverb.set_quality(1);
+		if (reverb.get_line_count() != lines / 2) {
+			printf("FAIL %s: %u lines at tier 1\n", name, reverb.get_line_count());
+			failures++;
+		}
+	}
+	
+	printf("%s: %u failure(s)\n", __FILE__, failures);
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,90 @@
+/*********************************************************************************************
+ * Fractional reads of MirroredRingBuffer against the analytic signal: a 1 kHz sine at 48 kHz is
+ * written a block at a time and read back through a delay swept from 100 to 500 samples, so
+ * out[n] must be sin(w * (n - delay[n])). Blocks of 16 and 13 frames (a partial group of 4).
+ * Also checks the edge cases: a read of 0 frames, and get_max_delay() of a block that fills the ring.
+ * Returns a non zero exit code if any error is above the bound of its interpolation.
+**********************************************************************************************/
+
+#include "Effects.h"
+#include <cmath>
+#include <cstdio>
+
+static const double sample_rate = 48000;
+static const double frequency = 1000;
+static const unsigned int length = 48000;
+static const unsigned int capacity = 1024;
+
+static unsigned int failures = 0;
+
+enum Interpolation
+{
+	LINEAR,
+	CUBIC,
+	ALLPASS
+};
+
+static const char* const names[] = {"read_linear", "read_cubic", "read_allpass"};
+// Largest error allowed (in dB from the amplitude of the sine), a few dB above the measured ones
+static const double bounds_db[] = {-50, -90, -60};
+
+static void
+__check(Interpolation interpolation, unsigned int block)
+{
+	const double w = 2 * M_PI * frequency / sample_rate;
+	MirroredRingBuffer<float> ring(capacity);
+	std::vector<float> in(block), delays(block), out(block);
+	float state = 0;
+	double error = 0;
+	
+	for (unsigned int frame = 0; frame + block <= length; frame += block) {
+		for (unsigned int n = 0; n < block; n++) {
+			const unsigned int t = frame + n;
+			in[n] = sin(w * t);
+			delays[n] = 100 + 400 * (double)t / length;
+		}
+		ring.write_block(in.data(), block);
+		switch (interpolation) {
+			case LINEAR: ring.read_linear(delays.data(), out.data(), block); break;
+			case CUBIC: ring.read_cubic(delays.data(), out.data(), block); break;
+			case ALLPASS: ring.read_allpass(delays.data(), out.data(), block, state); break;
+		}
+		
+		// Until the delay line is full (and the allpass state has settled), the reads see silence
+		if (frame < 1000)
+			continue;
+		for (unsigned int n = 0; n < block; n++)
+			error = std::max(error, fabs(out[n] - sin(w * (frame + n - (double)delays[n]))));
+	}
+	
+	const double error_db = 20 * log10(error);
+	if (!(error_db <= bounds_db[interpolation])) {
+		printf("FAIL %s, block %u: error %.1f dB (bound %.1f dB)\n", names[interpolation], block, error_db, bounds_db[interpolation]);
+		failures++;
+	}
+}
+
+int main()
+{
+	for (unsigned int block : {16u, 13u}) {
+		__check(LINEAR, block);
+		__check(CUBIC, block);
+		__check(ALLPASS, block);
+	}
+	
+	// Edge cases: no frames to read, and blocks that leave no room for any delay
+	MirroredRingBuffer<float> ring(16);
+	const float delay = 1;
+	float out = 0, state = 0;
+	ring.read_linear(&delay, &out, 0);
+	ring.read_cubic(&delay, &out, 0);
+	ring.read_allpass(&delay, &out, 0, state);
+	if (ring.get_max_delay(13) != 1 || ring.get_max_delay(14) != 0 || ring.get_max_delay(16) != 0) {
+		printf("FAIL get_max_delay: %u, %u, %u for blocks of 13, 14, 16 in 16 samples\n",
+			   ring.get_max_delay(13), ring.get_max_delay(14), ring.get_max_delay(16));
+		failures++;
+	}
+	
+	printf("%s: %u failure(s)\n", __FILE__, failures);
+	return failures ? 1 : 0;
+}
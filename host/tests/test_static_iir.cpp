@@ -0,0 +1,63 @@
+/*********************************************************************************************
+ * StaticIIRFilter against IIRFilter built from the same FilterElement arrays (the delays mean the same):
+ * - the one pole lowpass of lowpass_iir.cpp (output delay 0) and the allpass of the benchmark (D = 5 ms);
+ * - sample by sample with process(), and in blocks that do not divide the history.
+ * Returns a non zero exit code if any output differs.
+**********************************************************************************************/
+
+#include "Effects.h"
+#include <cstdio>
+#include <random>
+
+static const unsigned int length = 10000;
+static const unsigned int block = 77;
+
+static unsigned int failures = 0;
+
+template <unsigned int InputTaps, unsigned int OutputTaps, unsigned int HistorySize>
+static void
+__check(const char* name, const std::array<FilterElement, InputTaps>& input_elements,
+		const std::array<FilterElement, OutputTaps>& output_elements)
+{
+	std::mt19937 rng(1);
+	std::uniform_real_distribution<float> uniform(-1, 1);
+	std::vector<float> x(length);
+	for (float& sample : x)
+		sample = uniform(rng);
+	
+	std::array<FilterElement, InputTaps> inputs = input_elements;
+	std::array<FilterElement, OutputTaps> outputs = output_elements;
+	IIRFilter reference(InputTaps, inputs.data(), OutputTaps, outputs.data());
+	StaticIIRFilter<InputTaps, OutputTaps, HistorySize> sample_filter(input_elements, output_elements);
+	StaticIIRFilter<InputTaps, OutputTaps, HistorySize> block_filter(input_elements, output_elements);
+	
+	std::vector<float> expected(length), y(length);
+	reference.process(x.data(), expected.data(), length);
+	for (size_t n = 0; n < length; n += block)
+		block_filter.process(&x[n], &y[n], std::min<size_t>(block, length - n));
+	
+	unsigned int errors = 0;
+	for (unsigned int n = 0; n < length; n++) {
+		if (sample_filter.process(x[n]) != expected[n])
+			errors++;
+		if (y[n] != expected[n])
+			errors++;
+	}
+	if (errors) {
+		printf("FAIL %s: %u sample(s) differ from IIRFilter\n", name, errors);
+		failures++;
+	}
+}
+
+int main()
+{
+	const float a = 0.99;
+	__check<1, 1, 2>("lowpass", {{ {0, 1 - a} }}, {{ {0, -a} }});
+	
+	const float g = pow(0.001, 5 / 96.83);
+	const unsigned int D = 5 * 48;
+	__check<2, 1, 256>("allpass", {{ {0, -g}, {D, 1} }}, {{ {D, -g} }});
+	
+	printf("%s: %u failure(s)\n", __FILE__, failures);
+	return failures ? 1 : 0;
+}
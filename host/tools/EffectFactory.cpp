@@ -0,0 +1,68 @@
+/*********************************************************************************************
+ * Implementation of the host tools effect factory.
+**********************************************************************************************/
+
+#include "EffectFactory.h"
+#include <sstream>
+
+// Exponentially decaying white noise, a rough model of a room response (-60dB after 'seconds')
+static std::vector<float>
+__synthetic_impulse_response(float sample_rate, float seconds)
+{
+	std::vector<float> response((size_t)(seconds * sample_rate));
+	const float decay = logf(0.001f) / response.size();
+	uint32_t seed = 987654321;
+	for (size_t n = 0; n < response.size(); n++) {
+		seed = seed * 1664525 + 1013904223;
+		response[n] = ((int32_t)seed / 2147483648.0f) * expf(decay * n) * 0.05f;
+	}
+	return response;
+}
+
+Effects*
+create_effect(const std::string& name, BelaContext* context, GuiController* controller, unsigned int channels)
+{
+	if (name == "distortion")
+		return new Distortion(context, controller, Waveshaper::EXPONENTIAL_SOFT_CLIP, nullptr, channels);
+	if (name == "distortion-2x")
+		return new Distortion(context, controller, Waveshaper::EXPONENTIAL_SOFT_CLIP, nullptr, channels, 2);
+	if (name == "wahwah")
+		return new WahWah(context, controller, WahWah::CONTROL_RATE, 16, channels);
+	if (name == "wahwah-exact")
+		return new WahWah(context, controller, WahWah::PER_SAMPLE, 16, channels);
+	if (name == "wahwah-table")
+		return new WahWah(context, controller, WahWah::TABLE, 16, channels);
+	if (name == "reverb")
+		return new Reverb(context, controller, 4, channels);
+	if (name == "densereverb")
+		return new Reverb(context, controller, 8, channels);
+	if (name == "convolution")
+		return new ConvolutionReverb(context, controller, __synthetic_impulse_response(context->audioSampleRate, 2), channels);
+	if (name == "fdn")
+		return new FdnReverb(context, controller, 8, std::vector<float>(), channels);
+	if (name == "fdn-16")
+		return new FdnReverb(context, controller, 16, std::vector<float>(), channels);
+	return nullptr;
+}
+
+bool
+parse_effect_list(const std::string& list, std::vector<std::string>& names)
+{
+	const std::string known = "," + known_effect_names() + ",";
+	std::istringstream stream(list);
+	std::string name;
+	
+	names.clear();
+	while (std::getline(stream, name, ',')) {
+		if (known.find("," + name + ",") == std::string::npos)
+			return false;
+		names.push_back(name);
+	}
+	return !names.empty();
+}
+
+std::string
+known_effect_names()
+{
+	return "distortion,distortion-2x,wahwah,wahwah-exact,wahwah-table,reverb,densereverb,convolution,fdn,fdn-16";
+}
@@ -0,0 +1,33 @@
+/*********************************************************************************************
+ * Creates Effects by name, so the offline tools can build any chain from the command line.
+ * Known names: distortion, wahwah (control rate coefficients), wahwah-exact (per sample coefficients),
+ * wahwah-table (table based coefficients), reverb, densereverb (Reverb with 8 combs),
+ * convolution (ConvolutionReverb with a synthetic 2 seconds room response).
+**********************************************************************************************/
+
+#pragma once
+
+#include "Effects.h"
+#include <string>
+#include <vector>
+
+/**
+ * Creates an effect.
+ * @param name - name of the effect (see above).
+ * @param context - the (host) Bela context the effect will run with.
+ * @param controller - the gui controller the effect adds its sliders to.
+ * @param channels - number of channels the effect processes with process_channels().
+ * @returns the new effect (to be deleted by the caller) or nullptr if the name is unknown.
+**/
+Effects* create_effect(const std::string& name, BelaContext* context, GuiController* controller, unsigned int channels = 1);
+
+/**
+ * Splits a comma separated list of effect names, e.g. "distortion,wahwah,reverb".
+ * @param list - the list.
+ * @param names - receives the names.
+ * @returns false if one of the names is unknown.
+**/
+bool parse_effect_list(const std::string& list, std::vector<std::string>& names);
+
+// The names create_effect() accepts, for usage messages.
+std::string known_effect_names();
@@ -0,0 +1,144 @@
+/*********************************************************************************************
+ * Implementation of the pipeline executor.
+**********************************************************************************************/
+
+#include "PipelineExecutor.h"
+#include <algorithm>
+#include <cassert>
+
+// Attempts to read an empty queue before sleeping: a block that is about to come is taken without
+// the cost of a wake up, a stage that waits longer than that does not use the CPU
+static const unsigned int spin_attempts = 1000;
+
+PipelineExecutor::PipelineExecutor(BelaContext* context, unsigned int channels, unsigned int latency) :
+	channels(channels), block_size(context->audioFrames), latency(latency), stopping(false), pushed(0), popped(0)
+{
+}
+
+PipelineExecutor::~PipelineExecutor()
+{
+	stopping.store(true, std::memory_order_release);
+	for (std::unique_ptr<Queue>& queue : queues) {
+		std::lock_guard<std::mutex> lock(queue->mutex);
+		queue->ready.notify_all();
+	}
+	for (Stage& stage : stages) {
+		if (stage.thread.joinable())
+			stage.thread.join();
+	}
+}
+
+void
+PipelineExecutor::add_stage(Effects* stage)
+{
+	assert(queues.empty());
+	assert(stage->get_channels() == channels);
+	stages.push_back(Stage{stage, nullptr, std::thread()});
+}
+
+void
+PipelineExecutor::start(const GuiController* controller)
+{
+	assert(queues.empty() && !stages.empty());
+	if (!latency)
+		latency = 2 * stages.size();
+	
+	// Every block in flight has its own buffer, so the stages process them in place and a
+	// queue never holds more than 'latency' indices
+	samples.assign((size_t)latency * channels * block_size, 0);
+	for (unsigned int i = 0; i < latency; i++) {
+		blocks.push_back(Block{&samples[(size_t)i * channels * block_size], 0, 0});
+		free_blocks.push_back(latency - 1 - i);
+	}
+	for (unsigned int i = 0; i <= stages.size(); i++)
+		queues.emplace_back(new Queue(latency));
+	
+	for (unsigned int i = 0; i < stages.size(); i++) {
+		if (controller)
+			stages[i].controller.reset(new GuiController(*controller));
+		stages[i].thread = std::thread(&PipelineExecutor::run, this, i);
+	}
+}
+
+void
+PipelineExecutor::push(const float* const* in, unsigned int frames, double time)
+{
+	assert(!free_blocks.empty() && frames <= block_size);
+	const unsigned int index = free_blocks.back();
+	free_blocks.pop_back();
+	
+	Block& block = blocks[index];
+	for (unsigned int c = 0; c < channels; c++)
+		std::copy(in[c], in[c] + frames, block.samples + c * block_size);
+	block.frames = frames;
+	block.time = time;
+	
+	send(*queues.front(), index);
+	pushed++;
+}
+
+unsigned int
+PipelineExecutor::pop(float* const* out)
+{
+	if (!in_flight())
+		return 0;
+	
+	unsigned int index;
+	if (!receive(*queues.back(), index))
+		return 0;
+	
+	const Block& block = blocks[index];
+	for (unsigned int c = 0; c < channels; c++)
+		std::copy(block.samples + c * block_size, block.samples + c * block_size + block.frames, out[c]);
+	free_blocks.push_back(index);
+	popped++;
+	return block.frames;
+}
+
+void
+PipelineExecutor::run(unsigned int stage_index)
+{
+	Stage& stage = stages[stage_index];
+	Queue& input = *queues[stage_index];
+	Queue& output = *queues[stage_index + 1];
+	std::vector<float*> pointers(channels);
+	
+	unsigned int index;
+	while (receive(input, index)) {
+		Block& block = blocks[index];
+		for (unsigned int c = 0; c < channels; c++)
+			pointers[c] = block.samples + c * block_size;
+		// The stage sees the sliders the serial chain would have seen for this block
+		if (stage.controller)
+			stage.controller->update(block.time);
+		stage.effect->process_channels(pointers.data(), pointers.data(), block.frames, stage.controller.get());
+		
+		send(output, index);
+	}
+}
+
+void
+PipelineExecutor::send(Queue& queue, unsigned int index)
+{
+	// Cannot fail: at most 'latency' blocks exist
+	queue.ring.write(&index, 1);
+	// The consumer tests the ring with the mutex held before it sleeps, so taking the mutex here
+	// means it either sees the block or is already waiting for the notification
+	std::lock_guard<std::mutex> lock(queue.mutex);
+	queue.ready.notify_one();
+}
+
+bool
+PipelineExecutor::receive(Queue& queue, unsigned int& index)
+{
+	for (unsigned int attempt = 0; attempt < spin_attempts; attempt++) {
+		if (queue.ring.read(&index, 1))
+			return true;
+		if (stopping.load(std::memory_order_acquire))
+			return false;
+	}
+	
+	std::unique_lock<std::mutex> lock(queue.mutex);
+	queue.ready.wait(lock, [&] { return queue.ring.available() > 0 || stopping.load(std::memory_order_acquire); });
+	return queue.ring.read(&index, 1) == 1;
+}
@@ -0,0 +1,118 @@
+/*********************************************************************************************
+ * Pipeline-parallel execution of a chain of effects, for offline and server rendering.
+ * The chain is split into stages (usually EffectChains, e.g. Distortion and WahWah in one and
+ * Reverb in another), and every stage runs on its own thread. Blocks travel from stage to stage
+ * through lock-free SPSC queues (SpscRingBuffer of block indices), so while one stage processes
+ * block n the next one processes block n - 1, and a single stream scales past one core.
+ * A thread that finds its queue empty polls it briefly, then sleeps on a condition variable until
+ * the previous stage hands it a block, so an idle pipeline does not keep any core busy.
+ * Every stage processes the same blocks, in the same order and with the same slider values as
+ * a serial chain would (a stage replays the controller's script on its own copy of the controller
+ * at the time of every block), so the output is bit-identical to the serial chain.
+ * The price is latency: up to 'latency' blocks are in flight, and a block pushed into the pipeline
+ * comes out when 'latency' more blocks have been pushed (or when the pipeline is drained).
+ * At least one block per stage is needed for all of the stages to run at the same time, and a
+ * second one per stage lets a stage run ahead while the next one is busy with a longer block.
+**********************************************************************************************/
+
+#pragma once
+
+#include "Effects.h"
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class PipelineExecutor
+{
+public:
+	/**
+	 * @param context - the (host) Bela context, its audioFrames is the largest block size.
+	 * @param channels - number of channels, every stage must have as many.
+	 * @param latency - maximum number of blocks in flight, 0 for two blocks per stage.
+	**/
+	PipelineExecutor(BelaContext* context, unsigned int channels = 1, unsigned int latency = 0);
+	// Stops the stage threads (the blocks still in flight are dropped).
+	~PipelineExecutor();
+	
+	/**
+	 * Appends a stage, before start(). The stage is not owned by the executor.
+	 * @param stage - the effect (usually an EffectChain) processed by the new stage's thread.
+	 * @returns nothing.
+	**/
+	void add_stage(Effects* stage);
+	
+	/**
+	 * Starts one thread per stage.
+	 * @param controller - the gui controller of the effects, or nullptr to process them with their
+	 *                     published parameters. Every stage gets its own copy, taken now, so the
+	 *                     sliders must be set (and the script loaded) before.
+	 * @returns nothing.
+	**/
+	void start(const GuiController* controller = nullptr);
+	
+	/**
+	 * Pushes a block into the first stage. Only when fewer than get_latency() blocks are in flight.
+	 * @param in - one pointer per channel.
+	 * @param frames - number of frames, at most the context's audioFrames.
+	 * @param time - time of the block in seconds, the stages update their controllers to it.
+	 * @returns nothing.
+	**/
+	void push(const float* const* in, unsigned int frames, double time);
+	
+	/**
+	 * Takes the oldest block in flight out of the last stage, waiting for it if needed.
+	 * @param out - one pointer per channel.
+	 * @returns the number of frames of the block, 0 if no block is in flight.
+	**/
+	unsigned int pop(float* const* out);
+	
+	unsigned int in_flight() const { return pushed - popped; }
+	unsigned int get_latency() const { return latency; }
+	unsigned int get_stage_count() const { return stages.size(); }
+	
+private:
+	struct Block
+	{
+		float* samples;			// channels * block_size, planar
+		unsigned int frames;
+		double time;
+	};
+	
+	// A queue of block indices, with what its consumer needs to sleep until it is not empty
+	struct Queue
+	{
+		SpscRingBuffer<unsigned int> ring;
+		std::mutex mutex;
+		std::condition_variable ready;
+		
+		Queue(unsigned int capacity) : ring(capacity) {}
+	};
+	
+	struct Stage
+	{
+		Effects* effect;
+		std::unique_ptr<GuiController> controller;	// the stage's copy, null without a controller
+		std::thread thread;
+	};
+	
+	unsigned int channels;
+	unsigned int block_size;
+	unsigned int latency;
+	std::vector<float> samples;
+	std::vector<Block> blocks;
+	std::vector<unsigned int> free_blocks;		// only used by the thread calling push() and pop()
+	std::vector<Stage> stages;
+	// queues[i] feeds stage i, the last queue returns the blocks to pop()
+	std::vector<std::unique_ptr<Queue>> queues;
+	std::atomic<bool> stopping;
+	unsigned int pushed;
+	unsigned int popped;
+	
+	void run(unsigned int stage);
+	// Hands a block to the consumer of a queue, and wakes it up if it sleeps.
+	void send(Queue& queue, unsigned int index);
+	// Takes the next block of a queue, waiting for it. Returns false when the executor stops.
+	bool receive(Queue& queue, unsigned int& index);
+};
@@ -0,0 +1,112 @@
+/*********************************************************************************************
+ * Implementation of the work-stealing thread pool.
+**********************************************************************************************/
+
+#include "ThreadPool.h"
+#include <algorithm>
+
+// Pool and index of the worker running on this thread (nullptr and -1 outside any pool). A task
+// may submit to another pool than its own, so the index only counts for the pool it belongs to.
+static thread_local const ThreadPool* current_pool = nullptr;
+static thread_local int current_worker = -1;
+
+ThreadPool::ThreadPool(unsigned int threads_num) : pending(0), queued(0), next_queue(0), stopping(false)
+{
+	if (!threads_num)
+		threads_num = std::max(1u, std::thread::hardware_concurrency());
+	
+	for (unsigned int i = 0; i < threads_num; i++)
+		queues.emplace_back(new Queue);
+	for (unsigned int i = 0; i < threads_num; i++)
+		threads.emplace_back(&ThreadPool::run, this, i);
+}
+
+ThreadPool::~ThreadPool()
+{
+	wait();
+	{
+		std::lock_guard<std::mutex> lock(state_mutex);
+		stopping = true;
+	}
+	work_available.notify_all();
+	for (std::thread& thread : threads)
+		thread.join();
+}
+
+void
+ThreadPool::submit(Task task)
+{
+	unsigned int target;
+	{
+		std::lock_guard<std::mutex> lock(state_mutex);
+		pending++;
+		queued++;
+		// Tasks spawned by a worker stay local (and are the first to be stolen by idle workers)
+		target = current_pool == this ? current_worker : next_queue++ % queues.size();
+	}
+	{
+		std::lock_guard<std::mutex> lock(queues[target]->mutex);
+		queues[target]->tasks.push_back(std::move(task));
+	}
+	work_available.notify_one();
+}
+
+void
+ThreadPool::wait()
+{
+	std::unique_lock<std::mutex> lock(state_mutex);
+	all_done.wait(lock, [this] { return pending == 0; });
+}
+
+bool
+ThreadPool::pop(unsigned int worker, Task& task)
+{
+	{
+		Queue& own = *queues[worker];
+		std::lock_guard<std::mutex> lock(own.mutex);
+		if (!own.tasks.empty()) {
+			task = std::move(own.tasks.back());
+			own.tasks.pop_back();
+			return true;
+		}
+	}
+	
+	for (unsigned int i = 1; i < queues.size(); i++) {
+		Queue& victim = *queues[(worker + i) % queues.size()];
+		std::lock_guard<std::mutex> lock(victim.mutex);
+		if (!victim.tasks.empty()) {
+			task = std::move(victim.tasks.front());
+			victim.tasks.pop_front();
+			return true;
+		}
+	}
+	return false;
+}
+
+void
+ThreadPool::run(unsigned int worker)
+{
+	current_pool = this;
+	current_worker = worker;
+	
+	while (true) {
+		Task task;
+		if (pop(worker, task)) {
+			{
+				std::lock_guard<std::mutex> lock(state_mutex);
+				queued--;
+			}
+			task(worker);
+			std::lock_guard<std::mutex> lock(state_mutex);
+			if (--pending == 0)
+				all_done.notify_all();
+			continue;
+		}
+		
+		// 'queued' is counted before the task is pushed, so a worker never sleeps while a task is on its way
+		std::unique_lock<std::mutex> lock(state_mutex);
+		work_available.wait(lock, [this] { return queued > 0 || stopping; });
+		if (stopping && queued == 0)
+			return;
+	}
+}
@@ -0,0 +1,65 @@
+/*********************************************************************************************
+ * A small work-stealing thread pool for the offline tools.
+ * Every worker has its own task queue: it takes tasks from the back of its own queue and,
+ * when it runs out, steals from the front of the other workers' queues, so long and short
+ * tasks (whole files, segments) spread evenly over all the cores.
+ * Tasks receive the index of the worker running them, so they can use per-worker state
+ * (effect instances, preallocated buffers) without any locking.
+**********************************************************************************************/
+
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ThreadPool
+{
+public:
+	typedef std::function<void(unsigned int worker)> Task;
+	
+	/**
+	 * Starts the workers.
+	 * @param threads - number of worker threads, 0 for one per core.
+	**/
+	ThreadPool(unsigned int threads = 0);
+	// Waits for the remaining tasks and stops the workers.
+	~ThreadPool();
+	
+	/**
+	 * Queues a task. May be called from any thread, including from a task.
+	 * @param task - the task, called with the index of the worker running it.
+	 * @returns nothing.
+	**/
+	void submit(Task task);
+	
+	// Blocks until every submitted task has finished.
+	void wait();
+	
+	unsigned int size() const { return threads.size(); }
+	
+private:
+	struct Queue
+	{
+		std::mutex mutex;
+		std::deque<Task> tasks;
+	};
+	
+	std::vector<std::unique_ptr<Queue>> queues;
+	std::vector<std::thread> threads;
+	
+	std::mutex state_mutex;
+	std::condition_variable work_available;
+	std::condition_variable all_done;
+	unsigned int pending;		// queued + running tasks
+	unsigned int queued;		// tasks waiting in the queues
+	unsigned int next_queue;	// round robin target for tasks submitted from outside the pool
+	bool stopping;
+	
+	bool pop(unsigned int worker, Task& task);
+	void run(unsigned int worker);
+};
@@ -0,0 +1,325 @@
+/*********************************************************************************************
+ * Batch renderer: runs the same chain of Effects over many WAV files using all the cores.
+ * Independent files are spread over a work-stealing thread pool. Long files can also be split
+ * into segments (--segment): each segment is rendered after a warm-up on the audio preceding it
+ * (--warmup, long enough for the reverb tail to decay), with the modulation phase of the effects
+ * advanced to the segment start, so segments can be rendered in parallel and joined seamlessly.
+ * Every worker owns its effect instances and buffers, and reuses them (with Effects::reset())
+ * from one task to the next.
+ * The output of a file is allocated when its first segment starts and freed as soon as it is written,
+ * and only about one file per thread is in flight, so the memory used does not grow with the number
+ * of files.
+ * Run with -h for usage.
+**********************************************************************************************/
+
+#include "EffectFactory.h"
+#include "ThreadPool.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <getopt.h>
+#include <memory>
+#include <mutex>
+
+struct Settings
+{
+	std::vector<std::string> chain;
+	std::vector<std::string> assignments;
+	unsigned int block_size = 16;
+	float segment_seconds = 0;
+	float warmup_seconds = 3;
+	float tail_seconds = 0;
+	unsigned int bits_per_sample = 16;
+	bool quiet = false;
+};
+
+// Effect instances and buffers owned by one worker thread
+class Worker
+{
+private:
+	const Settings& settings;
+	float sample_rate = 0;
+	std::unique_ptr<HostContext> host;
+	std::unique_ptr<GuiController> controller;
+	std::vector<std::unique_ptr<Effects>> chain;
+	
+public:
+	std::vector<float> input;		// reused between tasks, only grows
+	std::vector<float> scratch;
+	
+	Worker(const Settings& settings) : settings(settings) {}
+	
+	// Gets the chain ready for a new task: fresh state, same sliders.
+	void prepare(float rate)
+	{
+		if (rate != sample_rate) {
+			// The effects depend on the sample rate, rebuild them
+			sample_rate = rate;
+			host.reset(new HostContext(rate, settings.block_size));
+			controller.reset(new GuiController);
+			chain.clear();
+			for (const std::string& name : settings.chain)
+				chain.emplace_back(create_effect(name, host->get(), controller.get()));
+			for (const std::string& assignment : settings.assignments)
+				controller->applyAssignment(assignment);
+		}
+		
+		for (auto& effect : chain)
+			effect->reset();
+	}
+	
+	void advance(size_t frames)
+	{
+		for (auto& effect : chain)
+			effect->advance(frames, controller.get());
+	}
+	
+	void process(const float* in, float* out, size_t frames)
+	{
+		for (size_t frame = 0; frame < frames; frame += settings.block_size) {
+			unsigned int block = std::min<size_t>(settings.block_size, frames - frame);
+			const float* block_in = in + frame;
+			float* block_out = out + frame;
+			for (auto& effect : chain) {
+				effect->process_block(block_in, block_out, block, controller.get());
+				block_in = block_out;
+			}
+			if (chain.empty())
+				std::copy(block_in, block_in + block, block_out);
+		}
+	}
+};
+
+// A file being rendered by one or more segment tasks
+struct FileJob
+{
+	std::string input_path;
+	std::string output_path;
+	float sample_rate;
+	size_t input_frames;
+	size_t output_frames;					// input + tail
+	std::vector<std::vector<float>> output;	// allocated by the first segment that starts (see __output)
+	std::once_flag output_allocated;
+	std::atomic<unsigned int> remaining;	// segments still to render
+};
+
+static std::mutex print_mutex;
+static std::atomic<bool> failed(false);
+
+// Files submitted and not written yet, the main thread waits for room before submitting another one
+static std::mutex files_mutex;
+static std::condition_variable file_done;
+static unsigned int files_in_flight = 0;
+
+// The output of a file, allocated on first use
+static std::vector<float>&
+__output(FileJob& job)
+{
+	std::call_once(job.output_allocated, [&job] { job.output.assign(1, std::vector<float>(job.output_frames)); });
+	return job.output[0];
+}
+
+static void
+__finish(FileJob& job, const Settings& settings)
+{
+	__output(job);
+	int result = AudioFileUtilities::write(job.output_path, job.output, job.sample_rate, settings.bits_per_sample);
+	job.output.clear();
+	job.output.shrink_to_fit();
+	
+	{
+		std::lock_guard<std::mutex> lock(print_mutex);
+		if (result) {
+			fprintf(stderr, "Could not write '%s'\n", job.output_path.c_str());
+			failed = true;
+		}
+		else if (!settings.quiet) {
+			printf("%s -> %s\n", job.input_path.c_str(), job.output_path.c_str());
+		}
+	}
+	
+	std::lock_guard<std::mutex> lock(files_mutex);
+	files_in_flight--;
+	file_done.notify_one();
+}
+
+// Renders output frames [start, end) of a file
+static void
+__render_segment(Worker& worker, FileJob& job, const Settings& settings, size_t start, size_t end)
+{
+	const size_t warmup_frames = std::min<size_t>(start, settings.warmup_seconds * job.sample_rate);
+	const size_t first = start - warmup_frames;
+	const size_t frames = end - first;
+	
+	// Only load the part of the file this segment needs
+	worker.input.assign(frames, 0);
+	if (first < job.input_frames) {
+		size_t count = std::min(frames, job.input_frames - first);
+		if (AudioFileUtilities::getSamples(job.input_path, worker.input.data(), 0, first, first + count)) {
+			std::lock_guard<std::mutex> lock(print_mutex);
+			fprintf(stderr, "Could not read '%s'\n", job.input_path.c_str());
+			failed = true;
+		}
+	}
+	
+	worker.prepare(job.sample_rate);
+	worker.advance(first);
+	
+	// The warm-up output is thrown away
+	worker.scratch.resize(warmup_frames);
+	worker.process(worker.input.data(), worker.scratch.data(), warmup_frames);
+	worker.process(worker.input.data() + warmup_frames, &__output(job)[start], end - start);
+	
+	if (--job.remaining == 0)
+		__finish(job, settings);
+}
+
+static std::string
+__output_path(const std::string& input_path, const std::string& output_dir)
+{
+	size_t slash = input_path.find_last_of('/');
+	return output_dir + "/" + (slash == std::string::npos ? input_path : input_path.substr(slash + 1));
+}
+
+static void
+__usage(const char* program)
+{
+	fprintf(stderr,
+			"Usage: %s [options] -o <output dir> <input.wav>...\n"
+			"  -o, --output DIR      directory receiving the rendered files (same names as the inputs)\n"
+			"  -c, --chain LIST      comma separated effects, run in order (default distortion,wahwah,reverb)\n"
+			"                        known effects: %s\n"
+			"  -b, --block N         block size in frames (default 16)\n"
+			"  -s, --set NAME=VALUE  set a slider, may be repeated\n"
+			"  -j, --threads N       number of worker threads (default: one per core)\n"
+			"  -g, --segment SEC     split files longer than this into segments rendered in parallel (default: off)\n"
+			"  -w, --warmup SEC      audio rendered (and discarded) before every segment (default 3)\n"
+			"  -t, --tail SECONDS    append silence so the effects can ring out (default 0)\n"
+			"  -f, --float           write 32 bit float samples instead of 16 bit PCM\n"
+			"  -q, --quiet           only print errors and the final statistics\n",
+			program, known_effect_names().c_str());
+}
+
+int main(int argc, char* argv[])
+{
+	Settings settings;
+	std::string chain_list = "distortion,wahwah,reverb";
+	std::string output_dir;
+	unsigned int threads = 0;
+	
+	const struct option options[] = {
+		{"output", required_argument, nullptr, 'o'},
+		{"chain", required_argument, nullptr, 'c'},
+		{"block", required_argument, nullptr, 'b'},
+		{"set", required_argument, nullptr, 's'},
+		{"threads", required_argument, nullptr, 'j'},
+		{"segment", required_argument, nullptr, 'g'},
+		{"warmup", required_argument, nullptr, 'w'},
+		{"tail", required_argument, nullptr, 't'},
+		{"float", no_argument, nullptr, 'f'},
+		{"quiet", no_argument, nullptr, 'q'},
+		{"help", no_argument, nullptr, 'h'},
+		{nullptr, 0, nullptr, 0}
+	};
+	
+	int opt;
+	while ((opt = getopt_long(argc, argv, "o:c:b:s:j:g:w:t:fqh", options, nullptr)) != -1) {
+		switch (opt) {
+			case 'o': output_dir = optarg; break;
+			case 'c': chain_list = optarg; break;
+			case 'b': settings.block_size = atoi(optarg); break;
+			case 's': settings.assignments.push_back(optarg); break;
+			case 'j': threads = atoi(optarg); break;
+			case 'g': settings.segment_seconds = atof(optarg); break;
+			case 'w': settings.warmup_seconds = atof(optarg); break;
+			case 't': settings.tail_seconds = atof(optarg); break;
+			case 'f': settings.bits_per_sample = 32; break;
+			case 'q': settings.quiet = true; break;
+			default: __usage(argv[0]); return opt == 'h' ? 0 : 1;
+		}
+	}
+	if (!parse_effect_list(chain_list, settings.chain) || !settings.block_size || output_dir.empty() || optind == argc) {
+		__usage(argv[0]);
+		return 1;
+	}
+	
+	// Check the slider assignments once, before starting the workers
+	{
+		HostContext host(44100, settings.block_size);
+		GuiController controller;
+		std::vector<std::unique_ptr<Effects>> chain;
+		for (const std::string& name : settings.chain)
+			chain.emplace_back(create_effect(name, host.get(), &controller));
+		for (const std::string& assignment : settings.assignments) {
+			if (!controller.applyAssignment(assignment)) {
+				fprintf(stderr, "Unknown slider or bad assignment '%s'\n", assignment.c_str());
+				return 1;
+			}
+		}
+	}
+	
+	std::vector<std::unique_ptr<FileJob>> jobs;
+	double audio_seconds = 0;
+	for (int i = optind; i < argc; i++) {
+		int frames = AudioFileUtilities::getNumFrames(argv[i]);
+		int sample_rate = AudioFileUtilities::getSampleRate(argv[i]);
+		if (frames < 0 || sample_rate <= 0) {
+			fprintf(stderr, "Could not read '%s'\n", argv[i]);
+			failed = true;
+			continue;
+		}
+		
+		FileJob* job = new FileJob;
+		job->input_path = argv[i];
+		job->output_path = __output_path(argv[i], output_dir);
+		job->sample_rate = sample_rate;
+		job->input_frames = frames;
+		job->output_frames = frames + (size_t)(settings.tail_seconds * sample_rate);
+		jobs.emplace_back(job);
+		audio_seconds += (double)job->output_frames / sample_rate;
+	}
+	
+	ThreadPool pool(threads);
+	std::vector<std::unique_ptr<Worker>> workers;
+	for (unsigned int i = 0; i < pool.size(); i++)
+		workers.emplace_back(new Worker(settings));
+	
+	auto start_time = std::chrono::steady_clock::now();
+	
+	for (auto& job_ptr : jobs) {
+		FileJob& job = *job_ptr;
+		{
+			std::unique_lock<std::mutex> lock(files_mutex);
+			file_done.wait(lock, [&pool] { return files_in_flight < pool.size(); });
+			files_in_flight++;
+		}
+		
+		size_t segment_frames = settings.segment_seconds > 0 ? (size_t)(settings.segment_seconds * job.sample_rate) : 0;
+		if (!segment_frames || segment_frames >= job.output_frames)
+			segment_frames = std::max<size_t>(job.output_frames, 1);
+		
+		unsigned int segments = (job.output_frames + segment_frames - 1) / segment_frames;
+		job.remaining = std::max(segments, 1u);
+		if (!segments) {
+			pool.submit([&job, &settings](unsigned int) { __finish(job, settings); });
+			continue;
+		}
+		
+		for (unsigned int s = 0; s < segments; s++) {
+			size_t start = s * segment_frames;
+			size_t end = std::min(start + segment_frames, job.output_frames);
+			pool.submit([&job, &workers, &settings, start, end](unsigned int worker) {
+				__render_segment(*workers[worker], job, settings, start, end);
+			});
+		}
+	}
+	
+	pool.wait();
+	
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+	printf("Rendered %zu files, %.1f s of audio in %.2f s on %u threads (%.1fx realtime)\n",
+		   jobs.size(), audio_seconds, seconds, pool.size(), audio_seconds / seconds);
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,431 @@
+/*********************************************************************************************
+ * Micro and macro benchmarks for the effects.
+ * Every case is run for every block size and sample rate, over a deterministic noise input,
+ * and reports ns/sample, samples/sec and the share of the realtime budget it uses
+ * (100% means the effect alone would take the whole audio callback), and its slowest block
+ * (effects which do more work in some callbacks than in others, such as ConvolutionReverb, must keep
+ * it under the budget as well).
+ * The "-tail" cases measure the same effect on silence, after its feedback loops decayed for a long
+ * time: their cost must equal the loud one (see DenormalGuard).
+ * Output is a table by default, or CSV/JSON (one record per measurement) for regression tracking.
+ * Run with -h for usage.
+**********************************************************************************************/
+
+#include "EffectFactory.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <getopt.h>
+#include <memory>
+#include <sstream>
+
+// When true (-a), the effects of every case are constructed inside an Arena
+static bool __use_arena = false;
+const size_t benchmark_arena_bytes = 64 << 20;	// only the pages used are ever touched
+
+// Common interface of everything that can be benchmarked
+class Processor
+{
+public:
+	virtual ~Processor() = default;
+	virtual void process(const float* in, float* out, unsigned int frames) = 0;
+};
+
+// A chain of Effects with their own controller, configured with slider assignments.
+// With several channels, every channel is fed the same input (planar, with process_channels),
+// and the time is still reported per frame, so it compares to the mono case directly.
+class EffectsProcessor : public Processor
+{
+private:
+	GuiController controller;
+	std::unique_ptr<Arena> arena;		// holds the state of the effects with -a, destroyed after them
+	std::vector<std::unique_ptr<Effects>> effects;
+	EffectChain chain;
+	unsigned int channels;
+	std::vector<float> scratch;		// outputs of channels 1 and up
+	std::vector<const float*> ins;
+	std::vector<float*> outs;
+	
+public:
+	EffectsProcessor(BelaContext* context, const std::vector<std::string>& names, const std::vector<std::string>& assignments,
+					 unsigned int channels) :
+			chain(context, 16, channels), channels(channels), scratch((channels - 1) * context->audioFrames),
+			ins(channels), outs(channels)
+	{
+		if (__use_arena)
+			arena.reset(new Arena(benchmark_arena_bytes));
+		Arena::Scope scope(arena.get());
+		for (const std::string& name : names) {
+			effects.emplace_back(create_effect(name, context, &controller, channels));
+			chain.add(effects.back().get());
+		}
+		for (unsigned int c = 1; c < channels; c++)
+			outs[c] = &scratch[(c - 1) * context->audioFrames];
+		for (const std::string& assignment : assignments) {
+			if (!controller.applyAssignment(assignment)) {
+				fprintf(stderr, "Bad benchmark assignment '%s'\n", assignment.c_str());
+				exit(1);
+			}
+		}
+	}
+	
+	void process(const float* in, float* out, unsigned int frames) override
+	{
+		if (channels == 1) {
+			chain.process_block(in, out, frames, &controller);
+			return;
+		}
+		std::fill(ins.begin(), ins.end(), in);
+		outs[0] = out;
+		chain.process_channels(ins.data(), outs.data(), frames, &controller);
+	}
+};
+
+// The Schroeder allpass of render_for_IIR.cpp, with the runtime IIRFilter and external RingBuffers
+class IIRFilterProcessor : public Processor
+{
+private:
+	std::unique_ptr<IIRFilter> filter;
+	RingBuffer<float> inputs;
+	RingBuffer<float> outputs;
+	
+public:
+	IIRFilterProcessor(BelaContext* context) : inputs(context->audioSampleRate), outputs(context->audioSampleRate)
+	{
+		const float g = pow(0.001, 5/96.83);
+		const unsigned int D = 5 * (context->audioSampleRate/1000);
+		FilterElement input_elements[2] = {{0, -g}, {D, 1}};
+		FilterElement output_elements[1] = {{D, -g}};
+		filter.reset(new IIRFilter(2, input_elements, 1, output_elements));
+	}
+	
+	void process(const float* in, float* out, unsigned int frames) override
+	{
+		for (unsigned int n = 0; n < frames; n++) {
+			inputs.write(in[n]);
+			out[n] = filter->process(inputs, outputs);
+			outputs.write(out[n]);
+		}
+	}
+};
+
+// The same allpass with the IIRFilter keeping its own history
+class StatefulIIRFilterProcessor : public Processor
+{
+private:
+	std::unique_ptr<IIRFilter> filter;
+	
+public:
+	StatefulIIRFilterProcessor(BelaContext* context)
+	{
+		const float g = pow(0.001, 5/96.83);
+		const unsigned int D = 5 * (context->audioSampleRate/1000);
+		FilterElement input_elements[2] = {{0, -g}, {D, 1}};
+		FilterElement output_elements[1] = {{D, -g}};
+		filter.reset(new IIRFilter(2, input_elements, 1, output_elements));
+	}
+	
+	void process(const float* in, float* out, unsigned int frames) override
+	{
+		filter->process(in, out, frames);
+	}
+};
+
+// The same allpass with the compile-time StaticIIRFilter
+class StaticIIRFilterProcessor : public Processor
+{
+private:
+	typedef StaticIIRFilter<2, 1, 1024> Allpass;
+	std::unique_ptr<Allpass> filter;
+	
+public:
+	StaticIIRFilterProcessor(BelaContext* context)
+	{
+		const float g = pow(0.001, 5/96.83);
+		const unsigned int D = 5 * (context->audioSampleRate/1000);
+		filter.reset(new Allpass({{ {0, -g}, {D, 1} }}, {{ {D, -g} }}));
+	}
+	
+	void process(const float* in, float* out, unsigned int frames) override
+	{
+		filter->process(in, out, frames);
+	}
+};
+
+struct BenchmarkCase
+{
+	std::string name;		// effect (or chain) name
+	std::string settings;	// human readable parameter settings
+	std::function<Processor*(BelaContext*)> create;
+	float tail_seconds = 0;	// when not 0: silence after one second of noise, measured once it has lasted this long
+};
+
+static BenchmarkCase
+__effects_case(const std::string& name, const std::string& chain, const std::vector<std::string>& assignments,
+			   unsigned int channels = 1)
+{
+	std::vector<std::string> names;
+	parse_effect_list(chain, names);
+	std::string settings;
+	for (const std::string& assignment : assignments)
+		settings += (settings.empty() ? "" : ";") + assignment;
+	return {name, settings.empty() ? "default" : settings,
+			[names, assignments, channels](BelaContext* context) {
+				return new EffectsProcessor(context, names, assignments, channels);
+			}};
+}
+
+// The same case on the silent tail of the effect
+static BenchmarkCase
+__tail_case(BenchmarkCase benchmark, float tail_seconds)
+{
+	benchmark.name += "-tail";
+	benchmark.tail_seconds = tail_seconds;
+	return benchmark;
+}
+
+static std::vector<BenchmarkCase>
+__all_cases()
+{
+	return {
+		__effects_case("distortion", "distortion", {"Gain=20"}),
+		__effects_case("distortion", "distortion", {"Gain=20", "Distortion/Overdrive=1"}),
+		__effects_case("distortion-2x", "distortion-2x", {"Gain=20", "Distortion/Overdrive=1"}),
+		__effects_case("wahwah", "wahwah", {"Q=0.5", "Dry/Wet=0.5"}),
+		__effects_case("wahwah", "wahwah", {"Q=10", "Dry/Wet=0.5"}),
+		__effects_case("wahwah-exact", "wahwah-exact", {"Q=10", "Dry/Wet=0.5"}),
+		__effects_case("wahwah-table", "wahwah-table", {"Q=10", "Dry/Wet=0.5"}),
+		__effects_case("reverb", "reverb", {"Reverb Time (ms)=100", "Mix Percentage=0.5"}),
+		__effects_case("reverb", "reverb", {"Reverb Time (ms)=3000", "Mix Percentage=0.5"}),
+		__effects_case("densereverb", "densereverb", {"Reverb Time (ms)=3000", "Mix Percentage=0.5"}),
+		__effects_case("convolution", "convolution", {"Convolution Mix=0.5"}),
+		__effects_case("fdn", "fdn", {"FDN Reverb Time (ms)=3000", "FDN Mix=0.5"}),
+		__effects_case("fdn-16", "fdn-16", {"FDN Reverb Time (ms)=3000", "FDN Mix=0.5"}),
+		{"iirfilter", "allpass D=5ms", [](BelaContext* context) { return new IIRFilterProcessor(context); }},
+		{"iirfilter-stateful", "allpass D=5ms", [](BelaContext* context) { return new StatefulIIRFilterProcessor(context); }},
+		{"staticiirfilter", "allpass D=5ms", [](BelaContext* context) { return new StaticIIRFilterProcessor(context); }},
+		// The chain of effects_render.cpp
+		__effects_case("chain", "distortion,wahwah,reverb", {"Gain=20", "Dry/Wet=0.5", "Mix Percentage=0.5"}),
+		// Planar multichannel processing, per frame
+		__effects_case("wahwah-stereo", "wahwah", {"Q=10", "Dry/Wet=0.5"}, 2),
+		__effects_case("wahwah-quad", "wahwah", {"Q=10", "Dry/Wet=0.5"}, 4),
+		__effects_case("chain-stereo", "distortion,wahwah,reverb", {"Gain=20", "Dry/Wet=0.5", "Mix Percentage=0.5"}, 2),
+		// Silent tails, long enough for the feedback loops to reach the denormal range (-760 dB) without protection
+		__tail_case(__effects_case("reverb", "reverb", {"Reverb Time (ms)=3000", "Mix Percentage=0.5"}), 40),
+		__tail_case(__effects_case("fdn", "fdn", {"FDN Reverb Time (ms)=3000", "FDN Mix=0.5"}), 40),
+		__tail_case(__effects_case("wahwah", "wahwah", {"Q=10", "Dry/Wet=0.5"}), 5),
+		__tail_case(__effects_case("wahwah-exact", "wahwah-exact", {"Q=10", "Dry/Wet=0.5"}), 5),
+		__tail_case({"iirfilter-stateful", "allpass D=5ms", [](BelaContext* context) { return new StatefulIIRFilterProcessor(context); }}, 5),
+		__tail_case({"staticiirfilter", "allpass D=5ms", [](BelaContext* context) { return new StaticIIRFilterProcessor(context); }}, 5),
+		__tail_case(__effects_case("chain", "distortion,wahwah,reverb", {"Gain=20", "Dry/Wet=0.5", "Mix Percentage=0.5"}), 20),
+	};
+}
+
+struct Result
+{
+	std::string name;
+	std::string settings;
+	float sample_rate;
+	unsigned int block_size;
+	double ns_per_sample;
+	double samples_per_second;
+	double realtime_percent;
+	double worst_block_us;		// the slowest block
+	double worst_block_percent;	// the slowest block, in % of the time of a block
+};
+
+static volatile float sink;
+
+static Result
+__run(const BenchmarkCase& benchmark, float sample_rate, unsigned int block_size, double seconds, unsigned int repeats)
+{
+	HostContext host(sample_rate, block_size);
+	std::unique_ptr<Processor> processor(benchmark.create(host.get()));
+	
+	// Deterministic white noise at -6dB, one second long
+	std::vector<float> input((size_t)sample_rate + block_size);
+	uint32_t seed = 12345;
+	for (float& sample : input) {
+		seed = seed * 1664525 + 1013904223;
+		sample = ((int32_t)seed / 2147483648.0f) * 0.5f;
+	}
+	std::vector<float> output(block_size);
+	
+	const size_t blocks = std::max<size_t>(1, (size_t)(seconds * sample_rate / block_size));
+	const size_t input_blocks = (input.size() - block_size) / block_size;
+	
+	// Warm up caches and delay lines, then keep the best of the repeats
+	for (size_t b = 0; b < std::min<size_t>(blocks, input_blocks); b++)
+		processor->process(&input[b * block_size], output.data(), block_size);
+	
+	// Tail cases: the loud warm up, then silence until the feedback loops have decayed, and silence is measured
+	if (benchmark.tail_seconds > 0) {
+		for (size_t b = 0; b < input_blocks; b++)
+			processor->process(&input[b * block_size], output.data(), block_size);
+		std::fill(input.begin(), input.end(), 0.0f);
+		const size_t tail_blocks = (size_t)(benchmark.tail_seconds * sample_rate / block_size);
+		for (size_t b = 0; b < tail_blocks; b++)
+			processor->process(&input[0], output.data(), block_size);
+	}
+	
+	double best = 1e30;
+	for (unsigned int r = 0; r < repeats; r++) {
+		auto start = std::chrono::steady_clock::now();
+		for (size_t b = 0; b < blocks; b++)
+			processor->process(&input[(b % input_blocks) * block_size], output.data(), block_size);
+		auto end = std::chrono::steady_clock::now();
+		best = std::min(best, std::chrono::duration<double>(end - start).count());
+		sink = output[0];
+	}
+	
+	// The slowest block, in separate passes (the clock calls would count in the measurements above).
+	// The fastest of the passes is kept, so the worst case is the one of the effect rather than a preemption.
+	double worst = 1e30;
+	for (unsigned int r = 0; r < repeats; r++) {
+		double slowest = 0;
+		for (size_t b = 0; b < blocks; b++) {
+			auto start = std::chrono::steady_clock::now();
+			processor->process(&input[(b % input_blocks) * block_size], output.data(), block_size);
+			auto end = std::chrono::steady_clock::now();
+			slowest = std::max(slowest, std::chrono::duration<double>(end - start).count());
+		}
+		worst = std::min(worst, slowest);
+		sink = output[0];
+	}
+	
+	const double samples = (double)blocks * block_size;
+	Result result;
+	result.name = benchmark.name;
+	result.settings = benchmark.settings;
+	result.sample_rate = sample_rate;
+	result.block_size = block_size;
+	result.ns_per_sample = 1e9 * best / samples;
+	result.samples_per_second = samples / best;
+	result.realtime_percent = 100 * sample_rate / result.samples_per_second;
+	result.worst_block_us = 1e6 * worst;
+	result.worst_block_percent = 100 * worst * sample_rate / block_size;
+	return result;
+}
+
+template <typename T>
+static bool
+__parse_list(const std::string& list, std::vector<T>& values)
+{
+	std::istringstream stream(list);
+	std::string item;
+	values.clear();
+	while (std::getline(stream, item, ',')) {
+		char* end = nullptr;
+		double value = strtod(item.c_str(), &end);
+		if (*end || value <= 0)
+			return false;
+		values.push_back(value);
+	}
+	return !values.empty();
+}
+
+static void
+__usage(const char* program)
+{
+	fprintf(stderr,
+			"Usage: %s [options]\n"
+			"  -e, --effects LIST    comma separated cases to run (default: all)\n"
+			"                        cases: distortion,distortion-2x,wahwah,wahwah-exact,wahwah-table,reverb,densereverb,\n"
+			"                        convolution,fdn,fdn-16,iirfilter,iirfilter-stateful,staticiirfilter,chain,\n"
+			"                        wahwah-stereo,wahwah-quad,chain-stereo,\n"
+			"                        reverb-tail,fdn-tail,wahwah-tail,wahwah-exact-tail,iirfilter-stateful-tail,staticiirfilter-tail,chain-tail\n"
+			"  -b, --blocks LIST     comma separated block sizes (default 1,2,4,8,16,32,64,128)\n"
+			"  -r, --rates LIST      comma separated sample rates (default 44100,48000,96000)\n"
+			"  -s, --seconds SEC     audio seconds processed per measurement (default 1)\n"
+			"  -n, --repeats N       measurements per case, the best one is kept (default 3)\n"
+			"  -f, --format FORMAT   table, csv or json (default table)\n"
+			"  -a, --arena           construct the effects inside an Arena (contiguous state)\n",
+			program);
+}
+
+int main(int argc, char* argv[])
+{
+	std::string effects_filter;
+	std::vector<unsigned int> block_sizes = {1, 2, 4, 8, 16, 32, 64, 128};
+	std::vector<float> sample_rates = {44100, 48000, 96000};
+	double seconds = 1;
+	unsigned int repeats = 3;
+	std::string format = "table";
+	
+	const struct option options[] = {
+		{"effects", required_argument, nullptr, 'e'},
+		{"blocks", required_argument, nullptr, 'b'},
+		{"rates", required_argument, nullptr, 'r'},
+		{"seconds", required_argument, nullptr, 's'},
+		{"repeats", required_argument, nullptr, 'n'},
+		{"format", required_argument, nullptr, 'f'},
+		{"arena", no_argument, nullptr, 'a'},
+		{"help", no_argument, nullptr, 'h'},
+		{nullptr, 0, nullptr, 0}
+	};
+	
+	int opt;
+	bool ok = true;
+	while ((opt = getopt_long(argc, argv, "e:b:r:s:n:f:ah", options, nullptr)) != -1) {
+		switch (opt) {
+			case 'e': effects_filter = "," + std::string(optarg) + ","; break;
+			case 'b': ok &= __parse_list(optarg, block_sizes); break;
+			case 'r': ok &= __parse_list(optarg, sample_rates); break;
+			case 's': seconds = atof(optarg); break;
+			case 'n': repeats = std::max(1, atoi(optarg)); break;
+			case 'f': format = optarg; break;
+			case 'a': __use_arena = true; break;
+			default: __usage(argv[0]); return opt == 'h' ? 0 : 1;
+		}
+	}
+	if (!ok || seconds <= 0 || (format != "table" && format != "csv" && format != "json")) {
+		__usage(argv[0]);
+		return 1;
+	}
+	
+	if (format == "table")
+		printf("%-24s %-43s %7s %6s %12s %14s %10s %10s %10s\n", "effect", "settings", "rate", "block", "ns/sample", "samples/sec",
+			   "%realtime", "worst us", "worst %");
+	else if (format == "csv")
+		printf("effect,settings,sample_rate,block_size,ns_per_sample,samples_per_second,realtime_percent,worst_block_us,worst_block_percent\n");
+	else
+		printf("[\n");
+	
+	bool first = true;
+	for (const BenchmarkCase& benchmark : __all_cases()) {
+		if (!effects_filter.empty() && effects_filter.find("," + benchmark.name + ",") == std::string::npos)
+			continue;
+		
+		for (float sample_rate : sample_rates) {
+			for (unsigned int block_size : block_sizes) {
+				Result r = __run(benchmark, sample_rate, block_size, seconds, repeats);
+				
+				if (format == "table") {
+					printf("%-24s %-43s %7.0f %6u %12.2f %14.0f %9.3f%% %10.2f %9.2f%%\n", r.name.c_str(), r.settings.c_str(),
+						   r.sample_rate, r.block_size, r.ns_per_sample, r.samples_per_second, r.realtime_percent,
+						   r.worst_block_us, r.worst_block_percent);
+				}
+				else if (format == "csv") {
+					printf("%s,\"%s\",%.0f,%u,%.3f,%.0f,%.4f,%.3f,%.3f\n", r.name.c_str(), r.settings.c_str(),
+						   r.sample_rate, r.block_size, r.ns_per_sample, r.samples_per_second, r.realtime_percent,
+						   r.worst_block_us, r.worst_block_percent);
+				}
+				else {
+					printf("%s  {\"effect\": \"%s\", \"settings\": \"%s\", \"sample_rate\": %.0f, \"block_size\": %u, "
+						   "\"ns_per_sample\": %.3f, \"samples_per_second\": %.0f, \"realtime_percent\": %.4f, "
+						   "\"worst_block_us\": %.3f, \"worst_block_percent\": %.3f}",
+						   first ? "" : ",\n", r.name.c_str(), r.settings.c_str(), r.sample_rate, r.block_size,
+						   r.ns_per_sample, r.samples_per_second, r.realtime_percent, r.worst_block_us, r.worst_block_percent);
+				}
+				first = false;
+				fflush(stdout);
+			}
+		}
+	}
+	
+	if (format == "json")
+		printf("\n]\n");
+	return 0;
+}
@@ -0,0 +1,259 @@
+/*********************************************************************************************
+ * Offline renderer: runs a chain of Effects over a WAV file as fast as the CPU allows.
+ * Every channel of the file is processed (planar, with process_channels), unless --mono is given.
+ * The effects run exactly as in render() on the board (same block size, in an EffectChain driven
+ * with process_channels), so the tool can be used both to batch-process material and to profile
+ * the DSP with perf/valgrind on a regular Linux machine.
+ * With --pipeline, the stages of the chain (separated by ':' in the chain list) run on their own
+ * threads (PipelineExecutor), and the output is the same as with the serial chain.
+ * Run with -h for usage.
+**********************************************************************************************/
+
+#include "EffectFactory.h"
+#include "PipelineExecutor.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <getopt.h>
+#include <memory>
+
+static void
+__usage(const char* program)
+{
+	fprintf(stderr,
+			"Usage: %s [options] <input.wav> <output.wav>\n"
+			"  -c, --chain LIST      comma separated effects, run in order (default distortion,wahwah,reverb)\n"
+			"                        known effects: %s\n"
+			"                        ':' splits the chain into pipeline stages, e.g. distortion,wahwah:reverb\n"
+			"  -b, --block N         block size in frames (default 16)\n"
+			"  -s, --set NAME=VALUE  set a slider before rendering, may be repeated\n"
+			"  -S, --script FILE     timed slider script (\"<seconds> <slider name> = <value>\" per line)\n"
+			"  -t, --tail SECONDS    append silence so the effects can ring out (default 0)\n"
+			"  -f, --float           write 32 bit float samples instead of 16 bit PCM\n"
+			"  -m, --mono            only process the first channel of the input\n"
+			"  -p, --profile         print the time every effect takes per block (CpuMonitor)\n"
+			"  -M, --meter           print the peak/RMS level and clipped samples after every effect (SignalMeter)\n"
+			"  -P, --pipeline        run every stage on its own thread (one stage per effect if there is no ':')\n"
+			"  -L, --latency BLOCKS  blocks in flight with --pipeline (default two per stage)\n"
+			"  -l, --list-sliders    print the sliders of the chain and exit\n"
+			"  -q, --quiet           do not print statistics\n",
+			program, known_effect_names().c_str());
+}
+
+int main(int argc, char* argv[])
+{
+	std::string chain_list = "distortion,wahwah,reverb";
+	unsigned int block_size = 16;
+	std::vector<std::string> assignments;
+	std::string script_path;
+	float tail_seconds = 0;
+	unsigned int bits_per_sample = 16;
+	bool mono = false;
+	bool profile = false;
+	bool meter_levels = false;
+	bool pipeline = false;
+	unsigned int latency = 0;
+	bool list_sliders = false;
+	bool quiet = false;
+	
+	const struct option options[] = {
+		{"chain", required_argument, nullptr, 'c'},
+		{"block", required_argument, nullptr, 'b'},
+		{"set", required_argument, nullptr, 's'},
+		{"script", required_argument, nullptr, 'S'},
+		{"tail", required_argument, nullptr, 't'},
+		{"float", no_argument, nullptr, 'f'},
+		{"mono", no_argument, nullptr, 'm'},
+		{"profile", no_argument, nullptr, 'p'},
+		{"meter", no_argument, nullptr, 'M'},
+		{"pipeline", no_argument, nullptr, 'P'},
+		{"latency", required_argument, nullptr, 'L'},
+		{"list-sliders", no_argument, nullptr, 'l'},
+		{"quiet", no_argument, nullptr, 'q'},
+		{"help", no_argument, nullptr, 'h'},
+		{nullptr, 0, nullptr, 0}
+	};
+	
+	int opt;
+	while ((opt = getopt_long(argc, argv, "c:b:s:S:t:fmpMPL:lqh", options, nullptr)) != -1) {
+		switch (opt) {
+			case 'c': chain_list = optarg; break;
+			case 'b': block_size = atoi(optarg); break;
+			case 's': assignments.push_back(optarg); break;
+			case 'S': script_path = optarg; break;
+			case 't': tail_seconds = atof(optarg); break;
+			case 'f': bits_per_sample = 32; break;
+			case 'm': mono = true; break;
+			case 'p': profile = true; break;
+			case 'M': meter_levels = true; break;
+			case 'P': pipeline = true; break;
+			case 'L': latency = atoi(optarg); break;
+			case 'l': list_sliders = true; break;
+			case 'q': quiet = true; break;
+			default: __usage(argv[0]); return opt == 'h' ? 0 : 1;
+		}
+	}
+	
+	// Effect names of every stage
+	std::vector<std::vector<std::string>> stage_names;
+	std::vector<std::string> names;
+	for (size_t start = 0; start <= chain_list.size(); ) {
+		size_t end = std::min(chain_list.find(':', start), chain_list.size());
+		stage_names.emplace_back();
+		if (!parse_effect_list(chain_list.substr(start, end - start), stage_names.back())) {
+			__usage(argv[0]);
+			return 1;
+		}
+		names.insert(names.end(), stage_names.back().begin(), stage_names.back().end());
+		start = end + 1;
+	}
+	if (pipeline && stage_names.size() == 1) {
+		stage_names.clear();
+		for (const std::string& name : names)
+			stage_names.push_back({name});
+	}
+	// The monitor and the meter are fed by a single audio thread
+	if (block_size == 0 || (pipeline && (profile || meter_levels))) {
+		__usage(argv[0]);
+		return 1;
+	}
+	if (!list_sliders && argc - optind != 2) {
+		__usage(argv[0]);
+		return 1;
+	}
+	
+	std::vector<std::vector<float>> input(1);
+	int sample_rate = 44100;
+	if (!list_sliders) {
+		input = AudioFileUtilities::load(argv[optind]);
+		sample_rate = AudioFileUtilities::getSampleRate(argv[optind]);
+		if (input.empty() || input[0].empty() || sample_rate <= 0) {
+			fprintf(stderr, "Could not read '%s'\n", argv[optind]);
+			return 1;
+		}
+		if (mono)
+			input.resize(1);
+	}
+	const unsigned int channels = input.size();
+	
+	HostContext host(sample_rate, block_size);
+	GuiController controller;
+	std::vector<std::unique_ptr<Effects>> effects;
+	EffectChain chain(host.get(), names.size(), channels);
+	for (const std::string& name : names) {
+		effects.emplace_back(create_effect(name, host.get(), &controller, channels));
+		chain.add(effects.back().get());
+	}
+	
+	// The same effects, split into one chain per pipeline stage
+	std::vector<std::unique_ptr<EffectChain>> stages;
+	PipelineExecutor executor(host.get(), channels, latency);
+	if (pipeline) {
+		unsigned int next = 0;
+		for (const std::vector<std::string>& stage : stage_names) {
+			stages.emplace_back(new EffectChain(host.get(), stage.size(), channels));
+			for (unsigned int i = 0; i < stage.size(); i++)
+				stages.back()->add(effects[next++].get());
+			executor.add_stage(stages.back().get());
+		}
+	}
+	
+	CpuMonitor monitor(host.get());
+	if (profile) {
+		for (unsigned int i = 0; i < names.size(); i++)
+			monitor.set_name(effects[i].get(), names[i]);
+		chain.set_monitor(&monitor);
+	}
+	monitor.set_enabled(profile);
+	
+	SignalMeter meter(host.get(), channels);
+	if (meter_levels) {
+		for (unsigned int i = 0; i < names.size(); i++)
+			meter.set_name(effects[i].get(), names[i]);
+		chain.set_meter(&meter);
+	}
+	
+	if (list_sliders) {
+		for (unsigned int i = 0; i < controller.getNumSliders(); i++)
+			printf("%s = %g\n", controller.getSliderName(i).c_str(), controller.getSliderValue(i));
+		return 0;
+	}
+	
+	for (const std::string& assignment : assignments) {
+		if (!controller.applyAssignment(assignment)) {
+			fprintf(stderr, "Unknown slider or bad assignment '%s'\n", assignment.c_str());
+			return 1;
+		}
+	}
+	if (!script_path.empty() && !controller.loadScript(script_path)) {
+		fprintf(stderr, "Could not load script '%s'\n", script_path.c_str());
+		return 1;
+	}
+	
+	const size_t total_frames = input[0].size() + (size_t)(tail_seconds * sample_rate);
+	for (std::vector<float>& channel : input)
+		channel.resize(total_frames, 0);
+	std::vector<std::vector<float>> output(channels, std::vector<float>(total_frames));
+	std::vector<const float*> in(channels);
+	std::vector<float*> out(channels);
+	
+	auto start = std::chrono::steady_clock::now();
+	
+	if (pipeline) {
+		executor.start(&controller);
+		// The output lags by up to get_latency() blocks, the blocks popped are written where they belong
+		size_t output_frame = 0;
+		for (size_t frame = 0; frame < total_frames || executor.in_flight(); ) {
+			if (frame < total_frames && executor.in_flight() < executor.get_latency()) {
+				unsigned int frames = std::min<size_t>(block_size, total_frames - frame);
+				for (unsigned int c = 0; c < channels; c++)
+					in[c] = &input[c][frame];
+				executor.push(in.data(), frames, (double)frame / sample_rate);
+				frame += frames;
+				continue;
+			}
+			for (unsigned int c = 0; c < channels; c++)
+				out[c] = &output[c][output_frame];
+			output_frame += executor.pop(out.data());
+		}
+	}
+	
+	for (size_t frame = 0; !pipeline && frame < total_frames; frame += block_size) {
+		unsigned int frames = std::min<size_t>(block_size, total_frames - frame);
+		for (unsigned int c = 0; c < channels; c++) {
+			in[c] = &input[c][frame];
+			out[c] = &output[c][frame];
+		}
+		
+		controller.update((double)frame / sample_rate);
+		
+		monitor.begin_block();
+		chain.process_channels(in.data(), out.data(), frames, &controller);
+		monitor.end_block(frames);
+		if (profile)
+			monitor.poll();
+		if (meter_levels) {
+			meter.measure(nullptr, out.data(), channels, frames);
+			meter.poll();
+		}
+	}
+	
+	auto end = std::chrono::steady_clock::now();
+	
+	if (AudioFileUtilities::write(argv[optind + 1], output, sample_rate, bits_per_sample)) {
+		fprintf(stderr, "Could not write '%s'\n", argv[optind + 1]);
+		return 1;
+	}
+	
+	if (!quiet) {
+		double seconds = std::chrono::duration<double>(end - start).count();
+		double audio_seconds = (double)total_frames / sample_rate;
+		printf("Rendered %.2f s of audio in %.3f s (%.1fx realtime, %.1f ns/sample)\n",
+			   audio_seconds, seconds, audio_seconds / seconds, 1e9 * seconds / (total_frames * channels));
+	}
+	if (profile)
+		monitor.print();
+	if (meter_levels)
+		meter.print();
+	return 0;
+}
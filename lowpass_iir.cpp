@@ -3,80 +3,71 @@
 *****************************************/
 
 /****************************************************
- * This is an example of how to use the 'IIRFilter'
- * class in a Bela program.
+ * This is an example of how to use the
+ * 'StaticIIRFilter' class in a Bela program.
  * In this case we will implement a lowpass filter
  * The filter difference equation is:
  * y[n] = (1-a)*x[n] + a*y[n-1]
+ * The number of taps is fixed, so the filter is
+ * fully unrolled by the compiler.
 *****************************************************/
 
 #include "Effects.h"
 
-std::vector<float> input_buffer;
-RingBuffer<float>* inputs = nullptr;
-RingBuffer<float>* outputs = nullptr;
-int rd_ptr = 0;
+AudioFileStream* song = nullptr;
+std::vector<float> block_buffer;
 std::string song_path = "../Californication_Instrumental.wav";
 
 Scope scope;
 
+// One input tap, one output tap and a history of 2 samples (y[n-1] is output delay 0, as with IIRFilter).
+typedef StaticIIRFilter<1, 1, 2> LowpassFilter;
+
 // Declare a global pointer for the filter.
-IIRFilter* schroeder_allpass = nullptr;
+LowpassFilter* lowpass = nullptr;
 
 bool setup(BelaContext *context, void *userData)
 {
 	scope.setup(1, context->audioSampleRate);
 	
-	float a = 0.99;
-
-	// Initialize coefficients arrays:
-	// Inputs:
-	FilterElement input_elements[1];
-	// (1-a)*x[n]
-	input_elements[0].delay = 0;
-	input_elements[0].coefficient = 1-a;
-
-	//Outputs:
-	FilterElement output_elements[1];
-	// a*y[n-1]
-	output_elements[0].delay = 1;
-	output_elements[0].coefficient = -a;
+	const float a = 0.99;
 	
-	// Initialize the filter
-	schroeder_allpass = new IIRFilter(1, input_elements, 1, output_elements);
+	// Initialize the filter:
+	lowpass = new LowpassFilter(
+			// Inputs: (1-a)*x[n]
+			{{ {0, 1-a} }},
+			// Outputs: a*y[n-1]
+			{{ {0, -a} }});
 	
-	input_buffer = AudioFileUtilities::loadMono(song_path);
-	
-	// Initiaize RingBuffers for inputs and Outputs
-	inputs = new RingBuffer<float>(input_buffer.size());
-	outputs = new RingBuffer<float>(int(context->audioSampleRate));
+	song = new AudioFileStream(song_path);
+	if (!song->is_open()) {
+		rt_printf("Could not open '%s'\n", song_path.c_str());
+		return false;
+	}
+	block_buffer.resize(context->audioFrames);
 	
 	return true;
 }
 
 void render(BelaContext *context, void *userData)
 {
+	float* block = block_buffer.data();
+	
+	song->read(&block, context->audioFrames);
+	
+	lowpass->process(block, block, context->audioFrames);
+	
 	for(unsigned int n = 0; n < context->audioFrames; n++) {
-    	
-	    inputs->write(input_buffer[rd_ptr]);
-	    if(++rd_ptr >= input_buffer.size()) {
-	        rd_ptr = 0;
-	    }
-
-	    float out = schroeder_allpass->process(*inputs, *outputs);
-	    outputs->write(out);
-
-	    scope.log(out);
+	    scope.log(block[n]);
 	    
 		for(unsigned int channel = 0; channel < context->audioOutChannels; channel++) {
-			audioWrite(context, n, channel, out);
+			audioWrite(context, n, channel, block[n]);
 		}
     }
 }
 
 void cleanup(BelaContext *context, void *userData)
 {
-	delete schroeder_allpass;
-	delete inputs;
-	delete outputs;
+	delete lowpass;
+	delete song;
 }
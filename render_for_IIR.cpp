@@ -10,14 +10,14 @@
  * (as part of the Schroeder's Reverb algorithm).
  * The filter difference equation is:
  * y[n] = x[n-D] - g * x[n] + g * y[n-D]
+ * The filter keeps its own history (a few kB),
+ * so no RingBuffers need to be allocated here.
 *****************************************************/
 
 #include "Effects.h"
 
-std::vector<float> input_buffer;
-RingBuffer<float>* inputs = nullptr;
-RingBuffer<float>* outputs = nullptr;
-int rd_ptr = 0;
+AudioFileStream* song = nullptr;
+std::vector<float> block_buffer;
 std::string song_path = "../Californication_Instrumental.wav";
 
 const float apf1_delay_ms = 5;
@@ -51,29 +51,28 @@ bool setup(BelaContext *context, void *userData)
 	// Initialize the filter
 	schroeder_allpass = new IIRFilter(2, input_elements, 1, output_elements);
 	
-	input_buffer = AudioFileUtilities::loadMono(song_path);
+	song = new AudioFileStream(song_path);
+	if (!song->is_open()) {
+		rt_printf("Could not open '%s'\n", song_path.c_str());
+		return false;
+	}
 	
-	// Initiaize RingBuffers for inputs and Outputs
-	inputs = new RingBuffer<float>(input_buffer.size());
-	outputs = new RingBuffer<float>(int(context->audioSampleRate));
+	block_buffer.resize(context->audioFrames);
 	
 	return true;
 }
 
 void render(BelaContext *context, void *userData)
 {
+	float* block = block_buffer.data();
+	song->read(&block, context->audioFrames);
+	
+	// Filter the whole block, the filter keeps the history from one block to the next
+	schroeder_allpass->process(block, block, context->audioFrames);
+	
 	for(unsigned int n = 0; n < context->audioFrames; n++) {
-    	
-	    inputs->write(input_buffer[rd_ptr]);
-	    if(++rd_ptr >= input_buffer.size()) {
-	        rd_ptr = 0;
-	    }
-
-	    float out = schroeder_allpass->process(*inputs, *outputs);
-	    outputs->write(out);
-	    
 		for(unsigned int channel = 0; channel < context->audioOutChannels; channel++) {
-			audioWrite(context, n, channel, out);
+			audioWrite(context, n, channel, block[n]);
 		}
     }
 }
@@ -81,7 +80,5 @@ void render(BelaContext *context, void *userData)
 void cleanup(BelaContext *context, void *userData)
 {
 	delete schroeder_allpass;
-	delete inputs;
-	delete outputs;
+	delete song;
 }
-